@@ -0,0 +1,47 @@
+#include "ConstexprAssembler.h"
+
+//Compile-time assembly is only instantiated by programs embedding code, so these checks build it with the library:
+//a change to the instruction table or the lexer that breaks it fails here instead of in a user's build.
+
+namespace {
+
+/**
+ * @brief Compares an assembled program with the bytes it should hold.
+ * @param bytes Assembled bytes.
+ * @param expected Bytes they should be.
+ * @return true if both have the same size and bytes.
+ */
+template<size_t Size, size_t ExpectedSize>
+constexpr bool same_bytes(const std::array<uint8_t, Size>& bytes, const uint8_t (&expected)[ExpectedSize]){
+    if(Size != ExpectedSize){
+        return false;
+    }
+    for(size_t i = 0; i < Size; i++){
+        if(bytes[i] != expected[i]){
+            return false;
+        }
+    }
+    return true;
+}
+
+//the example in the header
+constexpr auto EXAMPLE = i8080::assemble("MVI A,0Ah\nHLT");
+static_assert(EXAMPLE.size == 3 && EXAMPLE.origin == 0, "MVI A,0Ah / HLT is 3 bytes at 0");
+static_assert(EXAMPLE.bytes[0] == 0x3E && EXAMPLE.bytes[1] == 0x0A && EXAMPLE.bytes[2] == 0x76, "MVI A,0Ah / HLT");
+
+//a forward label used by a jump and by DW, a DB list with a string, and an ORG above the code
+constexpr uint8_t FORWARD[] = {0xC3, 0x08, 0x01, 0x01, 0x41, 0x42, 0x08, 0x01, 0x76};
+static_assert(same_bytes(I8080_ASSEMBLE(" ORG 100h\n JMP done\n DB 1,'AB'\n DW done\ndone: HLT\n"), FORWARD),
+              "forward label, DB, DW and ORG");
+static_assert(i8080::assemble(" ORG 100h\n NOP\n").origin == 0x100, "ORG sets the origin");
+
+//EQU constants as byte and word operands, and DS filled with zeros
+constexpr uint8_t CONSTANTS[] = {0x06, 0x02, 0x00, 0x00, 0x21, 0x02, 0x00};
+static_assert(same_bytes(I8080_ASSEMBLE("N EQU 2\n MVI B,N\n DS N\n LXI H,N\n"), CONSTANTS), "EQU and DS");
+
+//register and pair fields, and an immediate after a register operand
+constexpr uint8_t FIELDS[] = {0x78, 0x70, 0xC5, 0xF1, 0x31, 0xFF, 0x00, 0x36, 0x10};
+static_assert(same_bytes(I8080_ASSEMBLE(" MOV A,B\n MOV M,B\n PUSH B\n POP PSW\n LXI SP,0FFh\n MVI M,10h\n"), FIELDS),
+              "register and pair fields");
+
+}
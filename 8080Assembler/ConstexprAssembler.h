@@ -0,0 +1,268 @@
+#ifndef CONSTEXPRASSEMBLER_H_INCLUDED
+#define CONSTEXPRASSEMBLER_H_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "i8080Assembler.h"
+
+/**
+*
+*COMPILE-TIME ASSEMBLY
+*
+**/
+
+//Embeds 8080 code in a host program with no assembler run at startup:
+//    constexpr auto rom = i8080::assemble("MVI A,0Ah\nHLT");      //Rom<16>: rom.size == 3
+//    constexpr auto bytes = I8080_ASSEMBLE("MVI A,0Ah\nHLT");     //std::array<uint8_t, 3>
+//Lines are lexed by the same constexpr functions parse() uses (split_line, split_operands, scan_literal, field_code)
+//and encoded from the same instruction table. Labels (forward ones too), EQU, ORG before the first byte, DB, DW and DS
+//(filled with zeros) are supported; macros, REPT, conditionals and INCLUDE are not. A line the runtime assembler would reject stops the
+//compilation, with the reason in the "in constexpr expansion of require(...)" note.
+
+namespace i8080 {
+
+//Code assembled at compile time
+template<size_t Capacity>
+struct Rom {
+    //the program, from origin on; only the first size bytes are used
+    std::array<uint8_t, Capacity> bytes{};
+    size_t size = 0;
+    //address of bytes[0]: the ORG above the first line of code, 0 without one
+    uint16_t origin = 0;
+};
+
+namespace detail {
+
+//A label or EQU constant of a compile-time program
+struct Symbol {
+    std::string_view name;
+    uint16_t value = 0;
+};
+
+//Symbol table with room for every label a source of Capacity characters can define
+template<size_t Capacity>
+struct Symbols {
+    std::array<Symbol, Capacity / 2 + 1> entries{};
+    size_t count = 0;
+
+    /**
+     * @brief Looks a name up.
+     * @param name Label or constant.
+     * @param value Receives its value.
+     * @return true if name is defined; false otherwise.
+     */
+    constexpr bool find(std::string_view name, uint16_t& value) const{
+        for(size_t i = 0; i < count; i++){
+            if(entries[i].name == name){
+                value = entries[i].value;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+/**
+ * @brief Stops constant evaluation when a check fails, which turns the failure into a compile error.
+ * @param ok Result of the check.
+ * @param message What is wrong, shown in the compiler's note.
+ * @return None.
+ */
+constexpr void require(bool ok, const char* message){
+    if(!ok){
+        throw message;
+    }
+}
+
+/**
+ * @brief Gives the value of an operand: a number, or a label or constant (any label, once pass 1 has run).
+ * @param symbols Symbol table.
+ * @param operand Operand text.
+ * @param value Receives the value.
+ * @return true if the operand has a value yet; false otherwise.
+ */
+template<size_t Capacity>
+constexpr bool operand_value(const Symbols<Capacity>& symbols, std::string_view operand, uint16_t& value){
+    NumericLiteral literal;
+    if(scan_literal(operand, literal)){
+        value = literal.value;
+        return true;
+    }
+    return symbols.find(operand, value);
+}
+
+/**
+ * @brief Places a byte of the program (pass 2 only).
+ * @param rom Program being written, or nullptr in pass 1.
+ * @param at Index of the byte.
+ * @param value Byte.
+ * @return None.
+ */
+template<size_t Capacity>
+constexpr void put_byte(Rom<Capacity>* rom, size_t at, uint8_t value){
+    if(rom != nullptr){
+        require(at < Capacity, "program longer than its source");
+        rom->bytes[at] = value;
+    }
+}
+
+/**
+ * @brief Runs one pass over the source: pass 1 (rom == nullptr) lays out addresses and defines every label, pass 2
+ *        writes the bytes.
+ * @param source Program text.
+ * @param symbols Symbol table, filled in by pass 1.
+ * @param rom Program to write in pass 2; nullptr in pass 1.
+ * @return Bytes the program takes.
+ */
+template<size_t Capacity>
+constexpr size_t assemble_pass(std::string_view source, Symbols<Capacity>& symbols, Rom<Capacity>* rom){
+    uint16_t origin = 0;
+    size_t size = 0;
+    while(!source.empty()){
+        size_t end = source.find('\n');
+        std::string_view line = source.substr(0, end);
+        source.remove_prefix(end == std::string_view::npos ? source.size() : end + 1);
+        LineFields fields = split_line(line);
+        uint16_t pc = static_cast<uint16_t>(origin + size);
+        uint16_t value = 0;
+        if(fields.directive == Directive::Equ){
+            require(!fields.label.empty(), "EQU needs a name");
+            require(operand_value(symbols, trim(fields.rest), value), "EQU needs a number or a label defined above it");
+        }
+        if(!fields.label.empty() && rom == nullptr){
+            uint16_t defined = 0;
+            require(!symbols.find(fields.label, defined), "label defined twice");
+            require(symbols.count < symbols.entries.size(), "too many labels");
+            symbols.entries[symbols.count++] = {fields.label, fields.directive == Directive::Equ ? value : pc};
+        }
+        if(fields.instruction != nullptr){
+            const Instruction& insn = *fields.instruction;
+            std::string_view a1, a2;
+            split_operands(fields.rest, a1, a2);
+            uint8_t opcode = insn.baseOpcode;
+            if(insn.arg1.kind != FieldKind::None){
+                int code = field_code(insn.arg1, a1);
+                require(code >= 0, "operand does not fit the instruction");
+                opcode = static_cast<uint8_t>(opcode | (code & insn.arg1.mask) << insn.arg1.shift);
+                a1 = {};
+            }
+            if(insn.arg2.kind != FieldKind::None){
+                int code = field_code(insn.arg2, a2);
+                require(code >= 0, "operand does not fit the instruction");
+                opcode = static_cast<uint8_t>(opcode | (code & insn.arg2.mask) << insn.arg2.shift);
+                a2 = {};
+            }
+            int operands = !a1.empty() + !a2.empty();
+            require(operands == (insn.size > 1 ? 1 : 0), "wrong number of operands");
+            put_byte(rom, size, opcode);
+            if(insn.size > 1 && rom != nullptr){
+                require(operand_value(symbols, a1.empty() ? a2 : a1, value), "unrecognized symbol");
+                require(insn.size == 3 || value <= 0xFF, "operand does not fit in a byte");
+                put_byte(rom, size + 1, static_cast<uint8_t>(value));
+                if(insn.size == 3){
+                    put_byte(rom, size + 2, static_cast<uint8_t>(value >> 8));
+                }
+            }
+            size += insn.size;
+            continue;
+        }
+        switch(fields.directive){
+            case Directive::None:
+                require(fields.opcode.empty(), "opcode not found (macros are not supported at compile time)");
+                break;
+            case Directive::Equ:
+                break;
+            case Directive::Org:
+                require(size == 0, "ORG is only supported above the first line of code");
+                require(operand_value(symbols, trim(fields.rest), origin), "ORG needs a number or a label defined above it");
+                if(rom != nullptr){
+                    rom->origin = origin;
+                }
+                break;
+            case Directive::Ds:
+                require(operand_value(symbols, trim(fields.rest), value), "DS needs a number or a label defined above it");
+                for(uint16_t i = 0; i < value; i++){
+                    put_byte(rom, size + i, 0);
+                }
+                size += value;
+                break;
+            case Directive::Db:
+            case Directive::Dw:{
+                std::string_view list = trim(fields.rest);
+                require(!list.empty(), "DB and DW expect at least one value");
+                for(size_t start = 0; ; start++){
+                    size_t itemEnd = find_item_end(list, start);
+                    std::string_view item = trim(list.substr(start, itemEnd - start));
+                    require(!item.empty(), "empty item in a DB or DW list");
+                    if(item.front() == '\'' || item.front() == '"'){
+                        require(is_string_item(item), "unterminated string");
+                        require(fields.directive == Directive::Db, "DW takes numbers and labels, not strings");
+                        for(size_t i = 1; i + 1 < item.size(); i++){
+                            put_byte(rom, size++, static_cast<uint8_t>(item[i]));
+                        }
+                    }
+                    else{
+                        if(rom != nullptr){
+                            require(operand_value(symbols, item, value), "unrecognized symbol");
+                            require(fields.directive == Directive::Dw || value <= 0xFF, "DB value does not fit in a byte");
+                        }
+                        put_byte(rom, size++, static_cast<uint8_t>(value));
+                        if(fields.directive == Directive::Dw){
+                            put_byte(rom, size++, static_cast<uint8_t>(value >> 8));
+                        }
+                    }
+                    if(itemEnd == list.size()){
+                        break;
+                    }
+                    start = itemEnd;
+                }
+                break;
+            }
+            default:
+                require(false, "directive not supported at compile time");
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief Copies the used part of a program into an array of exactly its size.
+ * @param rom Program.
+ * @return The bytes.
+ */
+template<size_t Size, size_t Capacity>
+constexpr std::array<uint8_t, Size> trim_rom(const Rom<Capacity>& rom){
+    require(rom.size == Size, "array size differs from the program size");
+    std::array<uint8_t, Size> bytes{};
+    for(size_t i = 0; i < Size; i++){
+        bytes[i] = rom.bytes[i];
+    }
+    return bytes;
+}
+
+}
+
+/**
+ * @brief Assembles a program during compilation. Every line gets the encoding the runtime assembler gives it.
+ * @param source Program text, as a string literal; its length bounds the program's (DS aside, no line encodes to
+ *        more bytes than it has characters).
+ * @return The program.
+ */
+template<size_t Length>
+constexpr Rom<Length> assemble(const char (&source)[Length]){
+    std::string_view text(source, Length - 1);
+    detail::Symbols<Length> symbols;
+    Rom<Length> rom;
+    detail::assemble_pass(text, symbols, static_cast<Rom<Length>*>(nullptr));
+    rom.size = detail::assemble_pass(text, symbols, &rom);
+    return rom;
+}
+
+}
+
+//An exactly sized std::array of the bytes of a program assembled at compile time
+#define I8080_ASSEMBLE(source) (::i8080::detail::trim_rom<::i8080::assemble(source).size>(::i8080::assemble(source)))
+
+#endif // CONSTEXPRASSEMBLER_H_INCLUDED
@@ -0,0 +1,334 @@
+#include "Daemon.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+
+int run_daemon(const std::string& socketPath){
+    std::cout << "--daemon needs Unix domain sockets, which this build does not have (" << socketPath << ")" << std::endl;
+    return 1;
+}
+
+#else
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "i8080Assembler.h"
+#include "MappedFile.h"
+#include "OutputWriters.h"
+
+namespace {
+
+//requests larger than this are refused, so a bad length cannot make the daemon allocate wildly
+const uint32_t MAX_REQUEST = 64u << 20;
+
+//A source file mapped for path requests, shared with requests still using the previous mapping
+struct CachedSource{
+    std::filesystem::file_time_type writeTime;
+    std::shared_ptr<MappedFile> file;
+};
+
+//Sources sent by path, kept mapped between requests
+class SourceCache{
+public:
+    /**
+     * @brief Gives the mapping of a file, mapping it again if it changed since the last request.
+     * @param path Source file path.
+     * @return The mapping, or nullptr if the file cannot be opened.
+     */
+    std::shared_ptr<MappedFile> open(const std::string& path){
+        std::error_code error;
+        auto writeTime = std::filesystem::last_write_time(path,error);
+        if(error){
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        CachedSource& cached = sources[path];
+        if(cached.file == nullptr || cached.writeTime != writeTime){
+            auto file = std::make_shared<MappedFile>();
+            if(!file->open(path)){
+                sources.erase(path);
+                return nullptr;
+            }
+            cached.file = std::move(file);
+            cached.writeTime = writeTime;
+        }
+        return cached.file;
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string,CachedSource> sources;
+};
+
+//Assemblers of finished connections, handed to new ones so their buffers stay warm
+class AssemblerPool{
+public:
+    std::unique_ptr<Assembler> acquire(){
+        std::lock_guard<std::mutex> lock(mutex);
+        if(idle.empty()){
+            return std::make_unique<Assembler>();
+        }
+        std::unique_ptr<Assembler> assembler = std::move(idle.back());
+        idle.pop_back();
+        return assembler;
+    }
+
+    void release(std::unique_ptr<Assembler> assembler){
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(std::move(assembler));
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Assembler>> idle;
+};
+
+bool read_full(int fd,char* data,size_t size){
+    while(size > 0){
+        ssize_t got = ::read(fd,data,size);
+        if(got <= 0){
+            return false;
+        }
+        data += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+bool write_full(int fd,const char* data,size_t size){
+    while(size > 0){
+        ssize_t put = ::write(fd,data,size);
+        if(put <= 0){
+            return false;
+        }
+        data += put;
+        size -= static_cast<size_t>(put);
+    }
+    return true;
+}
+
+uint32_t get_u32(const char* data){
+    return static_cast<uint8_t>(data[0]) | static_cast<uint8_t>(data[1]) << 8 |
+           static_cast<uint8_t>(data[2]) << 16 | static_cast<uint32_t>(static_cast<uint8_t>(data[3])) << 24;
+}
+
+void put_u16(std::string& out,uint16_t value){
+    out.push_back(static_cast<char>(value & 0xFF));
+    out.push_back(static_cast<char>(value >> 8));
+}
+
+void put_u32(std::string& out,uint32_t value){
+    put_u16(out,static_cast<uint16_t>(value & 0xFFFF));
+    put_u16(out,static_cast<uint16_t>(value >> 16));
+}
+
+/**
+ * @brief Reads the define list at the start of a payload: u8 count | count * (u8 n | n bytes of name | u16 value).
+ * @param payload Rest of the request; the list is removed from its front.
+ * @param defines Receives the names, viewing the request, and their values.
+ * @return true if the list is well formed; false otherwise.
+ */
+bool read_defines(std::string_view& payload,std::vector<std::pair<std::string_view,uint16_t>>& defines){
+    if(payload.empty()){
+        return false;
+    }
+    size_t count = static_cast<uint8_t>(payload[0]);
+    payload.remove_prefix(1);
+    for(size_t i = 0; i < count; i++){
+        size_t length = payload.empty() ? 0 : static_cast<uint8_t>(payload[0]);
+        if(length == 0 || payload.size() < 3 + length){
+            return false;
+        }
+        std::string_view name = payload.substr(1,length);
+        uint16_t value = static_cast<uint16_t>(static_cast<uint8_t>(payload[1 + length]) |
+                                               static_cast<uint8_t>(payload[2 + length]) << 8);
+        defines.emplace_back(name,value);
+        payload.remove_prefix(3 + length);
+    }
+    return true;
+}
+
+/**
+ * @brief Fills in a response: status, output, symbols and diagnostics, with its length in front.
+ * @param response Receives the response (cleared first; its capacity is reused).
+ * @param ok Whether the request assembled without errors.
+ * @param output Rendered output.
+ * @param symbols Symbol table (nullptr for none).
+ * @param diagnostics Diagnostics, one per line.
+ * @return None.
+ */
+void build_response(std::string& response,bool ok,std::string_view output,const std::vector<Symbol>* symbols,std::string_view diagnostics){
+    response.assign(4,'\0');
+    response.push_back(ok ? 0 : 1);
+    put_u32(response,static_cast<uint32_t>(output.size()));
+    response.append(output);
+    put_u32(response,symbols != nullptr ? static_cast<uint32_t>(symbols->size()) : 0);
+    if(symbols != nullptr){
+        for(const Symbol& symbol : *symbols){
+            put_u16(response,symbol.address);
+            put_u16(response,static_cast<uint16_t>(symbol.name.size()));
+            response.append(symbol.name);
+        }
+    }
+    response.append(diagnostics);
+    uint32_t length = static_cast<uint32_t>(response.size() - 4);
+    for(int i = 0; i < 4; i++){
+        response[i] = static_cast<char>(length >> (8 * i));
+    }
+}
+
+/**
+ * @brief Answers one request with the connection's assembler.
+ * @param request Request without its length.
+ * @param assembler Assembler of the connection's thread.
+ * @param sources Shared source cache.
+ * @param response Receives the response.
+ * @return None.
+ */
+void handle_request(std::string_view request,Assembler& assembler,SourceCache& sources,std::string& response){
+    if(request.size() < 2 || request.size() - 2 < static_cast<uint8_t>(request[1])){
+        build_response(response,false,{},nullptr,"malformed request\n");
+        return;
+    }
+    bool byPath = (request[0] & 1) != 0;
+    bool optimize = (request[0] & 2) != 0;
+    std::string_view formatName = request.substr(2,static_cast<uint8_t>(request[1]));
+    std::string_view payload = request.substr(2 + formatName.size());
+    //the names view the request, which outlives the assembly
+    std::vector<std::pair<std::string_view,uint16_t>> defines;
+    if((request[0] & 4) != 0 && !read_defines(payload,defines)){
+        build_response(response,false,{},nullptr,"malformed define list\n");
+        return;
+    }
+    OutputFormat format;
+    if(!parse_output_format(formatName,format) || format == OutputFormat::Listing || format == OutputFormat::Object){
+        build_response(response,false,{},nullptr,"unknown output format " + std::string(formatName) + ", expected bits, bin or hex\n");
+        return;
+    }
+    std::shared_ptr<MappedFile> file;
+    std::string_view source = payload;
+    //INCLUDE and INCBIN names in a file are relative to it; in a sent source, to the daemon's working directory
+    std::string directory;
+    if(byPath){
+        file = sources.open(std::string(payload));
+        if(file == nullptr){
+            build_response(response,false,{},nullptr,std::string(payload) + " could not be opened.\n");
+            return;
+        }
+        source = file->view();
+        directory = std::filesystem::path(payload).parent_path().string();
+    }
+    const AssemblyResult& result = assembler.assemble(source,directory,defines,optimize);
+    std::vector<ImageSegment> segments;
+    segments.reserve(result.segments.size());
+    for(const Segment& segment : result.segments){
+        segments.push_back({segment.origin,result.bytes.data() + segment.offset,segment.size});
+    }
+    std::string output;
+    switch(format){
+        case OutputFormat::Binary:
+            output = render_image(segments);
+            break;
+        case OutputFormat::IntelHex:
+            output = render_intel_hex(segments);
+            break;
+        default:
+            output = render_bits(segments);
+            break;
+    }
+    std::string diagnostics;
+    for(const Diagnostic& diagnostic : result.diagnostics){
+        diagnostics += format_diagnostic(diagnostic);
+        diagnostics += '\n';
+    }
+    build_response(response,result.ok(),output,&result.symbols,diagnostics);
+}
+
+/**
+ * @brief Serves the requests of one connection until the client closes it.
+ * @param fd Connected socket; closed on return.
+ * @param sources Shared source cache.
+ * @param assemblers Idle assemblers; the connection borrows one.
+ * @return None.
+ */
+void serve_connection(int fd,SourceCache& sources,AssemblerPool& assemblers){
+    std::unique_ptr<Assembler> assembler = assemblers.acquire();
+    std::string request;
+    std::string response;
+    char header[4];
+    while(read_full(fd,header,sizeof(header))){
+        uint32_t length = get_u32(header);
+        if(length > MAX_REQUEST){
+            break;
+        }
+        request.resize(length);
+        if(!read_full(fd,request.data(),length)){
+            break;
+        }
+        handle_request(request,*assembler,sources,response);
+        if(!write_full(fd,response.data(),response.size())){
+            break;
+        }
+    }
+    ::close(fd);
+    assemblers.release(std::move(assembler));
+}
+
+}
+
+int run_daemon(const std::string& socketPath){
+    sockaddr_un address{};
+    if(socketPath.size() >= sizeof(address.sun_path)){
+        std::cout << socketPath << " is too long for a socket path." << std::endl;
+        return 1;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path,socketPath.c_str(),socketPath.size() + 1);
+    int listener = ::socket(AF_UNIX,SOCK_STREAM,0);
+    if(listener < 0){
+        std::cout << "socket could not be created." << std::endl;
+        return 1;
+    }
+    //only a stale socket is replaced; anything else at the path is left alone
+    struct stat existing;
+    if(::lstat(socketPath.c_str(),&existing) == 0){
+        if(!S_ISSOCK(existing.st_mode)){
+            std::cout << socketPath << " is in use by something that is not a socket." << std::endl;
+            ::close(listener);
+            return 1;
+        }
+        ::unlink(socketPath.c_str());
+    }
+    if(::bind(listener,reinterpret_cast<sockaddr*>(&address),sizeof(address)) != 0 || ::listen(listener,64) != 0){
+        std::cout << socketPath << " could not be bound." << std::endl;
+        ::close(listener);
+        return 1;
+    }
+    //a client that hangs up before reading its response must not kill the daemon
+    std::signal(SIGPIPE,SIG_IGN);
+    std::cout << "listening on " << socketPath << std::endl;
+    SourceCache sources;
+    AssemblerPool assemblers;
+    while(true){
+        int client = ::accept(listener,nullptr,nullptr);
+        if(client < 0){
+            continue;
+        }
+        std::thread(serve_connection,client,std::ref(sources),std::ref(assemblers)).detach();
+    }
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef DAEMON_H_INCLUDED
+#define DAEMON_H_INCLUDED
+
+#include <string>
+
+/**
+ * @brief Serves assembly requests on a Unix domain socket until the process is killed, so editors and test harnesses
+ *        pay for a socket round trip instead of a process start. Each connection is served on its own thread with an
+ *        Assembler borrowed from a pool, so its buffers stay warm from one request and one connection to the next;
+ *        sources sent by path are mapped once and remapped only when the file's modification time changes.
+ *        All integers are little-endian. A connection carries any number of requests, each answered in turn:
+ *          request:  u32 length of the rest | u8 flags (1: payload is a path, 2: -O, 4: defines follow)
+ *                    | u8 n | n bytes of format (bits, bin, hex)
+ *                    | [defines: u8 count | count * (u8 n | n bytes of name | u16 value)] | payload (source text or path)
+ *          response: u32 length of the rest | u8 status (0 ok, 1 errors or bad request) | u32 n | n output bytes
+ *                    | u32 count | count * (u16 address | u16 n | n bytes of name) | diagnostics, one per line
+ *        Not available on Windows.
+ * @param socketPath Path to bind the socket at; a stale socket file there is replaced, any other file is left alone.
+ * @return Exit code (only returns if the socket cannot be set up or the path holds something else).
+ */
+int run_daemon(const std::string& socketPath);
+
+#endif // DAEMON_H_INCLUDED
@@ -0,0 +1,42 @@
+#include "HeapCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<bool> counting{false};
+std::atomic<uint64_t> allocationCount{0};
+std::atomic<uint64_t> allocatedBytes{0};
+
+}
+
+void count_allocations(bool on){
+    counting.store(on,std::memory_order_relaxed);
+}
+
+void allocations_counted(uint64_t& allocations, uint64_t& bytes){
+    allocations = allocationCount.load(std::memory_order_relaxed);
+    bytes = allocatedBytes.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size){
+    if(counting.load(std::memory_order_relaxed)){
+        allocationCount.fetch_add(1,std::memory_order_relaxed);
+        allocatedBytes.fetch_add(size,std::memory_order_relaxed);
+    }
+    void* memory = std::malloc(size == 0 ? 1 : size);
+    if(memory == nullptr){
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept{
+    std::free(memory);
+}
+
+void operator delete(void* memory,size_t) noexcept{
+    std::free(memory);
+}
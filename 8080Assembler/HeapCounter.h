@@ -0,0 +1,24 @@
+#ifndef HEAPCOUNTER_H_INCLUDED
+#define HEAPCOUNTER_H_INCLUDED
+
+#include <cstdint>
+
+//HeapCounter.cpp replaces the global operator new, so it is built into the programs only: code that links the
+//Library target keeps its own allocator.
+
+/**
+ * @brief Starts or stops counting operator new calls (off by default).
+ * @param on true to count.
+ * @return None.
+ */
+void count_allocations(bool on);
+
+/**
+ * @brief Reads what has been counted so far.
+ * @param allocations Receives the number of operator new calls.
+ * @param bytes Receives the bytes they asked for.
+ * @return None.
+ */
+void allocations_counted(uint64_t& allocations, uint64_t& bytes);
+
+#endif // HEAPCOUNTER_H_INCLUDED
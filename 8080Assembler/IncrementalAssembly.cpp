@@ -0,0 +1,385 @@
+#include "IncrementalAssembly.h"
+
+#include <algorithm>
+#include "MappedFile.h"
+
+namespace {
+
+/**
+ * @brief Finds the operand of a line that becomes its immediate/address bytes (the one build_operand sees).
+ * @param currentLine Lexed line.
+ * @return The operand text; empty if the instruction takes no immediate.
+ */
+std::string_view value_operand(const ParsedLine& currentLine){
+    if(currentLine.instruction == nullptr || currentLine.instruction->immediate == ImmediateKind::None){
+        return {};
+    }
+    //the first operand is consumed by an opcode field if the instruction has one, then the value is the second
+    return currentLine.instruction->arg1.kind == FieldKind::None ? currentLine.argument1 : currentLine.argument2;
+}
+
+/**
+ * @brief Adds up the length of a set of lines.
+ * @param lines Lines to measure.
+ * @return Total bytes of text.
+ */
+size_t bytes_of(const std::vector<std::string_view>& lines){
+    size_t total = 0;
+    for(std::string_view line : lines){
+        total += line.size();
+    }
+    return total;
+}
+
+/**
+ * @brief Replaces count elements of a vector starting at first with the replacement, moving the tail only once.
+ * @param target Vector to edit.
+ * @param first Index of the first replaced element.
+ * @param count Number of elements replaced.
+ * @param replacement New elements.
+ * @return None.
+ */
+template <typename T>
+void splice(std::vector<T>& target,size_t first,size_t count,const std::vector<T>& replacement){
+    size_t common = std::min(count,replacement.size());
+    std::copy(replacement.begin(),replacement.begin() + common,target.begin() + first);
+    if(count > common){
+        target.erase(target.begin() + first + common,target.begin() + first + count);
+    }
+    else{
+        target.insert(target.begin() + first + common,replacement.begin() + common,replacement.end());
+    }
+}
+
+}
+
+void IncrementalAssembly::load(std::string_view source,std::string sourceDirectory){
+    directory = std::move(sourceDirectory);
+    text.clear();
+    textBytes = 0;
+    rebuild(split_lines(store(source)),false);
+}
+
+size_t IncrementalAssembly::update(std::string_view source){
+    std::vector<std::string_view> newLines = split_lines(source);
+    const std::vector<std::string_view>& oldLines = workingFile.lines;
+    size_t prefix = 0;
+    while(prefix < oldLines.size() && prefix < newLines.size() && oldLines[prefix] == newLines[prefix]){
+        prefix++;
+    }
+    size_t suffix = 0;
+    while(suffix < oldLines.size() - prefix && suffix < newLines.size() - prefix &&
+          oldLines[oldLines.size() - 1 - suffix] == newLines[newLines.size() - 1 - suffix]){
+        suffix++;
+    }
+    if(prefix + suffix == oldLines.size() && prefix + suffix == newLines.size() && !needsFullRebuild){
+        return 0;
+    }
+    std::vector<std::string_view> changed(newLines.begin() + prefix, newLines.end() - suffix);
+    return apply_edit(prefix, oldLines.size() - prefix - suffix, changed);
+}
+
+size_t IncrementalAssembly::apply_edit(size_t firstLine,size_t removedCount,const std::vector<std::string_view>& newLines){
+    std::vector<std::string_view> stored = store_lines(newLines);
+    if(needsFullRebuild || directiveLines != 0){
+        return rebuild_with_edit(firstLine,removedCount,stored);
+    }
+    std::vector<ParsedLine>& parsedLines = workingFile.parsedLines;
+    size_t removedEnd = firstLine + removedCount;
+    size_t addedEnd = firstLine + stored.size();
+
+    //lex the new lines and check their labels before touching any state
+    std::vector<ParsedLine> added;
+    added.reserve(stored.size());
+    for(size_t i = 0; i < stored.size(); i++){
+        added.push_back(parse(stored[i],static_cast<uint32_t>(firstLine + i)));
+        if(added.back().directive != Directive::None){
+            return rebuild_with_edit(firstLine,removedCount,stored);
+        }
+    }
+    std::vector<std::pair<std::string_view,uint16_t>> removedLabels;
+    for(size_t i = firstLine; i < removedEnd; i++){
+        if(!parsedLines[i].label.empty()){
+            removedLabels.push_back({parsedLines[i].label,parsedLines[i].pc});
+        }
+    }
+    for(size_t i = 0; i < added.size(); i++){
+        std::string_view label = added[i].label;
+        if(label.empty()){
+            continue;
+        }
+        bool freed = false;
+        for(const auto& removed : removedLabels){
+            freed = freed || removed.first == label;
+        }
+        bool clash = !freed && workingFile.symbolTable.count(label) != 0;
+        for(size_t j = 0; j < i && !clash; j++){
+            clash = added[j].label == label;
+        }
+        if(clash){
+            err("Error, label "+std::string(label)+" is already present in symbol table.",added[i].lineNumber);
+        }
+    }
+    //an edit that pushes the image past FFFFh is reported by the full assembly
+    uint64_t editedSize = workingFile.output.size();
+    for(size_t i = firstLine; i < removedEnd; i++){
+        editedSize -= parsedLines[i].instructionSize;
+    }
+    for(const ParsedLine& line : added){
+        editedSize += line.instructionSize;
+    }
+    if(editedSize > 0x10000){
+        return rebuild_with_edit(firstLine,removedCount,stored);
+    }
+
+    //from here on the state changes
+    uint32_t spanStart = firstLine < parsedLines.size() ? parsedLines[firstLine].offset : static_cast<uint32_t>(workingFile.output.size());
+    uint32_t oldSize = 0;
+    size_t removedText = 0;
+    for(size_t i = firstLine; i < removedEnd; i++){
+        oldSize += parsedLines[i].instructionSize;
+        removedText += workingFile.lines[i].size();
+        remove_reference(parsedLines[i],static_cast<uint32_t>(i));
+    }
+    for(const auto& removed : removedLabels){
+        workingFile.symbolTable.erase(removed.first);
+    }
+    uint32_t newSize = 0;
+    for(ParsedLine& line : added){
+        line.offset = spanStart + newSize;
+        line.pc = static_cast<uint16_t>(line.offset);
+        newSize += line.instructionSize;
+    }
+    int64_t byteShift = static_cast<int64_t>(newSize) - oldSize;
+    int64_t lineShift = static_cast<int64_t>(stored.size()) - static_cast<int64_t>(removedCount);
+
+    //splice the line caches, moving each tail once; the reference lists catch up when they are next used
+    splice(parsedLines,firstLine,removedCount,added);
+    splice(workingFile.lines,firstLine,removedCount,stored);
+    if(lineShift != 0){
+        lineShifts.push_back({static_cast<uint32_t>(removedEnd),static_cast<int32_t>(lineShift)});
+    }
+    if(lineShift != 0 || byteShift != 0){
+        for(size_t i = addedEnd; i < parsedLines.size(); i++){
+            parsedLines[i].lineNumber = static_cast<uint32_t>(i);
+            parsedLines[i].offset = static_cast<uint32_t>(parsedLines[i].offset + byteShift);
+            parsedLines[i].pc = static_cast<uint16_t>(parsedLines[i].offset);
+        }
+    }
+
+    //labels: drop the removed lines, renumber and re-address the tail, add the new ones
+    auto removedFrom = std::lower_bound(labelLines.begin(),labelLines.end(),static_cast<uint32_t>(firstLine));
+    auto removedTo = std::lower_bound(removedFrom,labelLines.end(),static_cast<uint32_t>(removedEnd));
+    size_t tailStart = static_cast<size_t>(removedFrom - labelLines.begin());
+    labelLines.erase(removedFrom,removedTo);
+    //symbols that appeared, disappeared or were redefined, and symbols that only moved with the tail
+    std::vector<std::string_view> changedSymbols;
+    std::vector<std::string_view> movedSymbols;
+    for(size_t i = tailStart; i < labelLines.size(); i++){
+        labelLines[i] = static_cast<uint32_t>(labelLines[i] + lineShift);
+        if(byteShift != 0){
+            const ParsedLine& line = parsedLines[labelLines[i]];
+            workingFile.symbolTable.find(line.label)->second = line.pc;
+            movedSymbols.push_back(line.label);
+        }
+    }
+    std::vector<uint32_t> addedLabelLines;
+    for(size_t i = firstLine; i < addedEnd; i++){
+        const ParsedLine& line = parsedLines[i];
+        add_reference(line,static_cast<uint32_t>(i));
+        if(line.label.empty()){
+            continue;
+        }
+        addedLabelLines.push_back(static_cast<uint32_t>(i));
+        workingFile.symbolTable.insert({line.label,line.pc});
+        bool unchanged = false;
+        for(const auto& removed : removedLabels){
+            unchanged = unchanged || (removed.first == line.label && removed.second == line.pc);
+        }
+        if(!unchanged){
+            changedSymbols.push_back(line.label);
+        }
+    }
+    labelLines.insert(labelLines.begin() + tailStart,addedLabelLines.begin(),addedLabelLines.end());
+    for(const auto& removed : removedLabels){
+        if(workingFile.symbolTable.count(removed.first) == 0){
+            changedSymbols.push_back(removed.first);
+        }
+    }
+
+    //patch the output: open or close the gap, then encode the new lines and every line using a changed symbol
+    std::vector<uint8_t>& output = workingFile.output;
+    if(byteShift > 0){
+        output.insert(output.begin() + spanStart + oldSize,static_cast<size_t>(byteShift),0);
+    }
+    else if(byteShift < 0){
+        output.erase(output.begin() + spanStart + newSize,output.begin() + spanStart + oldSize);
+    }
+    //without directives the image is one run from address 0
+    workingFile.segments.clear();
+    if(!output.empty()){
+        workingFile.segments.push_back({0,0,static_cast<uint32_t>(output.size()),0});
+    }
+    std::vector<uint32_t> dirty;
+    for(size_t i = firstLine; i < addedEnd; i++){
+        dirty.push_back(static_cast<uint32_t>(i));
+    }
+    for(std::string_view symbol : changedSymbols){
+        auto users = references.find(symbol);
+        if(users != references.end()){
+            const std::vector<uint32_t>& lines = current(users->second);
+            dirty.insert(dirty.end(),lines.begin(),lines.end());
+        }
+    }
+    std::sort(dirty.begin(),dirty.end());
+    dirty.erase(std::unique(dirty.begin(),dirty.end()),dirty.end());
+    size_t encoded = dirty.size();
+    try{
+        for(uint32_t line : dirty){
+            const ParsedLine& currentLineInfo = parsedLines[line];
+            if(currentLineInfo.instruction != nullptr){
+                encode_line(currentLineInfo,output.data() + currentLineInfo.offset,workingFile);
+            }
+        }
+        //a word operand naming a label that only moved already encodes fine except for the address itself
+        for(std::string_view symbol : movedSymbols){
+            auto users = references.find(symbol);
+            if(users == references.end()){
+                continue;
+            }
+            uint16_t address = workingFile.symbolTable.find(symbol)->second;
+            for(uint32_t line : current(users->second)){
+                const ParsedLine& currentLineInfo = parsedLines[line];
+                if(line >= firstLine && line < addedEnd){
+                    continue;
+                }
+                if(currentLineInfo.instruction->immediate == ImmediateKind::Word){
+                    to_little_endian(address,output.data() + currentLineInfo.offset + 1);
+                }
+                else{
+                    encode_line(currentLineInfo,output.data() + currentLineInfo.offset,workingFile);
+                }
+                encoded++;
+            }
+        }
+    }
+    catch(const AssemblyError&){
+        needsFullRebuild = true;
+        throw;
+    }
+
+    //once most of the arena is text that no line points at any more, start over from the live lines
+    if(lineShifts.size() >= MAX_LINE_SHIFTS){
+        for(auto& entry : references){
+            current(entry.second);
+        }
+        lineShifts.clear();
+        for(auto& entry : references){
+            entry.second.shiftsApplied = 0;
+        }
+    }
+    liveBytes = liveBytes + bytes_of(stored) - removedText;
+    if(textBytes > 2 * liveBytes + (1 << 20)){
+        rebuild(workingFile.lines,true);
+    }
+    return encoded;
+}
+
+size_t IncrementalAssembly::rebuild_with_edit(size_t firstLine,size_t removedCount,const std::vector<std::string_view>& stored){
+    std::vector<std::string_view> lines = workingFile.lines;
+    lines.erase(lines.begin() + firstLine, lines.begin() + firstLine + removedCount);
+    lines.insert(lines.begin() + firstLine, stored.begin(), stored.end());
+    rebuild(std::move(lines),false);
+    return workingFile.parsedLines.size();
+}
+
+std::string_view IncrementalAssembly::store(std::string_view source){
+    textBytes += source.size();
+    return text.emplace_back(source);
+}
+
+std::vector<std::string_view> IncrementalAssembly::store_lines(const std::vector<std::string_view>& lines){
+    std::string block;
+    block.reserve(bytes_of(lines));
+    for(std::string_view line : lines){
+        block += line;
+    }
+    std::string_view stored = store(block);
+    std::vector<std::string_view> views;
+    views.reserve(lines.size());
+    size_t position = 0;
+    for(std::string_view line : lines){
+        views.push_back(stored.substr(position,line.size()));
+        position += line.size();
+    }
+    return views;
+}
+
+std::vector<uint32_t>& IncrementalAssembly::current(ReferenceList& list){
+    for(; list.shiftsApplied < lineShifts.size(); list.shiftsApplied++){
+        const auto& shift = lineShifts[list.shiftsApplied];
+        for(uint32_t& line : list.lines){
+            if(line >= shift.first){
+                line = static_cast<uint32_t>(static_cast<int64_t>(line) + shift.second);
+            }
+        }
+    }
+    return list.lines;
+}
+
+void IncrementalAssembly::add_reference(const ParsedLine& line,uint32_t index){
+    std::string_view operand = value_operand(line);
+    if(!operand.empty()){
+        auto inserted = references.try_emplace(operand);
+        if(inserted.second){
+            inserted.first->second.shiftsApplied = lineShifts.size();
+        }
+        current(inserted.first->second).push_back(index);
+    }
+}
+
+void IncrementalAssembly::remove_reference(const ParsedLine& line,uint32_t index){
+    std::string_view operand = value_operand(line);
+    if(operand.empty()){
+        return;
+    }
+    auto users = references.find(operand);
+    if(users == references.end()){
+        return;
+    }
+    std::vector<uint32_t>& lines = current(users->second);
+    lines.erase(std::remove(lines.begin(),lines.end(),index),lines.end());
+    if(lines.empty()){
+        references.erase(users);
+    }
+}
+
+void IncrementalAssembly::rebuild(std::vector<std::string_view> lines,bool compact){
+    if(compact){
+        //the old arena stays alive until the lines are copied out of it
+        std::deque<std::string> old;
+        old.swap(text);
+        textBytes = 0;
+        lines = store_lines(lines);
+    }
+    liveBytes = bytes_of(lines);
+    workingFile = AssembledFile(std::move(lines));
+    workingFile.directory = directory;
+    labelLines.clear();
+    references.clear();
+    lineShifts.clear();
+    directiveLines = 0;
+    needsFullRebuild = true;
+    assemble(workingFile);
+    for(size_t i = 0; i < workingFile.parsedLines.size(); i++){
+        const ParsedLine& line = workingFile.parsedLines[i];
+        if(line.directive != Directive::None){
+            directiveLines++;
+        }
+        if(!line.label.empty()){
+            labelLines.push_back(static_cast<uint32_t>(i));
+        }
+        add_reference(line,static_cast<uint32_t>(i));
+    }
+    needsFullRebuild = false;
+}
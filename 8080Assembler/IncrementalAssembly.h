@@ -0,0 +1,127 @@
+#ifndef INCREMENTALASSEMBLY_H_INCLUDED
+#define INCREMENTALASSEMBLY_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "i8080Assembler.h"
+
+/**
+ * @brief Keeps the results of the last assembly so an edit only redoes the lines it affects.
+ *        Besides the cached lines, their offsets and the symbol table, it keeps the lines that define labels and a
+ *        reverse index from operand text to the lines using it. An edit re-lexes the changed lines, shifts offsets,
+ *        PCs and label addresses downstream of a size change, patches output in place and re-encodes only the new
+ *        lines plus the lines referring to a symbol that was added, removed or moved.
+ *        Line text is copied into an append-only arena so the views in the caches stay valid across edits; the
+ *        arena is compacted by a full rebuild once it is mostly dead text.
+ *        A source using directives (ORG, DB, DW, DS, EQU) is rebuilt in full on every edit, since one changed value can
+ *        move every address after it.
+ */
+class IncrementalAssembly{
+public:
+    /**
+     * @brief Assembles a whole source from scratch and builds the indexes.
+     * @param source Whole source text (copied).
+     * @param sourceDirectory Directory INCLUDE and INCBIN names are relative to (the source's); empty for the working
+     *        directory. Kept for every later rebuild.
+     * @return None (throws AssemblyError on failure).
+     */
+    void load(std::string_view source,std::string sourceDirectory = {});
+
+    /**
+     * @brief Brings the assembly up to date with a new version of the source by diffing it against the current
+     *        lines (common prefix and suffix) and applying the difference as one edit.
+     * @param source Whole new source text.
+     * @return Number of lines that were re-encoded.
+     */
+    size_t update(std::string_view source);
+
+    /**
+     * @brief Replaces removedCount lines starting at firstLine with newLines.
+     *        Lexing errors and duplicate labels are reported before anything changes. An encoding error leaves the
+     *        new text in place and the next edit falls back to a full rebuild.
+     * @param firstLine Index of the first replaced line.
+     * @param removedCount Number of lines removed.
+     * @param newLines Replacement lines (copied).
+     * @return Number of lines that were re-encoded.
+     */
+    size_t apply_edit(size_t firstLine,size_t removedCount,const std::vector<std::string_view>& newLines);
+
+    const AssembledFile& file() const { return workingFile; }
+
+private:
+    //lines using one operand, as of lineShifts[shiftsApplied]
+    struct ReferenceList{
+        std::vector<uint32_t> lines;
+        size_t shiftsApplied = 0;
+    };
+
+    /**
+     * @brief Copies text into the arena.
+     * @param source Text to keep.
+     * @return View of the stored copy, valid for the life of the arena.
+     */
+    std::string_view store(std::string_view source);
+
+    /**
+     * @brief Copies lines into one arena block.
+     * @param lines Lines to keep.
+     * @return Views of the stored copies, in order.
+     */
+    std::vector<std::string_view> store_lines(const std::vector<std::string_view>& lines);
+
+    /**
+     * @brief Applies the line shifts a reference list has not seen yet.
+     * @param list Reference list.
+     * @return The list's lines, now numbered as in the current source.
+     */
+    std::vector<uint32_t>& current(ReferenceList& list);
+
+    void add_reference(const ParsedLine& line,uint32_t index);
+
+    void remove_reference(const ParsedLine& line,uint32_t index);
+
+    /**
+     * @brief Assembles lines from scratch and rebuilds the label and reference indexes.
+     * @param lines Current source lines.
+     * @param compact Copy the lines into a fresh arena and free the old one first.
+     * @return None (throws AssemblyError on failure, leaving a full rebuild pending).
+     */
+    void rebuild(std::vector<std::string_view> lines,bool compact);
+
+    /**
+     * @brief Applies an edit by assembling the edited source from scratch.
+     * @param firstLine Index of the first replaced line.
+     * @param removedCount Number of lines removed.
+     * @param stored Replacement lines, already in the arena.
+     * @return Number of lines that were encoded (all of them).
+     */
+    size_t rebuild_with_edit(size_t firstLine,size_t removedCount,const std::vector<std::string_view>& stored);
+
+    //every line text the caches point into
+    std::deque<std::string> text;
+    size_t textBytes = 0;
+    //bytes of line text still in use
+    size_t liveBytes = 0;
+    AssembledFile workingFile;
+    //directory of the source, set on every rebuilt file
+    std::string directory;
+    //lines that define a label, ascending
+    std::vector<uint32_t> labelLines;
+    //operand text -> lines whose value operand is that text
+    std::unordered_map<std::string_view,ReferenceList> references;
+    //(first line moved, lines it moved by) for every edit that changed the line count, oldest first
+    std::vector<std::pair<uint32_t,int32_t>> lineShifts;
+    //edits the shift log holds before every reference list is brought up to date and the log is cleared
+    static const size_t MAX_LINE_SHIFTS = 64;
+    bool needsFullRebuild = false;
+    //lines holding a directive; while there are any, every edit is a full rebuild
+    size_t directiveLines = 0;
+};
+
+#endif // INCREMENTALASSEMBLY_H_INCLUDED
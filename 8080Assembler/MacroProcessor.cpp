@@ -0,0 +1,381 @@
+#include "MacroProcessor.h"
+
+#include <cctype>
+#include "MappedFile.h"
+
+namespace {
+
+/**
+ * @brief Checks whether a character can be part of a name (label, parameter or number).
+ * @param c Character to check.
+ * @return true for letters, digits and _ ? @ $ .; false otherwise.
+ */
+bool is_name_char(char c){
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '?' || c == '@' || c == '$' || c == '.';
+}
+
+/**
+ * @brief Splits a comma separated list into trimmed items.
+ * @param list List text (may be empty).
+ * @param items Receives the items.
+ * @return None.
+ */
+void split_list(std::string_view list,std::vector<std::string_view>& items){
+    items.clear();
+    if(list.empty()){
+        return;
+    }
+    for(size_t start = 0; ; start++){
+        size_t end = find_item_end(list,start);
+        items.push_back(trim(list.substr(start,end - start)));
+        if(end == list.size()){
+            break;
+        }
+        start = end;
+    }
+}
+
+/**
+ * @brief Appends a body line to text with every parameter replaced by its argument and every local label by the
+ *        name it has in this expansion. Quoted strings and the comment are copied as they are.
+ * @param line Body line.
+ * @param names Parameters, then locals.
+ * @param values Arguments (missing ones are empty), then the locals' names.
+ * @param localStart Index in names of the first local.
+ * @param text Receives the line.
+ * @param localUses Counts the local labels substituted.
+ * @return None.
+ */
+void substitute(std::string_view line,const std::vector<std::string_view>& names,const std::vector<std::string_view>& values,
+                size_t localStart,std::string& text,uint32_t& localUses){
+    size_t i = 0;
+    while(i < line.size()){
+        char c = line[i];
+        if(c == ';'){
+            text.append(line.substr(i));
+            return;
+        }
+        if(c == '\'' || c == '"'){
+            size_t close = line.find(c,i + 1);
+            size_t end = close == std::string_view::npos ? line.size() : close + 1;
+            text.append(line.substr(i,end - i));
+            i = end;
+            continue;
+        }
+        if(!is_name_char(c)){
+            text.push_back(c);
+            i++;
+            continue;
+        }
+        size_t end = i;
+        while(end < line.size() && is_name_char(line[end])){
+            end++;
+        }
+        std::string_view word = line.substr(i,end - i);
+        size_t k = 0;
+        while(k < names.size() && names[k] != word){
+            k++;
+        }
+        if(k < names.size()){
+            text.append(values[k]);
+            localUses += k >= localStart ? 1 : 0;
+        }
+        else{
+            text.append(word);
+        }
+        i = end;
+    }
+}
+
+/**
+ * @brief Gives the field of a line a patch refers to.
+ * @param line Line.
+ * @param field 0 label, 1 argument1, 2 argument2.
+ * @return The field.
+ */
+std::string_view& line_field(ParsedLine& line,uint8_t field){
+    return field == 0 ? line.label : field == 1 ? line.argument1 : line.argument2;
+}
+
+}
+
+MacroProcessor::MacroProcessor(AssembledFile& workingFile) : workingFile(workingFile){
+}
+
+void MacroProcessor::begin(const ParsedLine& line,bool copyText){
+    open = Block();
+    open.lineNumber = line.lineNumber;
+    if(line.directive == Directive::Rept){
+        open.count = resolve_value(workingFile,line);
+        open.kind = Directive::Rept;
+        return;
+    }
+    if(line.label.empty()){
+        err("Error, MACRO needs a name.",line.lineNumber);
+    }
+    if(lookup_instruction(line.label) != nullptr || lookup_directive(line.label) != Directive::None){
+        err("Error, ["+std::string(line.label)+"] is an instruction or directive and cannot name a macro.",line.lineNumber);
+    }
+    if(defines(line.label)){
+        err("Error, macro ["+std::string(line.label)+"] is already defined.",line.lineNumber);
+    }
+    split_list(line.argument1,open.params);
+    for(std::string_view& param : open.params){
+        if(param.empty()){
+            err("Error, empty parameter in the list of macro ["+std::string(line.label)+"].",line.lineNumber);
+        }
+        param = keep(param,copyText);
+    }
+    open.name = keep(line.label,copyText);
+    open.kind = Directive::Macro;
+}
+
+bool MacroProcessor::record(std::string_view text,uint32_t lineNumber,bool copyText){
+    Directive directive = block_directive(text);
+    if(directive == Directive::Macro || directive == Directive::Rept){
+        open.depth++;
+    }
+    else if(directive == Directive::Endm){
+        if(open.depth == 0){
+            return true;
+        }
+        open.depth--;
+    }
+    open.body.push_back(keep(text,copyText));
+    open.bodyLines.push_back(lineNumber);
+    return false;
+}
+
+const std::vector<ParsedLine>& MacroProcessor::close(){
+    result.clear();
+    Block block = std::move(open);
+    open = Block();
+    if(block.kind == Directive::Macro){
+        Definition definition;
+        definition.params = std::move(block.params);
+        for(size_t i = 0; i < block.body.size(); i++){
+            if(block_directive(block.body[i]) != Directive::Local){
+                definition.body.push_back(block.body[i]);
+                continue;
+            }
+            std::vector<std::string_view> locals;
+            split_list(parse(block.body[i],block.bodyLines[i]).argument1,locals);
+            for(std::string_view local : locals){
+                if(local.empty()){
+                    err("Error, empty name in LOCAL list.",block.bodyLines[i]);
+                }
+                definition.locals.push_back(local);
+            }
+        }
+        macros.emplace(block.name,std::move(definition));
+        return result;
+    }
+    //REPT: the body is lexed once and unrolled from the lexed lines
+    std::vector<ParsedLine> lexed;
+    lexed.reserve(block.body.size());
+    for(size_t i = 0; i < block.body.size(); i++){
+        lexed.push_back(parse(block.body[i],block.bodyLines[i],this));
+    }
+    Expansion expansion;
+    std::vector<LocalPatch> ownPatches;
+    for(uint16_t i = 0; i < block.count; i++){
+        flatten(lexed,0,lexed.size(),expansion,{},ownPatches,0);
+    }
+    instantiate(expansion,result);
+    return result;
+}
+
+const std::vector<ParsedLine>& MacroProcessor::expand(const ParsedLine& call){
+    Expansion scratch;
+    instantiate(find_or_build(call,0,scratch),result);
+    for(ParsedLine& line : result){
+        line.lineNumber = call.lineNumber;
+    }
+    return result;
+}
+
+void MacroProcessor::finish() const{
+    if(recording()){
+        err(std::string("Error, ")+(open.kind == Directive::Macro ? "MACRO" : "REPT")+" without ENDM.",open.lineNumber);
+    }
+}
+
+std::string_view MacroProcessor::keep(std::string_view text,bool copyText){
+    if(!copyText){
+        return text;
+    }
+    return workingFile.ownedNames.emplace_back(text);
+}
+
+std::string_view MacroProcessor::new_local(){
+    return workingFile.ownedNames.emplace_back("??" + std::to_string(++localCount));
+}
+
+const MacroProcessor::Expansion& MacroProcessor::find_or_build(const ParsedLine& call,int depth,Expansion& scratch){
+    if(depth > MAX_DEPTH){
+        err("Error, macro ["+std::string(call.opcode)+"] is nested more than "+std::to_string(MAX_DEPTH)+" deep.",call.lineNumber);
+    }
+    const Definition& definition = macros.find(call.opcode)->second;
+    std::vector<std::string_view> values;
+    split_list(call.argument1,values);
+    if(values.size() > definition.params.size()){
+        err("Error, macro ["+std::string(call.opcode)+"] takes "+std::to_string(definition.params.size())+
+            " arguments but was passed "+std::to_string(values.size()),call.lineNumber);
+    }
+    key.assign(call.opcode);
+    for(std::string_view value : values){
+        key += '\n';
+        key += value;
+    }
+    auto cached = cache.find(key);
+    if(cached != cache.end()){
+        return cached->second;
+    }
+    //nested calls reuse key while this one is built
+    std::string cacheKey = key;
+
+    //substitute the arguments and the locals' names for this expansion into one block of text
+    std::vector<std::string_view> body;
+    std::vector<std::string_view> instances;
+    uint32_t localUses = 0;
+    if(definition.params.empty() && definition.locals.empty()){
+        body = definition.body;
+    }
+    else{
+        std::vector<std::string_view> names = definition.params;
+        names.insert(names.end(),definition.locals.begin(),definition.locals.end());
+        values.resize(definition.params.size());
+        for(size_t i = 0; i < definition.locals.size(); i++){
+            instances.push_back(new_local());
+        }
+        values.insert(values.end(),instances.begin(),instances.end());
+        std::string text;
+        for(std::string_view line : definition.body){
+            substitute(line,names,values,definition.params.size(),text,localUses);
+            text += '\n';
+        }
+        split_lines(workingFile.ownedNames.emplace_back(std::move(text)),body);
+    }
+
+    std::vector<ParsedLine> lexed;
+    lexed.reserve(body.size());
+    for(std::string_view line : body){
+        lexed.push_back(parse(line,call.lineNumber,this));
+    }
+    Expansion& expansion = scratch;
+    std::vector<LocalPatch> ownPatches;
+    flatten(lexed,0,lexed.size(),expansion,instances,ownPatches,depth);
+
+    //the locals can be renamed on reuse only if every use of them is a whole field of an ordinary line
+    uint32_t patchable = 0;
+    for(const ParsedLine& line : lexed){
+        if(line.directive == Directive::MacroCall || line.directive == Directive::Rept){
+            continue;
+        }
+        for(std::string_view instance : instances){
+            patchable += (line.label == instance) + (line.argument1 == instance) + (line.argument2 == instance);
+        }
+    }
+    if(patchable != localUses){
+        expansion.reusable = false;
+        return expansion;
+    }
+    for(LocalPatch patch : ownPatches){
+        patch.local += expansion.locals;
+        expansion.patches.push_back(patch);
+    }
+    expansion.locals += static_cast<uint32_t>(instances.size());
+    if(!expansion.reusable){
+        return expansion;
+    }
+    return cache.emplace(std::move(cacheKey),std::move(expansion)).first->second;
+}
+
+void MacroProcessor::flatten(const std::vector<ParsedLine>& lexed,size_t begin,size_t end,Expansion& out,
+                             const std::vector<std::string_view>& instances,std::vector<LocalPatch>& ownPatches,int depth){
+    for(size_t i = begin; i < end; i++){
+        const ParsedLine& line = lexed[i];
+        switch(line.directive){
+            case Directive::Macro:
+                err("Error, a macro cannot be defined inside a MACRO or REPT block.",line.lineNumber);
+            case Directive::Local:
+                err("Error, LOCAL is only allowed in a macro body.",line.lineNumber);
+            case Directive::Endm:
+                err("Error, ENDM without MACRO or REPT.",line.lineNumber);
+            default:
+                break;
+        }
+        ParsedLine labelLine;
+        const ParsedLine* plain = &line;
+        if(line.directive == Directive::Rept || line.directive == Directive::MacroCall){
+            //the label of a REPT or call line marks where its lines start; the opcode keeps it from being a blank line
+            if(line.label.empty()){
+                plain = nullptr;
+            }
+            else{
+                labelLine = ParsedLine(line.label,line.opcode,{},{},nullptr,line.lineNumber);
+                plain = &labelLine;
+            }
+        }
+        if(plain != nullptr){
+            uint32_t index = static_cast<uint32_t>(out.lines.size());
+            out.lines.push_back(*plain);
+            for(size_t k = 0; k < instances.size(); k++){
+                for(uint8_t field = 0; field < 3; field++){
+                    if(line_field(out.lines.back(),field) == instances[k]){
+                        ownPatches.push_back({index,field,static_cast<uint32_t>(k)});
+                    }
+                }
+            }
+        }
+        if(line.directive == Directive::Rept){
+            uint16_t count = resolve_value(workingFile,line);
+            size_t close = i + 1;
+            for(int open = 0; close < end; close++){
+                Directive directive = lexed[close].directive;
+                if(directive == Directive::Rept){
+                    open++;
+                }
+                else if(directive == Directive::Endm && open-- == 0){
+                    break;
+                }
+            }
+            if(close == end){
+                err("Error, REPT without ENDM.",line.lineNumber);
+            }
+            for(uint16_t repeat = 0; repeat < count; repeat++){
+                flatten(lexed,i + 1,close,out,instances,ownPatches,depth);
+            }
+            i = close;
+        }
+        else if(line.directive == Directive::MacroCall){
+            Expansion scratch;
+            const Expansion& nested = find_or_build(line,depth + 1,scratch);
+            uint32_t first = static_cast<uint32_t>(out.lines.size());
+            out.lines.insert(out.lines.end(),nested.lines.begin(),nested.lines.end());
+            for(size_t k = first; k < out.lines.size(); k++){
+                out.lines[k].lineNumber = line.lineNumber;
+            }
+            for(LocalPatch patch : nested.patches){
+                out.patches.push_back({first + patch.line,patch.field,out.locals + patch.local});
+            }
+            out.locals += nested.locals;
+            out.reusable = out.reusable && nested.reusable;
+        }
+    }
+}
+
+void MacroProcessor::instantiate(const Expansion& expansion,std::vector<ParsedLine>& lines){
+    lines.assign(expansion.lines.begin(),expansion.lines.end());
+    if(expansion.locals == 0){
+        return;
+    }
+    std::vector<std::string_view> names;
+    names.reserve(expansion.locals);
+    for(uint32_t i = 0; i < expansion.locals; i++){
+        names.push_back(new_local());
+    }
+    for(const LocalPatch& patch : expansion.patches){
+        line_field(lines[patch.line],patch.field) = names[patch.local];
+    }
+}
@@ -0,0 +1,157 @@
+#ifndef MACROPROCESSOR_H_INCLUDED
+#define MACROPROCESSOR_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "i8080Assembler.h"
+
+/**
+ * @brief The macro front end of the single pass: records MACRO and REPT blocks and turns macro calls and closed
+ *        REPT blocks into lexed lines for the assembler.
+ *        An expansion substitutes the arguments into the body once, lexes it and unrolls nested REPT blocks and macro
+ *        calls, giving a flat list of ParsedLines whose views point into one text block in the file's arena; no line
+ *        is added to AssembledFile::lines. Expansions are cached by macro and argument list, so calling a macro
+ *        again with the same arguments copies the lexed lines and only renames its LOCAL labels.
+ */
+class MacroProcessor{
+public:
+    explicit MacroProcessor(AssembledFile& workingFile);
+
+    /**
+     * @brief Tells whether a MACRO or REPT block is open, so the next source line belongs to its body.
+     * @return true while recording; false otherwise.
+     */
+    bool recording() const { return open.kind != Directive::None; }
+
+    /**
+     * @brief Tells whether a name is a macro defined so far.
+     * @param name Opcode as written in the source.
+     * @return true if name is a macro; false otherwise.
+     */
+    bool defines(std::string_view name) const { return macros.count(name) != 0; }
+
+    /**
+     * @brief Opens a block from its MACRO or REPT line. The REPT count must be known already.
+     * @param line Lexed MACRO or REPT line.
+     * @param copyText Whether the source text goes away after the line (streaming); names are then copied.
+     * @return None (throws AssemblyError on a bad definition).
+     */
+    void begin(const ParsedLine& line,bool copyText);
+
+    /**
+     * @brief Adds a source line to the open block.
+     * @param text Raw line text.
+     * @param lineNumber Zero-based line number.
+     * @param copyText Whether the text must be copied (see begin).
+     * @return true if the line was the ENDM closing the block; close() must be called next.
+     */
+    bool record(std::string_view text,uint32_t lineNumber,bool copyText);
+
+    /**
+     * @brief Closes the block whose ENDM was just recorded: a MACRO is stored, a REPT is unrolled.
+     * @return Lines to assemble in place of the block (none for a MACRO). Valid until the next call.
+     */
+    const std::vector<ParsedLine>& close();
+
+    /**
+     * @brief Expands a macro call.
+     * @param call Lexed call line (Directive::MacroCall).
+     * @return Lines to assemble in place of the call, all numbered as the call. Valid until the next call.
+     */
+    const std::vector<ParsedLine>& expand(const ParsedLine& call);
+
+    /**
+     * @brief Checks that no block is left open at the end of the source.
+     * @return None (throws AssemblyError naming the unclosed block's line).
+     */
+    void finish() const;
+
+private:
+    struct Definition{
+        std::vector<std::string_view> params;
+        std::vector<std::string_view> locals;
+        //body lines without the LOCAL lines
+        std::vector<std::string_view> body;
+    };
+
+    //a field of a cached line that holds a local label, renamed on every use
+    struct LocalPatch{
+        uint32_t line = 0;
+        //0 label, 1 argument1, 2 argument2
+        uint8_t field = 0;
+        uint32_t local = 0;
+    };
+
+    struct Expansion{
+        std::vector<ParsedLine> lines;
+        std::vector<LocalPatch> patches;
+        //distinct local labels the patches refer to
+        uint32_t locals = 0;
+        //false if a local label is used somewhere a patch cannot reach (inside a list or a nested call's arguments)
+        bool reusable = true;
+    };
+
+    //the block being recorded
+    struct Block{
+        Directive kind = Directive::None;
+        std::string_view name;
+        std::vector<std::string_view> params;
+        uint16_t count = 0;
+        uint32_t lineNumber = 0;
+        std::vector<std::string_view> body;
+        std::vector<uint32_t> bodyLines;
+        //nested MACRO/REPT blocks open inside the body
+        int depth = 0;
+    };
+
+    std::string_view keep(std::string_view text,bool copyText);
+    std::string_view new_local();
+
+    /**
+     * @brief Finds the cached expansion of a call, or builds it.
+     * @param call Lexed call line.
+     * @param depth Nesting depth of the call.
+     * @param scratch Holds the expansion if it cannot be cached.
+     * @return The expansion (its local labels still need fresh names, see instantiate).
+     */
+    const Expansion& find_or_build(const ParsedLine& call,int depth,Expansion& scratch);
+
+    /**
+     * @brief Unrolls lexed lines into an expansion: REPT blocks are repeated and macro calls expanded in place.
+     * @param lexed Lexed lines.
+     * @param begin First line to unroll.
+     * @param end One past the last line.
+     * @param out Expansion receiving the lines.
+     * @param instances Names given to the enclosing macro's locals; patches are recorded where a line uses one.
+     * @param ownPatches Receives those patches.
+     * @param depth Nesting depth.
+     * @return None.
+     */
+    void flatten(const std::vector<ParsedLine>& lexed,size_t begin,size_t end,Expansion& out,
+                 const std::vector<std::string_view>& instances,std::vector<LocalPatch>& ownPatches,int depth);
+
+    /**
+     * @brief Copies an expansion's lines and gives its local labels fresh names.
+     * @param expansion Expansion to copy.
+     * @param lines Receives the lines.
+     * @return None.
+     */
+    void instantiate(const Expansion& expansion,std::vector<ParsedLine>& lines);
+
+    AssembledFile& workingFile;
+    Block open;
+    std::unordered_map<std::string_view,Definition> macros;
+    //(macro, arguments) joined by newlines -> expansion
+    std::unordered_map<std::string,Expansion> cache;
+    std::string key;
+    std::vector<ParsedLine> result;
+    uint32_t localCount = 0;
+    //calls nested deeper than this are taken to be a macro calling itself
+    static const int MAX_DEPTH = 32;
+};
+
+#endif // MACROPROCESSOR_H_INCLUDED
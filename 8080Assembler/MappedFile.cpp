@@ -0,0 +1,153 @@
+#include "MappedFile.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile(){
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept{
+    if(this != &other){
+        close();
+        data = other.data;
+        length = other.length;
+        other.data = nullptr;
+        other.length = 0;
+#ifdef _WIN32
+        fileHandle = other.fileHandle;
+        mappingHandle = other.mappingHandle;
+        other.fileHandle = nullptr;
+        other.mappingHandle = nullptr;
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path){
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE){
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize)){
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    //an empty file cannot be mapped, but it is still a valid (empty) source
+    if(fileSize.QuadPart == 0){
+        return true;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping == nullptr){
+        close();
+        return false;
+    }
+    mappingHandle = mapping;
+    data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if(data == nullptr){
+        close();
+        return false;
+    }
+    length = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::close(){
+    if(data != nullptr){
+        UnmapViewOfFile(data);
+    }
+    if(mappingHandle != nullptr){
+        CloseHandle(mappingHandle);
+    }
+    if(fileHandle != nullptr){
+        CloseHandle(fileHandle);
+    }
+    data = nullptr;
+    length = 0;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path){
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)){
+        ::close(fd);
+        return false;
+    }
+    //an empty file cannot be mapped, but it is still a valid (empty) source
+    if(info.st_size == 0){
+        ::close(fd);
+        return true;
+    }
+    void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    //the mapping keeps its own reference to the file
+    ::close(fd);
+    if(mapping == MAP_FAILED){
+        return false;
+    }
+    //the passes read the source front to back exactly once each
+    madvise(mapping, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+    data = static_cast<const char*>(mapping);
+    length = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void MappedFile::close(){
+    if(data != nullptr){
+        munmap(const_cast<char*>(data), length);
+    }
+    data = nullptr;
+    length = 0;
+}
+
+#endif
+
+void split_lines(std::string_view buffer,std::vector<std::string_view>& lines){
+    const char* cursor = buffer.data();
+    const char* end = cursor + buffer.size();
+    while(cursor < end){
+        const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', static_cast<size_t>(end - cursor)));
+        const char* lineEnd = newline ? newline : end;
+        size_t length = static_cast<size_t>(lineEnd - cursor);
+        if(length > 0 && cursor[length - 1] == '\r'){
+            length--;
+        }
+        lines.emplace_back(cursor, length);
+        if(newline == nullptr){
+            break;
+        }
+        cursor = newline + 1;
+    }
+}
+
+std::vector<std::string_view> split_lines(std::string_view buffer){
+    std::vector<std::string_view> lines;
+    //a rough guess at the line count saves most of the regrowth on large files
+    lines.reserve(buffer.size() / 16 + 1);
+    split_lines(buffer,lines);
+    return lines;
+}
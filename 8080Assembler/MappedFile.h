@@ -0,0 +1,65 @@
+#ifndef MAPPEDFILE_H_INCLUDED
+#define MAPPEDFILE_H_INCLUDED
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief A read-only memory mapping of a whole file.
+ *        The mapping lives as long as the object, so views handed out by view() must not outlive it.
+ */
+class MappedFile{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    /**
+     * @brief Maps the file at path read-only, replacing any previous mapping.
+     * @param path File to map.
+     * @return true if the file was opened and mapped (an empty file maps to an empty view); false otherwise.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Unmaps the file. Safe to call on an unopened object.
+     * @param None.
+     * @return None.
+     */
+    void close();
+
+    std::string_view view() const { return std::string_view(data, length); }
+    size_t size() const { return length; }
+
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
+
+/**
+ * @brief Splits a buffer into lines without copying them.
+ *        Newlines are found with memchr, which the C library implements with wide vector loads,
+ *        so the scan runs at memory bandwidth. A trailing '\r' is dropped from each line.
+ * @param buffer Whole source text.
+ * @return One view per line, pointing into buffer. A final line without a newline is included.
+ */
+std::vector<std::string_view> split_lines(std::string_view buffer);
+
+/**
+ * @brief Splits a buffer into lines like split_lines(buffer), appending to an existing vector so its capacity is reused.
+ * @param buffer Whole source text.
+ * @param lines Receives one view per line, pointing into buffer.
+ * @return None.
+ */
+void split_lines(std::string_view buffer,std::vector<std::string_view>& lines);
+
+#endif // MAPPEDFILE_H_INCLUDED
@@ -0,0 +1,160 @@
+#include "ObjectFile.h"
+
+#include <cstring>
+
+namespace {
+
+const char OBJECT_MAGIC[4] = {'I', '8', '0', 'O'};
+const uint16_t OBJECT_VERSION = 1;
+
+void put_u16(std::string& out, uint16_t value){
+    out.push_back(static_cast<char>(value & 0xFF));
+    out.push_back(static_cast<char>(value >> 8));
+}
+
+void put_u32(std::string& out, uint32_t value){
+    put_u16(out, static_cast<uint16_t>(value & 0xFFFF));
+    put_u16(out, static_cast<uint16_t>(value >> 16));
+}
+
+void put_name(std::string& out, std::string_view name){
+    put_u16(out, static_cast<uint16_t>(name.size()));
+    out.append(name);
+}
+
+//Reads little-endian fields off the front of an object file; every read fails once one runs past the end
+struct ObjectReader {
+    std::string_view data;
+    bool ok = true;
+
+    bool take(size_t count, std::string_view& bytes){
+        if(!ok || data.size() < count){
+            ok = false;
+            return false;
+        }
+        bytes = data.substr(0, count);
+        data.remove_prefix(count);
+        return true;
+    }
+
+    uint32_t u16(){
+        std::string_view bytes;
+        if(!take(2, bytes)){
+            return 0;
+        }
+        return static_cast<uint8_t>(bytes[0]) | static_cast<uint32_t>(static_cast<uint8_t>(bytes[1])) << 8;
+    }
+
+    uint32_t u32(){
+        uint32_t low = u16();
+        return low | u16() << 16;
+    }
+
+    //a count is checked against the bytes left, so a corrupt one cannot make the reader allocate wildly
+    uint32_t count(size_t entrySize){
+        uint32_t value = u32();
+        if(value > data.size() / entrySize){
+            ok = false;
+            return 0;
+        }
+        return value;
+    }
+
+    std::string name(){
+        std::string_view bytes;
+        take(u16(), bytes);
+        return std::string(bytes);
+    }
+};
+
+}
+
+std::string render_object(const ObjectModule& module){
+    std::string out(OBJECT_MAGIC, sizeof(OBJECT_MAGIC));
+    put_u16(out, OBJECT_VERSION);
+    put_u32(out, static_cast<uint32_t>(module.sections.size()));
+    for(const ObjectSection& section : module.sections){
+        put_u32(out, section.origin);
+        put_u32(out, section.offset);
+        put_u32(out, section.size);
+    }
+    put_u32(out, static_cast<uint32_t>(module.bytes.size()));
+    out.append(reinterpret_cast<const char*>(module.bytes.data()), module.bytes.size());
+    put_u32(out, static_cast<uint32_t>(module.exports.size()));
+    for(const ObjectSymbol& symbol : module.exports){
+        put_name(out, symbol.name);
+        put_u16(out, symbol.value);
+        out.push_back(symbol.relocatable ? 1 : 0);
+    }
+    put_u32(out, static_cast<uint32_t>(module.imports.size()));
+    for(const std::string& name : module.imports){
+        put_name(out, name);
+    }
+    put_u32(out, static_cast<uint32_t>(module.relocations.size()));
+    for(const ObjectRelocation& relocation : module.relocations){
+        put_u32(out, relocation.offset);
+        put_u32(out, relocation.import);
+    }
+    return out;
+}
+
+bool read_object(std::string_view data, ObjectModule& module){
+    module = ObjectModule();
+    ObjectReader reader{data};
+    std::string_view bytes;
+    if(!reader.take(sizeof(OBJECT_MAGIC), bytes) || std::memcmp(bytes.data(), OBJECT_MAGIC, sizeof(OBJECT_MAGIC)) != 0 ||
+       reader.u16() != OBJECT_VERSION){
+        return false;
+    }
+    module.sections.resize(reader.count(12));
+    for(ObjectSection& section : module.sections){
+        section.origin = reader.u32();
+        section.offset = reader.u32();
+        section.size = reader.u32();
+    }
+    if(reader.take(reader.count(1), bytes)){
+        module.bytes.assign(bytes.begin(), bytes.end());
+    }
+    module.exports.resize(reader.count(5));
+    for(ObjectSymbol& symbol : module.exports){
+        symbol.name = reader.name();
+        symbol.value = static_cast<uint16_t>(reader.u16());
+        reader.take(1, bytes);
+        symbol.relocatable = reader.ok && bytes[0] != 0;
+    }
+    module.imports.resize(reader.count(2));
+    for(std::string& name : module.imports){
+        name = reader.name();
+    }
+    module.relocations.resize(reader.count(8));
+    for(ObjectRelocation& relocation : module.relocations){
+        relocation.offset = reader.u32();
+        relocation.import = reader.u32();
+    }
+    if(!reader.ok || !reader.data.empty()){
+        return false;
+    }
+    for(const ObjectSection& section : module.sections){
+        if(section.offset > module.bytes.size() || section.size > module.bytes.size() - section.offset ||
+           section.origin + uint64_t(section.size) > 0x10000){
+            return false;
+        }
+    }
+    for(const ObjectRelocation& relocation : module.relocations){
+        if(relocation.offset + uint64_t(2) > module.bytes.size() ||
+           (relocation.import != LOCAL_RELOCATION && relocation.import >= module.imports.size())){
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t module_extent(const ObjectModule& module){
+    uint32_t extent = 0;
+    for(const ObjectSection& section : module.sections){
+        if(section.origin + section.size > extent){
+            extent = section.origin + section.size;
+        }
+    }
+    return extent;
+}
@@ -0,0 +1,69 @@
+#ifndef OBJECTFILE_H_INCLUDED
+#define OBJECTFILE_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//A run of a module's bytes: bytes[offset, offset + size) is loaded at the module's base address + origin
+struct ObjectSection {
+    uint32_t origin = 0;
+    uint32_t offset = 0;
+    uint32_t size = 0;
+};
+
+//A name another module can link against
+struct ObjectSymbol {
+    std::string name;
+    uint16_t value = 0;
+    //false for an EQU constant, which keeps its value wherever the module is placed
+    bool relocatable = true;
+};
+
+//relocation against the module's own base address rather than an import
+const uint32_t LOCAL_RELOCATION = UINT32_MAX;
+
+//A little-endian word in the module's bytes that the linker adds an address to
+struct ObjectRelocation {
+    //offset of the word in ObjectModule::bytes
+    uint32_t offset = 0;
+    //index into ObjectModule::imports, or LOCAL_RELOCATION to add the module's base address
+    uint32_t import = LOCAL_RELOCATION;
+};
+
+//One relocatable module as written by the assembler (-f obj) and read by the linker.
+//Addresses in the bytes and in exported values start at 0; the linker moves the module to its base address.
+struct ObjectModule {
+    std::vector<ObjectSection> sections;
+    std::vector<uint8_t> bytes;
+    std::vector<ObjectSymbol> exports;
+    std::vector<std::string> imports;
+    //in offset order
+    std::vector<ObjectRelocation> relocations;
+};
+
+/**
+ * @brief Serializes a module: a magic number and version, then the sections, bytes, exports, imports and relocations,
+ *        each as a count followed by its entries, all little-endian.
+ * @param module Module to write.
+ * @return The object file contents.
+ */
+std::string render_object(const ObjectModule& module);
+
+/**
+ * @brief Parses an object file written by render_object, checking every section and relocation lies inside it.
+ * @param data Object file contents.
+ * @param module Receives the module.
+ * @return true if data is a well-formed object file; false otherwise.
+ */
+bool read_object(std::string_view data, ObjectModule& module);
+
+/**
+ * @brief Gives the address space a module takes when it is placed: one past its highest section byte.
+ * @param module Module.
+ * @return Size in bytes from the module's base address.
+ */
+uint32_t module_extent(const ObjectModule& module);
+
+#endif // OBJECTFILE_H_INCLUDED
@@ -0,0 +1,122 @@
+#include "OutputCache.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <thread>
+
+namespace {
+
+const char CACHE_MAGIC[4] = {'I', '8', '0', 'C'};
+
+//the build stamp keeps a rebuilt assembler, whose output may differ, away from the entries of the old one
+const char CACHE_VERSION[] = "8080Assembler 1 " __DATE__ " " __TIME__;
+
+const uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+uint64_t fnv1a(uint64_t hash, std::string_view bytes){
+    for(char c : bytes){
+        hash = (hash ^ static_cast<uint8_t>(c)) * FNV_PRIME;
+    }
+    return hash;
+}
+
+void put_hex(std::string& out, uint64_t value, int digits){
+    static const char hexDigits[] = "0123456789abcdef";
+    for(int shift = (digits - 1) * 4; shift >= 0; shift -= 4){
+        out.push_back(hexDigits[(value >> shift) & 0xF]);
+    }
+}
+
+}
+
+OutputCache::OutputCache(std::string directory) : directory(std::move(directory)){
+}
+
+std::string OutputCache::key(std::string_view source, OutputFormat format, std::string_view options){
+    uint64_t hash = fnv1a(FNV_OFFSET, std::string_view(CACHE_VERSION, sizeof(CACHE_VERSION)));
+    const char* extension = format_extension(format);
+    hash = fnv1a(hash, std::string_view(extension, std::strlen(extension) + 1));
+    hash = fnv1a(hash, options);
+    hash = fnv1a(hash, std::string_view("", 1));
+    //a '\r' ending a line is dropped, as split_lines does; runs between them are hashed whole
+    uint64_t length = 0;
+    while(true){
+        size_t cr = source.find('\r');
+        if(cr == std::string_view::npos){
+            hash = fnv1a(hash, source);
+            length += source.size();
+            break;
+        }
+        bool lineEnd = cr + 1 == source.size() || source[cr + 1] == '\n';
+        size_t run = lineEnd ? cr : cr + 1;
+        hash = fnv1a(hash, source.substr(0, run));
+        length += run;
+        source.remove_prefix(cr + 1);
+    }
+    std::string name;
+    put_hex(name, hash, 16);
+    name.push_back('-');
+    put_hex(name, length, 8);
+    return name;
+}
+
+bool OutputCache::lookup(const std::string& key, CachedOutput& entry) const{
+    if(!entry.file.open(directory + "/" + key)){
+        return false;
+    }
+    std::string_view data = entry.file.view();
+    if(data.size() < sizeof(CACHE_MAGIC) + 4 || std::memcmp(data.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0){
+        return false;
+    }
+    data.remove_prefix(sizeof(CACHE_MAGIC));
+    uint32_t messagesLength = 0;
+    for(int i = 3; i >= 0; i--){
+        messagesLength = messagesLength << 8 | static_cast<uint8_t>(data[i]);
+    }
+    data.remove_prefix(4);
+    if(messagesLength > data.size()){
+        return false;
+    }
+    entry.messages = data.substr(0, messagesLength);
+    entry.output = data.substr(messagesLength);
+    return true;
+}
+
+bool OutputCache::store(const std::string& key, std::string_view messages, std::string_view output) const{
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    //unique per process and thread, so concurrent writers of the same key never share a temporary
+    static std::atomic<uint32_t> counter{0};
+    std::string temporary = directory + "/" + key + ".tmp";
+    put_hex(temporary, std::hash<std::thread::id>()(std::this_thread::get_id()), 16);
+    put_hex(temporary, static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()), 16);
+    put_hex(temporary, counter++, 8);
+    std::FILE* file = std::fopen(temporary.c_str(), "wb");
+    if(file == nullptr){
+        return false;
+    }
+    char header[sizeof(CACHE_MAGIC) + 4];
+    std::memcpy(header, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    uint32_t messagesLength = static_cast<uint32_t>(messages.size());
+    for(int i = 0; i < 4; i++){
+        header[sizeof(CACHE_MAGIC) + i] = static_cast<char>(messagesLength >> (8 * i));
+    }
+    bool ok = std::fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    ok = ok && std::fwrite(messages.data(), 1, messages.size(), file) == messages.size();
+    ok = ok && std::fwrite(output.data(), 1, output.size(), file) == output.size();
+    ok = std::fclose(file) == 0 && ok;
+    if(ok){
+        std::filesystem::rename(temporary, directory + "/" + key, error);
+        ok = !error;
+    }
+    if(!ok){
+        std::filesystem::remove(temporary, error);
+    }
+    return ok;
+}
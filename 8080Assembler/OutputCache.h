@@ -0,0 +1,59 @@
+#ifndef OUTPUTCACHE_H_INCLUDED
+#define OUTPUTCACHE_H_INCLUDED
+
+#include <string>
+#include <string_view>
+#include "MappedFile.h"
+#include "OutputWriters.h"
+
+//A cache entry mapped from disk; the views point into the mapping
+struct CachedOutput {
+    MappedFile file;
+    //warnings the assembly printed, one per line
+    std::string_view messages;
+    //the output file's contents
+    std::string_view output;
+};
+
+/**
+ * @brief A directory of assembled outputs, content-addressed by a hash of the source and of everything else that
+ *        decides the output (assembler build, output format and defines), so an unchanged source is never assembled twice.
+ *        Only sources that assembled without errors are stored. Entries are written to a temporary file and renamed
+ *        into place, so concurrent runs sharing the directory never see a partial entry.
+ */
+class OutputCache {
+public:
+    explicit OutputCache(std::string directory);
+
+    /**
+     * @brief Computes the key of a source. Line endings are normalized the way split_lines reads them, so a CRLF
+     *        checkout hits the entries of an LF one.
+     * @param source Whole source text.
+     * @param format Output format.
+     * @param options Any other settings that change the output (the -D defines), in a fixed spelling.
+     * @return Entry name: 64-bit FNV-1a hash and normalized length, in hex.
+     */
+    static std::string key(std::string_view source, OutputFormat format, std::string_view options);
+
+    /**
+     * @brief Maps the entry for a key.
+     * @param key Key from key().
+     * @param entry Receives the mapping and views of its parts.
+     * @return true on a hit; false if there is no (well-formed) entry.
+     */
+    bool lookup(const std::string& key, CachedOutput& entry) const;
+
+    /**
+     * @brief Stores an entry, replacing any entry with the same key.
+     * @param key Key from key().
+     * @param messages Warnings, one per line.
+     * @param output Output file contents.
+     * @return true if the entry was written; false otherwise (the cache is then just skipped).
+     */
+    bool store(const std::string& key, std::string_view messages, std::string_view output) const;
+
+private:
+    std::string directory;
+};
+
+#endif // OUTPUTCACHE_H_INCLUDED
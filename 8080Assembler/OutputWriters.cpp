@@ -0,0 +1,275 @@
+#include "OutputWriters.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+
+const char hexDigits[] = "0123456789ABCDEF";
+
+//Width of a listing row before the source text: "AAAA  XX XX XX  "
+const size_t LISTING_PREFIX = 16;
+
+//Bytes shown on a listing row; a longer line continues on rows of its own
+const uint32_t LISTING_ROW_BYTES = 3;
+
+/**
+ * @brief Appends a byte as two uppercase hex digits to a buffer that already has room for them.
+ * @param out Write cursor, advanced past the digits.
+ * @param value Byte to write.
+ * @return None.
+ */
+void put_hex_byte(char*& out, uint8_t value){
+    *out++ = hexDigits[value >> 4];
+    *out++ = hexDigits[value & 0xF];
+}
+
+/**
+ * @brief Writes one Intel HEX record (":LLAAAATT<data>CC\n").
+ * @param out Write cursor, advanced past the record.
+ * @param address 16-bit load address field.
+ * @param type Record type (00 data, 01 end of file, 04 extended linear address).
+ * @param data Record payload.
+ * @param length Number of payload bytes.
+ * @return None.
+ */
+void put_hex_record(char*& out, uint16_t address, uint8_t type, const uint8_t* data, uint8_t length){
+    uint8_t checksum = static_cast<uint8_t>(length + (address >> 8) + (address & 0xFF) + type);
+    *out++ = ':';
+    put_hex_byte(out, length);
+    put_hex_byte(out, static_cast<uint8_t>(address >> 8));
+    put_hex_byte(out, static_cast<uint8_t>(address & 0xFF));
+    put_hex_byte(out, type);
+    for(uint8_t i = 0; i < length; i++){
+        put_hex_byte(out, data[i]);
+        checksum = static_cast<uint8_t>(checksum + data[i]);
+    }
+    put_hex_byte(out, static_cast<uint8_t>(-checksum));
+    *out++ = '\n';
+}
+
+/**
+ * @brief Splits the image into Intel HEX data records: at most 16 bytes, never crossing a segment end or a 64 KiB
+ *        boundary.
+ * @param segments Populated segments, in address order.
+ * @param record Callable taking (uint32_t address, const uint8_t* data, uint8_t length) for each record.
+ * @return None.
+ */
+template <typename Record>
+void for_each_hex_record(const std::vector<ImageSegment>& segments, Record record){
+    const size_t bytesPerRecord = 16;
+    for(const ImageSegment& segment : segments){
+        for(size_t done = 0; done < segment.size;){
+            uint32_t address = static_cast<uint32_t>(segment.address + done);
+            size_t length = segment.size - done < bytesPerRecord ? segment.size - done : bytesPerRecord;
+            size_t toBoundary = 0x10000 - (address & 0xFFFF);
+            if(length > toBoundary){
+                length = toBoundary;
+            }
+            record(address, segment.data + done, static_cast<uint8_t>(length));
+            done += length;
+        }
+    }
+}
+
+/**
+ * @brief Opens stdout for binary output.
+ * @return stdout.
+ */
+std::FILE* binary_stdout(){
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    return stdout;
+}
+
+}
+
+OutputFormat format_from_extension(std::string_view path){
+    size_t dot = path.find_last_of('.');
+    if(dot == std::string_view::npos){
+        return OutputFormat::Binary;
+    }
+    std::string_view extension = path.substr(dot + 1);
+    if(extension == "hex" || extension == "HEX" || extension == "ihx" || extension == "IHX"){
+        return OutputFormat::IntelHex;
+    }
+    if(extension == "lst" || extension == "LST"){
+        return OutputFormat::Listing;
+    }
+    if(extension == "obj" || extension == "OBJ"){
+        return OutputFormat::Object;
+    }
+    return OutputFormat::Binary;
+}
+
+const char* format_extension(OutputFormat format){
+    switch(format){
+        case OutputFormat::Binary: return ".bin";
+        case OutputFormat::IntelHex: return ".hex";
+        case OutputFormat::Listing: return ".lst";
+        case OutputFormat::Object: return ".obj";
+        case OutputFormat::Bits: break;
+    }
+    return ".bits";
+}
+
+bool parse_output_format(std::string_view name, OutputFormat& format){
+    if(name == "bits"){ format = OutputFormat::Bits; return true; }
+    if(name == "bin"){ format = OutputFormat::Binary; return true; }
+    if(name == "hex"){ format = OutputFormat::IntelHex; return true; }
+    if(name == "lst"){ format = OutputFormat::Listing; return true; }
+    if(name == "obj"){ format = OutputFormat::Object; return true; }
+    return false;
+}
+
+std::string render_bits(const std::vector<ImageSegment>& segments){
+    size_t total = 0;
+    for(const ImageSegment& segment : segments){
+        total += segment.size;
+    }
+    std::string text(total * 9, '\n');
+    char* out = text.data();
+    for(const ImageSegment& segment : segments){
+        for(size_t b = 0; b < segment.size; b++){
+            uint8_t value = segment.data[b];
+            for (int i = 7; i >= 0; --i) {
+                *out++ = static_cast<char>('0' + ((value >> i) & 1));
+            }
+            //the newline is already there from the fill
+            out++;
+        }
+    }
+    return text;
+}
+
+std::string render_intel_hex(const std::vector<ImageSegment>& segments){
+    //data records are 12 characters plus 2 per byte, the EOF record is 12 and each extended address record 16
+    size_t total = 12;
+    uint32_t upper = 0;
+    for_each_hex_record(segments, [&](uint32_t address, const uint8_t*, uint8_t length){
+        if((address >> 16) != upper){
+            upper = address >> 16;
+            total += 16;
+        }
+        total += 12 + length * 2;
+    });
+    std::string text(total, '\0');
+    char* out = text.data();
+    upper = 0;
+    for_each_hex_record(segments, [&](uint32_t address, const uint8_t* data, uint8_t length){
+        if((address >> 16) != upper){
+            upper = address >> 16;
+            uint8_t upperBytes[2] = {static_cast<uint8_t>(upper >> 8), static_cast<uint8_t>(upper & 0xFF)};
+            put_hex_record(out, 0, 0x04, upperBytes, 2);
+        }
+        put_hex_record(out, static_cast<uint16_t>(address & 0xFFFF), 0x00, data, length);
+    });
+    put_hex_record(out, 0, 0x01, nullptr, 0);
+    return text;
+}
+
+std::string render_listing(const std::vector<uint8_t>& image, const std::vector<ListingEntry>& entries){
+    size_t total = 0;
+    for(const ListingEntry& entry : entries){
+        total += LISTING_PREFIX + entry.source.size() + 1;
+        //continuation rows: "AAAA  XX XX XX\n"
+        for(uint32_t at = LISTING_ROW_BYTES; at < entry.size; at += LISTING_ROW_BYTES){
+            total += 6 + 3 * std::min<size_t>(entry.size - at, LISTING_ROW_BYTES);
+        }
+    }
+    std::string text(total, ' ');
+    char* out = text.data();
+    for(const ListingEntry& entry : entries){
+        for(uint32_t at = 0; at == 0 || at < entry.size; at += LISTING_ROW_BYTES){
+            char* row = out;
+            uint16_t address = static_cast<uint16_t>(entry.address + at);
+            put_hex_byte(out, static_cast<uint8_t>(address >> 8));
+            put_hex_byte(out, static_cast<uint8_t>(address & 0xFF));
+            out += 2;
+            for(uint32_t i = at; i < entry.size && i < at + LISTING_ROW_BYTES; i++){
+                put_hex_byte(out, image[entry.offset + i]);
+                out++;
+            }
+            if(at == 0){
+                out = row + LISTING_PREFIX;
+                out += entry.source.copy(out, entry.source.size());
+            }
+            else{
+                //no separator after the last byte
+                out--;
+            }
+            *out++ = '\n';
+        }
+    }
+    return text;
+}
+
+std::string render_image(const std::vector<ImageSegment>& segments){
+    if(segments.empty()){
+        return {};
+    }
+    uint32_t base = segments.front().address;
+    std::string image(segments.back().address + segments.back().size - base, '\0');
+    for(const ImageSegment& segment : segments){
+        std::copy(segment.data, segment.data + segment.size, image.begin() + (segment.address - base));
+    }
+    return image;
+}
+
+bool write_image(const std::string& path, const std::vector<ImageSegment>& segments){
+    if(segments.size() <= 1){
+        //a single run is just a buffer
+        return segments.empty() ? write_output(path, {}) :
+               write_output(path, std::string_view(reinterpret_cast<const char*>(segments[0].data), segments[0].size));
+    }
+    uint32_t base = segments.front().address;
+    bool ok = true;
+    if(path == "-"){
+        std::FILE* out = binary_stdout();
+        uint32_t end = base;
+        const char zeros[256] = {};
+        for(const ImageSegment& segment : segments){
+            for(; end < segment.address; ){
+                size_t gap = segment.address - end < sizeof(zeros) ? segment.address - end : sizeof(zeros);
+                ok = ok && std::fwrite(zeros, 1, gap, out) == gap;
+                end += static_cast<uint32_t>(gap);
+            }
+            ok = ok && std::fwrite(segment.data, 1, segment.size, out) == segment.size;
+            end = static_cast<uint32_t>(segment.address + segment.size);
+        }
+        return std::fflush(out) == 0 && ok;
+    }
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if(file == nullptr){
+        return false;
+    }
+    //every segment is one write at its own place; seeking past the end leaves the gap unwritten
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    for(const ImageSegment& segment : segments){
+        ok = ok && std::fseek(file, static_cast<long>(segment.address - base), SEEK_SET) == 0;
+        ok = ok && std::fwrite(segment.data, 1, segment.size, file) == segment.size;
+    }
+    return std::fclose(file) == 0 && ok;
+}
+
+bool write_output(const std::string& path, std::string_view data){
+    if(path == "-"){
+        binary_stdout();
+        bool ok = std::fwrite(data.data(), 1, data.size(), stdout) == data.size();
+        return std::fflush(stdout) == 0 && ok;
+    }
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if(file == nullptr){
+        return false;
+    }
+    //the whole output is already in one buffer, so skip stdio's buffer and hand it to the OS in one write
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    return std::fclose(file) == 0 && ok;
+}
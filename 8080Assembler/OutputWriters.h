@@ -0,0 +1,109 @@
+#ifndef OUTPUTWRITERS_H_INCLUDED
+#define OUTPUTWRITERS_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//Formats the assembler can write its output in
+enum class OutputFormat {
+    Bits,       //one byte per line as 8 binary digits (the original console output)
+    Binary,     //raw image bytes
+    IntelHex,   //Intel HEX records, 16 data bytes per record
+    Listing,    //address, encoded bytes and source text per line
+    Object      //relocatable object for the linker (see ObjectFile.h)
+};
+
+//One source line as it appears in a listing
+struct ListingEntry {
+    //offset of the line's first byte in the image
+    uint32_t offset;
+    //address the line was assembled at
+    uint16_t address;
+    //number of bytes the line produced (0 for label-only/blank/ORG/DS/EQU lines)
+    uint16_t size;
+    std::string_view source;
+};
+
+//A populated run of the memory image
+struct ImageSegment {
+    //load address of the first byte
+    uint32_t address;
+    const uint8_t* data;
+    size_t size;
+};
+
+/**
+ * @brief Picks an output format from a file name's extension (.hex/.ihx, .lst, .obj, anything else is raw binary).
+ * @param path Output file name.
+ * @return The matching format.
+ */
+OutputFormat format_from_extension(std::string_view path);
+
+/**
+ * @brief Gives the file extension batch mode uses for a format.
+ * @param format Output format.
+ * @return Extension including the dot (".bin", ".hex", ".lst", ".obj" or ".bits").
+ */
+const char* format_extension(OutputFormat format);
+
+/**
+ * @brief Parses a format name given on the command line (bits, bin, hex, lst, obj).
+ * @param name Format name.
+ * @param format Receives the format if the name is recognized.
+ * @return true if name was recognized; false otherwise.
+ */
+bool parse_output_format(std::string_view name, OutputFormat& format);
+
+/**
+ * @brief Renders the image as 8 binary digits plus a newline per byte, segment after segment (gaps are skipped).
+ * @param segments Populated segments, in address order.
+ * @return The rendered text, allocated once at its final size.
+ */
+std::string render_bits(const std::vector<ImageSegment>& segments);
+
+/**
+ * @brief Renders the image as Intel HEX data records followed by an end-of-file record.
+ *        Only the populated segments get records; a record never crosses the end of a segment or a 64 KiB boundary,
+ *        and an extended linear address record is written whenever the upper 16 address bits change.
+ * @param segments Populated segments, in address order.
+ * @return The rendered text, allocated once at its final size.
+ */
+std::string render_intel_hex(const std::vector<ImageSegment>& segments);
+
+/**
+ * @brief Renders a listing with one row per source line: address, up to 3 encoded bytes, then the source text.
+ *        A line of more than 3 bytes continues on rows holding only the address and the next 3 bytes.
+ * @param image Assembled bytes.
+ * @param entries One entry per source line, in source order.
+ * @return The rendered text, allocated once at its final size.
+ */
+std::string render_listing(const std::vector<uint8_t>& image, const std::vector<ListingEntry>& entries);
+
+/**
+ * @brief Renders the image as the raw binary write_image produces: from the lowest segment's address, gaps as zeros.
+ * @param segments Populated segments, in address order.
+ * @return The bytes, allocated once at their final size.
+ */
+std::string render_image(const std::vector<ImageSegment>& segments);
+
+/**
+ * @brief Writes the image as a raw binary starting at the lowest segment's address.
+ *        A file gets each segment at its place by seeking over the gaps, so large gaps become holes on file systems
+ *        that support them; stdout gets the gaps as zero bytes.
+ * @param path Destination file, or "-" for stdout.
+ * @param segments Populated segments, in address order.
+ * @return true if every byte was written; false otherwise.
+ */
+bool write_image(const std::string& path, const std::vector<ImageSegment>& segments);
+
+/**
+ * @brief Writes a buffer to a file (or stdout for "-") with a single unbuffered write.
+ * @param path Destination file, or "-" for stdout.
+ * @param data Bytes to write.
+ * @return true if every byte was written; false otherwise.
+ */
+bool write_output(const std::string& path, std::string_view data);
+
+#endif // OUTPUTWRITERS_H_INCLUDED
@@ -0,0 +1,294 @@
+#include "Peephole.h"
+
+#include "MacroProcessor.h"
+
+namespace {
+
+//register bits of a liveness set, in Reg order, then the flags
+const uint16_t REG_B = 1 << 0;
+const uint16_t REG_C = 1 << 1;
+const uint16_t REG_D = 1 << 2;
+const uint16_t REG_E = 1 << 3;
+const uint16_t REG_H = 1 << 4;
+const uint16_t REG_L = 1 << 5;
+const uint16_t REG_A = 1 << 7;
+const uint16_t FLAGS = 1 << 8;
+
+//source lines a liveness scan looks at before giving up
+const size_t LOOKAHEAD = 32;
+
+//What an instruction does to the registers
+struct Effect{
+    //registers whose value it uses
+    uint16_t reads = 0;
+    //registers it overwrites whole (a partial write of the flags, like INR's, is not one)
+    uint16_t writes = 0;
+    //control leaves the straight line (or the line is not an instruction): everything is live
+    bool ends = false;
+};
+
+/**
+ * @brief Gives the bits of a register operand; M stands for the H and L it addresses through.
+ * @param name Operand text.
+ * @return The register bits; 0 if name is not a register.
+ */
+uint16_t register_bits(std::string_view name){
+    int code = lookup_reg(name);
+    if(code < 0){
+        return 0;
+    }
+    return code == static_cast<int>(Reg::M) ? REG_H | REG_L : static_cast<uint16_t>(1 << code);
+}
+
+/**
+ * @brief Gives the bits of a register pair operand (PSW is A and the flags).
+ * @param name Operand text.
+ * @return The register bits; 0 for SP or a name that is not a pair.
+ */
+uint16_t pair_bits(std::string_view name){
+    if(name == "PSW"){
+        return REG_A | FLAGS;
+    }
+    switch(lookup_rp(name)){
+        case static_cast<int>(RP::BC): return REG_B | REG_C;
+        case static_cast<int>(RP::DE): return REG_D | REG_E;
+        case static_cast<int>(RP::HL): return REG_H | REG_L;
+        default: return 0;
+    }
+}
+
+/**
+ * @brief Works out what a lexed line does to the registers.
+ * @param line Lexed line.
+ * @return Its effect; a label-only or blank line has none.
+ */
+Effect line_effect(const ParsedLine& line){
+    Effect effect;
+    if(line.instruction == nullptr){
+        effect.ends = line.directive != Directive::None || !line.opcode.empty();
+        return effect;
+    }
+    std::string_view mnemonic = line.instruction->mnemonic;
+    std::string_view a1 = line.argument1;
+    std::string_view a2 = line.argument2;
+    bool memory = a1 == "M";
+    if(mnemonic == "MOV"){
+        effect.reads = register_bits(a2) | (memory ? REG_H | REG_L : 0);
+        effect.writes = memory ? 0 : register_bits(a1);
+    }
+    else if(mnemonic == "MVI"){
+        effect.reads = memory ? REG_H | REG_L : 0;
+        effect.writes = memory ? 0 : register_bits(a1);
+    }
+    else if(mnemonic == "ADD" || mnemonic == "SUB" || mnemonic == "ANA" || mnemonic == "XRA" || mnemonic == "ORA"){
+        effect.reads = REG_A | register_bits(a1);
+        effect.writes = REG_A | FLAGS;
+    }
+    else if(mnemonic == "ADC" || mnemonic == "SBB"){
+        effect.reads = REG_A | FLAGS | register_bits(a1);
+        effect.writes = REG_A | FLAGS;
+    }
+    else if(mnemonic == "CMP"){
+        effect.reads = REG_A | register_bits(a1);
+        effect.writes = FLAGS;
+    }
+    else if(mnemonic == "ADI" || mnemonic == "SUI" || mnemonic == "ANI" || mnemonic == "XRI" || mnemonic == "ORI"){
+        effect.reads = REG_A;
+        effect.writes = REG_A | FLAGS;
+    }
+    else if(mnemonic == "ACI" || mnemonic == "SBI" || mnemonic == "DAA"){
+        effect.reads = REG_A | FLAGS;
+        effect.writes = REG_A | FLAGS;
+    }
+    else if(mnemonic == "CPI"){
+        effect.reads = REG_A;
+        effect.writes = FLAGS;
+    }
+    else if(mnemonic == "INR" || mnemonic == "DCR"){
+        effect.reads = register_bits(a1);
+    }
+    else if(mnemonic == "INX" || mnemonic == "DCX" || mnemonic == "PUSH"){
+        effect.reads = pair_bits(a1);
+    }
+    else if(mnemonic == "DAD"){
+        effect.reads = REG_H | REG_L | pair_bits(a1);
+    }
+    else if(mnemonic == "POP" || mnemonic == "LXI"){
+        effect.writes = pair_bits(a1);
+    }
+    else if(mnemonic == "RLC" || mnemonic == "RRC" || mnemonic == "CMA" || mnemonic == "STA" || mnemonic == "OUT"){
+        effect.reads = REG_A;
+    }
+    else if(mnemonic == "RAL" || mnemonic == "RAR"){
+        effect.reads = REG_A | FLAGS;
+    }
+    else if(mnemonic == "CMC"){
+        effect.reads = FLAGS;
+    }
+    else if(mnemonic == "XCHG"){
+        effect.reads = REG_D | REG_E | REG_H | REG_L;
+    }
+    else if(mnemonic == "XTHL" || mnemonic == "SPHL" || mnemonic == "SHLD"){
+        effect.reads = REG_H | REG_L;
+    }
+    else if(mnemonic == "LDA" || mnemonic == "IN"){
+        effect.writes = REG_A;
+    }
+    else if(mnemonic == "STAX"){
+        effect.reads = REG_A | pair_bits(a1);
+    }
+    else if(mnemonic == "LDAX"){
+        effect.reads = pair_bits(a1);
+        effect.writes = REG_A;
+    }
+    else if(mnemonic == "LHLD"){
+        effect.writes = REG_H | REG_L;
+    }
+    else if(mnemonic != "NOP" && mnemonic != "STC" && mnemonic != "EI" && mnemonic != "DI"){
+        //jumps, calls, returns, RST and HLT
+        effect.ends = true;
+    }
+    return effect;
+}
+
+/**
+ * @brief Lexes a source line for a scan, without throwing.
+ * @param lines Source lines.
+ * @param index Line to lex.
+ * @param macros Macro processor of the run.
+ * @param line Receives the lexed line.
+ * @return true if the line lexed; false otherwise.
+ */
+bool lex_ahead(const std::vector<std::string_view>& lines,size_t index,const MacroProcessor& macros,ParsedLine& line){
+    try{
+        line = parse(lines[index],static_cast<uint32_t>(index),&macros);
+        return true;
+    }
+    catch(const AssemblyError&){
+        return false;
+    }
+}
+
+/**
+ * @brief Tells whether any of a set of registers may be read before it is overwritten, from a line onwards.
+ * @param registers Register bits.
+ * @param lines Source lines.
+ * @param from First line to look at.
+ * @param macros Macro processor of the run.
+ * @return false only if every register in the set is overwritten first on the straight line that follows.
+ */
+bool is_live(uint16_t registers,const std::vector<std::string_view>& lines,size_t from,const MacroProcessor& macros){
+    size_t end = from + LOOKAHEAD < lines.size() ? from + LOOKAHEAD : lines.size();
+    ParsedLine line;
+    for(size_t i = from; i < end; i++){
+        if(!lex_ahead(lines,i,macros,line)){
+            return true;
+        }
+        Effect effect = line_effect(line);
+        if(effect.ends || (effect.reads & registers) != 0){
+            return true;
+        }
+        registers &= static_cast<uint16_t>(~effect.writes);
+        if(registers == 0){
+            return false;
+        }
+    }
+    //the end of the source, or of the window: assume the registers are used
+    return true;
+}
+
+/**
+ * @brief Tells whether an operand is the number zero, in any base the assembler reads.
+ * @param text Operand text.
+ * @return true for 0, 00h, 0x0, 0b0, 0000b and the like.
+ */
+bool is_zero(std::string_view text){
+    if(!text.empty() && text[0] == '+'){
+        text.remove_prefix(1);
+    }
+    if(text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X' || text[1] == 'b' || text[1] == 'B')){
+        text.remove_prefix(2);
+    }
+    else if(text.size() > 1 && (text.back() == 'h' || text.back() == 'H' || text.back() == 'b' || text.back() == 'B')){
+        text.remove_suffix(1);
+    }
+    return !text.empty() && text.find_first_not_of('0') == std::string_view::npos;
+}
+
+}
+
+void remove_instruction(ParsedLine& line,OptimizationStats& stats){
+    stats.rewrites++;
+    stats.bytes += line.instruction->size;
+    stats.cycles += line.instruction->cycles;
+    //the opcode stays as text, which makes the line take no bytes without a "no opcode" warning
+    line = ParsedLine(line.label,line.opcode,{},{},nullptr,line.lineNumber);
+}
+
+uint32_t optimize_line(ParsedLine& line,const std::vector<std::string_view>& lines,const MacroProcessor& macros,OptimizationStats& stats){
+    std::string_view mnemonic = line.instruction->mnemonic;
+    size_t next = line.lineNumber + 1;
+    if(mnemonic == "MOV" || mnemonic == "MVI"){
+        //a memory operand may be memory-mapped I/O, so those lines always stay
+        const int memory = static_cast<int>(Reg::M);
+        int target = lookup_reg(line.argument1);
+        if(target < 0 || target == memory){
+            return NO_LINE;
+        }
+        if(mnemonic == "MOV"){
+            int source = lookup_reg(line.argument2);
+            if(source < 0 || source == memory){
+                return NO_LINE;
+            }
+            if(source == target){
+                remove_instruction(line,stats);
+                return NO_LINE;
+            }
+        }
+        if(!is_live(register_bits(line.argument1),lines,next,macros)){
+            remove_instruction(line,stats);
+        }
+        else if(mnemonic == "MVI" && target == static_cast<int>(Reg::A) && is_zero(line.argument2) && !is_live(FLAGS,lines,next,macros)){
+            static constexpr const Instruction* XRA = lookup_instruction("XRA");
+            stats.rewrites++;
+            stats.bytes += line.instruction->size - XRA->size;
+            stats.cycles += line.instruction->cycles - XRA->cycles;
+            line = ParsedLine(line.label,XRA->mnemonic,"A",{},XRA,line.lineNumber);
+        }
+        return NO_LINE;
+    }
+    if(mnemonic == "JMP"){
+        //only labels, blank lines and comments may come between the JMP and its target, which may label code or data
+        ParsedLine ahead;
+        for(size_t i = next; i < lines.size() && lex_ahead(lines,i,macros,ahead); i++){
+            //EQU, ORG and MACRO labels name something other than the address the JMP falls through to
+            bool labelsAddress = ahead.directive == Directive::None || ahead.directive == Directive::Db ||
+                                 ahead.directive == Directive::Dw || ahead.directive == Directive::Ds ||
+                                 ahead.directive == Directive::MacroCall;
+            if(labelsAddress && !ahead.label.empty() && ahead.label == line.argument1){
+                remove_instruction(line,stats);
+                break;
+            }
+            if(ahead.instruction != nullptr || ahead.directive != Directive::None || !ahead.opcode.empty()){
+                break;
+            }
+        }
+        return NO_LINE;
+    }
+    if(mnemonic == "PUSH"){
+        //a label between them is a way in that would reach the POP alone
+        ParsedLine ahead;
+        for(size_t i = next; i < lines.size() && lex_ahead(lines,i,macros,ahead) && ahead.label.empty(); i++){
+            if(ahead.instruction == nullptr && ahead.directive == Directive::None && ahead.opcode.empty()){
+                continue;
+            }
+            if(ahead.instruction != nullptr && ahead.instruction->mnemonic == "POP" && ahead.argument1 == line.argument1 &&
+               pair_bits(line.argument1) != 0){
+                remove_instruction(line,stats);
+                return static_cast<uint32_t>(i);
+            }
+            break;
+        }
+    }
+    return NO_LINE;
+}
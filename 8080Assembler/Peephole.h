@@ -0,0 +1,42 @@
+#ifndef PEEPHOLE_H_INCLUDED
+#define PEEPHOLE_H_INCLUDED
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "i8080Assembler.h"
+
+class MacroProcessor;
+
+//returned by optimize_line when no later line has to be removed
+inline constexpr uint32_t NO_LINE = 0xFFFFFFFF;
+
+/**
+ * @brief The -O peephole pass for one source line, run between lexing and encoding so every line after it is placed
+ *        at its new address and labels follow the code as it shrinks. It rewrites:
+ *          MOV r,r                          removed
+ *          MOV r,s / MVI r,n, r dead        removed (never when the source or destination is M)
+ *          MVI A,0, flags dead              XRA A
+ *          JMP to the next line             removed
+ *          PUSH rp directly followed by POP rp (no label between)   both removed
+ *        Liveness is found by lexing the source lines that follow until the registers in question are overwritten
+ *        or read. Any jump, call, return, directive, macro call or line that does not lex ends the scan with
+ *        everything assumed live, so only straight-line code is rewritten. Code reached through computed offsets
+ *        (a jump table of JMPs, say) must not be assembled with -O.
+ * @param line Lexed instruction line about to be assembled; rewritten in place (a removed instruction keeps its label).
+ * @param lines Source lines.
+ * @param macros Macro processor of the run, so the scan recognizes macro calls.
+ * @param stats Receives what was saved.
+ * @return A later line whose instruction goes too (the POP of a cancelled pair), or NO_LINE.
+ */
+uint32_t optimize_line(ParsedLine& line,const std::vector<std::string_view>& lines,const MacroProcessor& macros,OptimizationStats& stats);
+
+/**
+ * @brief Drops the instruction of a line, keeping its label. The line then takes no bytes and raises no warning.
+ * @param line Lexed instruction line.
+ * @param stats Receives its bytes and cycles.
+ * @return None.
+ */
+void remove_instruction(ParsedLine& line,OptimizationStats& stats);
+
+#endif // PEEPHOLE_H_INCLUDED
@@ -0,0 +1,120 @@
+#include "SelfCheck.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "i8080Assembler.h"
+#include "ObjectFile.h"
+#include "OutputCache.h"
+
+namespace {
+
+/**
+ * @brief Prints a check that failed.
+ * @param ok Outcome of the check.
+ * @param what What was checked.
+ * @param failed Failure count, incremented when ok is false.
+ * @return None.
+ */
+void check(bool ok,const char* what,int& failed){
+    if(!ok){
+        std::cout << "self-check failed: " << what << std::endl;
+        failed++;
+    }
+}
+
+bool same_module(const ObjectModule& a,const ObjectModule& b){
+    if(a.bytes != b.bytes || a.imports != b.imports || a.sections.size() != b.sections.size() ||
+       a.exports.size() != b.exports.size() || a.relocations.size() != b.relocations.size()){
+        return false;
+    }
+    for(size_t i = 0; i < a.sections.size(); i++){
+        if(a.sections[i].origin != b.sections[i].origin || a.sections[i].offset != b.sections[i].offset ||
+           a.sections[i].size != b.sections[i].size){
+            return false;
+        }
+    }
+    for(size_t i = 0; i < a.exports.size(); i++){
+        if(a.exports[i].name != b.exports[i].name || a.exports[i].value != b.exports[i].value ||
+           a.exports[i].relocatable != b.exports[i].relocatable){
+            return false;
+        }
+    }
+    for(size_t i = 0; i < a.relocations.size(); i++){
+        if(a.relocations[i].offset != b.relocations[i].offset || a.relocations[i].import != b.relocations[i].import){
+            return false;
+        }
+    }
+    return true;
+}
+
+void check_object_round_trip(int& failed){
+    ObjectModule module;
+    module.sections = {{0,0,4},{0x100,4,3}};
+    module.bytes = {0x21,0x03,0x00,0x76,0xC3,0x00,0x00};
+    module.exports = {{"start",0,true},{"N",5,false}};
+    module.imports = {"ext"};
+    module.relocations = {{1,LOCAL_RELOCATION},{5,0}};
+    std::string data = render_object(module);
+    ObjectModule read;
+    check(read_object(data,read) && same_module(module,read),"an object file reads back as the module written",failed);
+    data.pop_back();
+    check(!read_object(data,read),"a truncated object file is rejected",failed);
+}
+
+void check_relocatable_words(int& failed){
+    AssembledFile workingFile(split_lines(" EXTRN ext\nN EQU 5\nstart: LXI H,tbl\n CALL ext\n LXI D,N\ntbl: DB 1\n"
+                                          "ALIAS EQU tbl\n LXI B,ALIAS\n"));
+    workingFile.relocatable = true;
+    try{
+        assemble(workingFile);
+    }
+    catch(const AssemblyError&){
+        check(false,"a relocatable source assembles",failed);
+        return;
+    }
+    std::vector<std::pair<uint32_t,std::string_view>> words;
+    for(const Relocation& relocation : workingFile.relocations){
+        words.emplace_back(relocation.offset,relocation.name);
+    }
+    std::vector<std::pair<uint32_t,std::string_view>> expected = {{1,"tbl"},{4,"ext"},{7,"N"},{11,"ALIAS"}};
+    check(words == expected,"every word naming a symbol is recorded for the linker",failed);
+    const std::vector<std::string_view>& constants = workingFile.constants;
+    check(std::find(constants.begin(),constants.end(),"N") != constants.end() &&
+          std::find(constants.begin(),constants.end(),"ALIAS") == constants.end(),
+          "an EQU of a number stays put and an EQU of a label moves",failed);
+}
+
+void check_cache_keys(int& failed){
+    std::string key = OutputCache::key(" MVI A,1\n HLT\n",OutputFormat::Binary,"");
+    check(key == OutputCache::key(" MVI A,1\r\n HLT\r\n",OutputFormat::Binary,""),"CRLF and LF sources share a cache key",failed);
+    check(key != OutputCache::key(" MVI A,2\n HLT\n",OutputFormat::Binary,""),"the cache key follows the source",failed);
+    check(key != OutputCache::key(" MVI A,1\n HLT\n",OutputFormat::IntelHex,""),"the cache key follows the format",failed);
+    check(key != OutputCache::key(" MVI A,1\n HLT\n",OutputFormat::Binary,"X=1\n"),"the cache key follows the options",failed);
+}
+
+void check_macro_locals(int& failed){
+    AssemblyResult result = assemble("SKIP MACRO\n LOCAL next\n JMP next\nnext: NOP\n ENDM\n SKIP\n SKIP\n");
+    const std::vector<uint8_t> expected = {0xC3,0x03,0x00,0x00,0xC3,0x07,0x00,0x00};
+    check(result.ok() && result.bytes == expected,"each expansion jumps to its own LOCAL label",failed);
+    check(result.symbols.size() == 2 && result.symbols[0].name != result.symbols[1].name,
+          "LOCAL labels get a new name in every expansion",failed);
+}
+
+}
+
+int run_self_checks(){
+    int failed = 0;
+    check_object_round_trip(failed);
+    check_relocatable_words(failed);
+    check_cache_keys(failed);
+    check_macro_locals(failed);
+    if(failed == 0){
+        std::cout << "self-check passed" << std::endl;
+    }
+    return failed;
+}
@@ -0,0 +1,14 @@
+#ifndef SELFCHECK_H_INCLUDED
+#define SELFCHECK_H_INCLUDED
+
+/**
+ * @brief Runs the checks that need no test framework (--self-check): an object module survives render_object and
+ *        read_object, relocatable assembly records the words the linker must move, cache keys change with everything
+ *        that changes the output but not with line endings, and macro LOCAL names are renamed apart in every
+ *        expansion. The compile-time assembler is checked at build time instead (see ConstexprAssembler.cpp).
+ * @param None.
+ * @return Number of checks that failed, each printed as it fails.
+ */
+int run_self_checks();
+
+#endif // SELFCHECK_H_INCLUDED
@@ -0,0 +1,91 @@
+#include "SourceMap.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char MAP_MAGIC[4] = {'I', '8', '0', 'M'};
+const uint16_t MAP_VERSION = 1;
+//address, length, line
+const size_t ENTRY_SIZE = 8;
+
+uint32_t get_le(const char* data, int bytes){
+    uint32_t value = 0;
+    for(int i = bytes - 1; i >= 0; i--){
+        value = value << 8 | static_cast<uint8_t>(data[i]);
+    }
+    return value;
+}
+
+void put_le(char*& out, uint32_t value, int bytes){
+    for(int i = 0; i < bytes; i++){
+        *out++ = static_cast<char>(value >> (8 * i));
+    }
+}
+
+bool by_address(const SourceMapEntry& a, const SourceMapEntry& b){
+    return a.address < b.address;
+}
+
+}
+
+std::vector<SourceMapEntry> build_source_map(const std::vector<ListingEntry>& entries){
+    std::vector<SourceMapEntry> map;
+    for(size_t i = 0; i < entries.size(); i++){
+        if(entries[i].size != 0){
+            map.push_back({entries[i].address, entries[i].size, static_cast<uint32_t>(i)});
+        }
+    }
+    //source order is address order unless an ORG goes back down
+    if(!std::is_sorted(map.begin(), map.end(), by_address)){
+        std::stable_sort(map.begin(), map.end(), by_address);
+    }
+    return map;
+}
+
+const SourceMapEntry* find_source_line(const std::vector<SourceMapEntry>& map, uint16_t address){
+    auto next = std::upper_bound(map.begin(), map.end(), address,
+                                 [](uint16_t value, const SourceMapEntry& entry){ return value < entry.address; });
+    if(next == map.begin()){
+        return nullptr;
+    }
+    const SourceMapEntry& entry = *(next - 1);
+    return address - entry.address < entry.length ? &entry : nullptr;
+}
+
+std::string render_source_map(const std::vector<SourceMapEntry>& map){
+    std::string data(sizeof(MAP_MAGIC) + 6 + map.size() * ENTRY_SIZE, '\0');
+    char* out = data.data();
+    std::memcpy(out, MAP_MAGIC, sizeof(MAP_MAGIC));
+    out += sizeof(MAP_MAGIC);
+    put_le(out, MAP_VERSION, 2);
+    put_le(out, static_cast<uint32_t>(map.size()), 4);
+    for(const SourceMapEntry& entry : map){
+        put_le(out, entry.address, 2);
+        put_le(out, entry.length, 2);
+        put_le(out, entry.line, 4);
+    }
+    return data;
+}
+
+bool read_source_map(std::string_view data, std::vector<SourceMapEntry>& map){
+    map.clear();
+    if(data.size() < sizeof(MAP_MAGIC) + 6 || std::memcmp(data.data(), MAP_MAGIC, sizeof(MAP_MAGIC)) != 0 ||
+       get_le(data.data() + 4, 2) != MAP_VERSION){
+        return false;
+    }
+    uint32_t count = get_le(data.data() + 6, 4);
+    data.remove_prefix(sizeof(MAP_MAGIC) + 6);
+    if(data.size() != count * uint64_t(ENTRY_SIZE)){
+        return false;
+    }
+    map.resize(count);
+    for(SourceMapEntry& entry : map){
+        entry.address = static_cast<uint16_t>(get_le(data.data(), 2));
+        entry.length = static_cast<uint16_t>(get_le(data.data() + 2, 2));
+        entry.line = get_le(data.data() + 4, 4);
+        data.remove_prefix(ENTRY_SIZE);
+    }
+    return std::is_sorted(map.begin(), map.end(), by_address);
+}
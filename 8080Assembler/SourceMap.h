@@ -0,0 +1,51 @@
+#ifndef SOURCEMAP_H_INCLUDED
+#define SOURCEMAP_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "OutputWriters.h"
+
+//The source line that produced a run of the image
+struct SourceMapEntry {
+    uint16_t address = 0;
+    //bytes the line produced (a macro call or REPT covers its whole expansion)
+    uint16_t length = 0;
+    //zero-based source line
+    uint32_t line = 0;
+};
+
+/**
+ * @brief Builds the source map from the per-line records the listing is rendered from: every line that produced
+ *        bytes, sorted by address. Lines that produce nothing (labels, comments, ORG, EQU...) are left out.
+ * @param entries One listing entry per source line, in source order.
+ * @return Entries sorted by address, never overlapping.
+ */
+std::vector<SourceMapEntry> build_source_map(const std::vector<ListingEntry>& entries);
+
+/**
+ * @brief Finds the line that produced the byte at an address with a binary search.
+ * @param map Source map sorted by address.
+ * @param address Address to look up.
+ * @return The entry whose bytes cover address, or nullptr if no line produced it.
+ */
+const SourceMapEntry* find_source_line(const std::vector<SourceMapEntry>& map, uint16_t address);
+
+/**
+ * @brief Serializes a source map: "I80M", a u16 version, a u32 count, then per entry u16 address, u16 length and
+ *        u32 zero-based line, all little-endian, in address order.
+ * @param map Source map sorted by address.
+ * @return The file contents.
+ */
+std::string render_source_map(const std::vector<SourceMapEntry>& map);
+
+/**
+ * @brief Parses a file written by render_source_map.
+ * @param data File contents.
+ * @param map Receives the entries.
+ * @return true if data is a well-formed source map sorted by address; false otherwise.
+ */
+bool read_source_map(std::string_view data, std::vector<SourceMapEntry>& map);
+
+#endif // SOURCEMAP_H_INCLUDED
@@ -0,0 +1,55 @@
+#include "Stats.h"
+
+#include <cstdio>
+
+namespace {
+
+/**
+ * @brief Formats nanoseconds as milliseconds with three decimals.
+ * @param nanoseconds Time.
+ * @return The text, e.g. "12.345 ms".
+ */
+std::string milliseconds(uint64_t nanoseconds){
+    char text[32];
+    std::snprintf(text,sizeof(text),"%.3f ms",nanoseconds / 1e6);
+    return text;
+}
+
+}
+
+HashTableStats hash_table_stats(const std::unordered_map<std::string_view,uint16_t>& table){
+    HashTableStats stats;
+    stats.size = table.size();
+    stats.buckets = table.bucket_count();
+    stats.loadFactor = table.load_factor();
+    uint64_t probes = 0;
+    for(size_t bucket = 0; bucket < stats.buckets; bucket++){
+        size_t chain = table.bucket_size(bucket);
+        if(chain == 0){
+            stats.emptyBuckets++;
+        }
+        if(chain > stats.longestChain){
+            stats.longestChain = chain;
+        }
+        //the k-th key of a chain is found after k compares
+        probes += chain * (chain + 1) / 2;
+    }
+    stats.probesPerHit = stats.size != 0 ? static_cast<double>(probes) / stats.size : 0;
+    return stats;
+}
+
+std::string render_stats(const AssembledFile& workingFile,const AssemblyCounters& counters,const RunStats& run){
+    std::string text;
+    text += "stats: load "+milliseconds(run.loadNanoseconds)+", pass 1 "+milliseconds(workingFile.passNanoseconds[0])+
+            ", pass 2 "+milliseconds(workingFile.passNanoseconds[1])+", emit "+milliseconds(run.emitNanoseconds)+"\n";
+    text += "stats: heap "+std::to_string(run.allocations)+" allocations, "+std::to_string(run.allocatedBytes)+" bytes\n";
+    HashTableStats symbols = hash_table_stats(workingFile.symbolTable);
+    char line[160];
+    std::snprintf(line,sizeof(line),"stats: symbols %zu in %zu buckets (load factor %.2f), %zu empty, longest chain %zu, %.2f compares per hit\n",
+                  symbols.size,symbols.buckets,symbols.loadFactor,symbols.emptyBuckets,symbols.longestChain,symbols.probesPerHit);
+    text += line;
+    text += "stats: operands "+std::to_string(counters.symbolLookups.load())+" symbol lookups ("+
+            std::to_string(counters.symbolMisses.load())+" missed), "+std::to_string(counters.literalScans.load())+
+            " literal scans, "+std::to_string(counters.byteChecks.load())+" byte checks\n";
+    return text;
+}
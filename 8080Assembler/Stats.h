@@ -0,0 +1,50 @@
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "i8080Assembler.h"
+
+//What --stats measures around assemble(): the phases the program runs itself and the heap
+struct RunStats{
+    //mapping the source and splitting it into lines
+    uint64_t loadNanoseconds = 0;
+    //rendering and writing the output
+    uint64_t emitNanoseconds = 0;
+    //operator new calls and the bytes they asked for, from the load to the end of the emit
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+};
+
+//How a chained hash table spreads its keys
+struct HashTableStats{
+    size_t size = 0;
+    size_t buckets = 0;
+    size_t emptyBuckets = 0;
+    size_t longestChain = 0;
+    double loadFactor = 0;
+    //keys compared, on average, to find a key that is in the table
+    double probesPerHit = 0;
+};
+
+/**
+ * @brief Walks the buckets of the symbol table.
+ * @param table Symbol table.
+ * @return Its size, buckets and chains.
+ */
+HashTableStats hash_table_stats(const std::unordered_map<std::string_view,uint16_t>& table);
+
+/**
+ * @brief Renders the --stats report: wall time of load, pass 1, pass 2 and emit, heap allocations, the symbol
+ *        table's buckets and the operand counters.
+ * @param workingFile Assembled file context after assemble().
+ * @param counters Counters assemble() bumped.
+ * @param run Phases and heap measured around assemble().
+ * @return The report, one "stats:" line per topic.
+ */
+std::string render_stats(const AssembledFile& workingFile,const AssemblyCounters& counters,const RunStats& run);
+
+#endif // STATS_H_INCLUDED
@@ -0,0 +1,105 @@
+#include "ThreadPool.h"
+
+namespace {
+
+//index of the worker running on this thread, or -1 on threads outside any pool
+thread_local int currentWorker = -1;
+thread_local const ThreadPool* currentPool = nullptr;
+
+}
+
+ThreadPool::ThreadPool(unsigned threadCount){
+    if(threadCount == 0){
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if(threadCount == 0){
+        threadCount = 1;
+    }
+    for(unsigned i = 0; i < threadCount; i++){
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for(unsigned i = 0; i < threadCount; i++){
+        threads.emplace_back([this, i]{ run(i); });
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task){
+    unsigned target;
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        pending++;
+        //counted before the push so it can never be taken before it is counted,
+        //and under stateLock so a worker cannot check queued and go to sleep in between
+        queued++;
+        //tasks spawned by a task stay on that worker, where their data is likely still in cache
+        target = currentPool == this ? static_cast<unsigned>(currentWorker) : nextWorker++ % size();
+    }
+    {
+        std::lock_guard<std::mutex> guard(workers[target]->lock);
+        workers[target]->tasks.push_back(std::move(task));
+    }
+    taskAvailable.notify_one();
+}
+
+void ThreadPool::wait(){
+    std::unique_lock<std::mutex> guard(stateLock);
+    allDone.wait(guard, [this]{ return pending == 0; });
+}
+
+bool ThreadPool::take_task(unsigned self, std::function<void()>& task){
+    {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if(!own.tasks.empty()){
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    for(unsigned offset = 1; offset < size(); offset++){
+        Worker& victim = *workers[(self + offset) % size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if(!victim.tasks.empty()){
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(unsigned self){
+    currentWorker = static_cast<int>(self);
+    currentPool = this;
+    std::function<void()> task;
+    while(true){
+        if(take_task(self, task)){
+            task();
+            task = nullptr;
+            std::lock_guard<std::mutex> guard(stateLock);
+            if(--pending == 0){
+                allDone.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(stateLock);
+        taskAvailable.wait(guard, [this]{ return stopping || queued > 0; });
+        if(stopping && queued == 0){
+            return;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef THREADPOOL_H_INCLUDED
+#define THREADPOOL_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed-size work-stealing thread pool.
+ *        Every worker owns a deque. Tasks submitted from a worker go to the back of its own deque and
+ *        are taken LIFO; tasks submitted from outside are dealt round-robin. An idle worker steals from
+ *        the front of the other deques, so uneven task sizes still keep every core busy.
+ *        Tasks must not throw.
+ */
+class ThreadPool{
+public:
+    /**
+     * @brief Starts the worker threads.
+     * @param threadCount Number of workers; 0 uses one per hardware thread.
+     * @return None (constructor).
+     */
+    explicit ThreadPool(unsigned threadCount = 0);
+
+    /**
+     * @brief Waits for all queued tasks, then stops and joins the workers.
+     * @param None.
+     * @return None (destructor).
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Queues a task.
+     * @param task Work to run on some worker.
+     * @return None.
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * @brief Blocks until every submitted task (including tasks they submitted) has finished.
+     *        Must not be called from inside a task.
+     * @param None.
+     * @return None.
+     */
+    void wait();
+
+    //workers is complete before the first thread starts; threads is still growing while they run
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    /**
+     * @brief Runs body(i) for every i in [0, count) across the pool and waits for all of them.
+     * @param count Number of iterations.
+     * @param body Callable taking the iteration index.
+     * @return None.
+     */
+    template <typename Body>
+    void parallel_for(size_t count, const Body& body){
+        for(size_t i = 0; i < count; i++){
+            submit([&body, i]{ body(i); });
+        }
+        wait();
+    }
+
+private:
+    struct Worker{
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    /**
+     * @brief Takes a task from worker self's own deque, or steals one from another worker.
+     * @param self Index of the calling worker.
+     * @param task Receives the task.
+     * @return true if a task was taken; false if every deque was empty.
+     */
+    bool take_task(unsigned self, std::function<void()>& task);
+
+    /**
+     * @brief Worker thread body: runs tasks until the pool stops.
+     * @param self Index of this worker.
+     * @return None.
+     */
+    void run(unsigned self);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    //tasks sitting in some deque
+    std::atomic<size_t> queued{0};
+    //tasks queued or running, guarded by stateLock
+    size_t pending = 0;
+    unsigned nextWorker = 0;
+    bool stopping = false;
+    std::mutex stateLock;
+    std::condition_variable taskAvailable;
+    std::condition_variable allDone;
+};
+
+#endif // THREADPOOL_H_INCLUDED
@@ -0,0 +1,272 @@
+#include "Timing.h"
+
+#include <cstdio>
+
+namespace {
+
+constexpr const Instruction* JNZ = lookup_instruction("JNZ");
+constexpr const Instruction* DCR = lookup_instruction("DCR");
+constexpr const Instruction* MVI = lookup_instruction("MVI");
+
+//returned by counted_loop for a JNZ that closes no counted loop
+const size_t NO_LOOP = static_cast<size_t>(-1);
+
+//Width of a report row before the source text: "AAAA  CCCCCCC  "
+const size_t TIMING_PREFIX = 15;
+
+/**
+ * @brief Gives the instruction an opcode byte decodes to.
+ * @param opcode Opcode byte.
+ * @return Its table entry, or nullptr for an undocumented opcode.
+ */
+const Instruction* decode(uint8_t opcode){
+    uint8_t index = i8080Opcodes.opcodes[opcode].instruction;
+    return index == NO_INSTRUCTION ? nullptr : &i8080Instructions[index];
+}
+
+/**
+ * @brief Tells whether a line holds code to time: an instruction, or an expansion that produced bytes.
+ * @param line Assembled line.
+ * @return true for code; false for data, directives and lines that produce nothing.
+ */
+bool is_code(const ParsedLine& line){
+    if(line.instructionSize == 0){
+        return false;
+    }
+    return line.instruction != nullptr || line.directive == Directive::MacroCall || line.directive == Directive::Rept ||
+           line.directive == Directive::Endm || line.directive == Directive::Include;
+}
+
+/**
+ * @brief Tells whether a line starts a block: it defines a label (not an EQU or MACRO name).
+ * @param line Assembled line.
+ * @return true if the line has a code label.
+ */
+bool starts_block(const ParsedLine& line){
+    return !line.label.empty() && line.directive != Directive::Equ && line.directive != Directive::Macro;
+}
+
+/**
+ * @brief Tells whether an instruction may change a register, as a loop counter would see it. A call or RST may do
+ *        anything.
+ * @param insn Decoded instruction.
+ * @param opcode Its opcode byte.
+ * @param reg Register code (Reg order).
+ * @return true if reg may hold another value afterwards.
+ */
+bool may_change(const Instruction& insn, uint8_t opcode, int reg){
+    std::string_view mnemonic = insn.mnemonic;
+    const int destination = opcode >> 3 & 7;
+    const int pair = opcode >> 4 & 3;
+    const int A = static_cast<int>(Reg::A);
+    if(mnemonic == "MOV" || mnemonic == "MVI" || mnemonic == "INR" || mnemonic == "DCR"){
+        return destination == reg;
+    }
+    if(mnemonic == "LXI" || mnemonic == "INX" || mnemonic == "DCX" || mnemonic == "POP"){
+        if(pair == 3){
+            return mnemonic == "POP" && reg == A;
+        }
+        return reg == pair * 2 || reg == pair * 2 + 1;
+    }
+    if(mnemonic == "DAD" || mnemonic == "LHLD" || mnemonic == "XTHL"){
+        return reg == static_cast<int>(Reg::H) || reg == static_cast<int>(Reg::L);
+    }
+    if(mnemonic == "XCHG"){
+        return reg >= static_cast<int>(Reg::D) && reg <= static_cast<int>(Reg::L);
+    }
+    //CALL and the conditional calls are the three-byte instructions starting with C
+    if(mnemonic == "RST" || (mnemonic[0] == 'C' && insn.size == 3)){
+        return true;
+    }
+    if(reg != A){
+        return false;
+    }
+    //everything else that writes A: the arithmetic and logic group (not the compares), loads, IN and the rotates
+    bool arithmetic = (opcode & 0xC0) == 0x80 || ((opcode & 0xC7) == 0xC6);
+    return (arithmetic && (opcode & 0x38) != 0x38) || mnemonic == "LDA" || mnemonic == "LDAX" || mnemonic == "IN" ||
+           mnemonic == "RLC" || mnemonic == "RRC" || mnemonic == "RAL" || mnemonic == "RAR" || mnemonic == "CMA" ||
+           mnemonic == "DAA";
+}
+
+/**
+ * @brief Finds the bound of the counted loop a JNZ line closes, if it closes one.
+ * @param workingFile Assembled file context.
+ * @param end Index of the JNZ line.
+ * @param iterations Receives the iteration count.
+ * @param worst Receives the loop's worst case in T-states.
+ * @return The line of the loop label, or NO_LOOP.
+ */
+size_t counted_loop(const AssembledFile& workingFile, size_t end, uint32_t& iterations, uint64_t& worst){
+    const std::vector<ParsedLine>& lines = workingFile.parsedLines;
+    const uint8_t* jump = workingFile.output.data() + lines[end].offset;
+    uint16_t target = static_cast<uint16_t>(jump[1] | jump[2] << 8);
+    if(target > lines[end].pc){
+        return NO_LOOP;
+    }
+    //the counter: DCR r right before the JNZ
+    size_t count = end;
+    while(count > 0 && !is_code(lines[--count])){}
+    if(count == end || lines[count].instruction != DCR){
+        return NO_LOOP;
+    }
+    const int counter = workingFile.output[lines[count].offset] >> 3 & 7;
+    if(counter == static_cast<int>(Reg::M)){
+        return NO_LOOP;
+    }
+    //the loop label, at the target address
+    size_t start = count;
+    while(start > 0 && !(starts_block(lines[start]) && lines[start].pc == target)){
+        if(lines[start].pc < target){
+            return NO_LOOP;
+        }
+        start--;
+    }
+    if(!starts_block(lines[start]) || lines[start].pc != target){
+        return NO_LOOP;
+    }
+    //the body must leave the counter alone and hold no loop of its own
+    worst = 0;
+    for(size_t i = start; i <= end; i++){
+        const ParsedLine& line = lines[i];
+        if(!is_code(line)){
+            continue;
+        }
+        const uint8_t* code = workingFile.output.data() + line.offset;
+        for(size_t at = 0; at < line.instructionSize;){
+            const Instruction* insn = decode(code[at]);
+            if(insn == nullptr){
+                at++;
+                continue;
+            }
+            if(i != count && may_change(*insn, code[at], counter)){
+                return NO_LOOP;
+            }
+            if(i != end && insn->mnemonic[0] == 'J' && at + 2 < line.instructionSize){
+                uint16_t inner = static_cast<uint16_t>(code[at + 1] | code[at + 2] << 8);
+                if(inner >= target && inner <= line.pc + at){
+                    return NO_LOOP;
+                }
+            }
+            at += insn->size;
+        }
+        worst += count_cycles(code, line.instructionSize).taken;
+    }
+    //the count: MVI r,n as the last code above the label, with no other way in between
+    size_t setup = start;
+    while(setup > 0){
+        const ParsedLine& line = lines[--setup];
+        if(is_code(line)){
+            break;
+        }
+        if(starts_block(line)){
+            return NO_LOOP;
+        }
+    }
+    const ParsedLine& load = lines[setup];
+    if(setup == start || load.instruction != MVI){
+        return NO_LOOP;
+    }
+    const uint8_t* code = workingFile.output.data() + load.offset;
+    if((code[0] >> 3 & 7) != counter){
+        return NO_LOOP;
+    }
+    iterations = code[1] == 0 ? 256 : code[1];
+    worst *= iterations;
+    return start;
+}
+
+/**
+ * @brief Formats a cycle count as "n", or "n/m" when a condition changes it.
+ * @param count T-states.
+ * @return The text.
+ */
+std::string cycles_text(const CycleCount& count){
+    std::string text = std::to_string(count.cycles);
+    if(count.taken != count.cycles){
+        text += "/" + std::to_string(count.taken);
+    }
+    return text;
+}
+
+/**
+ * @brief Appends the total of a finished block.
+ * @param text Report being built.
+ * @param name Label of the block ("" before the first label).
+ * @param total T-states of the block.
+ * @return None.
+ */
+void put_block(std::string& text, std::string_view name, const CycleCount& total){
+    text.append(TIMING_PREFIX, ' ');
+    text += "; block ";
+    text += name.empty() ? std::string_view("(start)") : name;
+    text += ": " + std::to_string(total.cycles) + " cycles";
+    if(total.taken != total.cycles){
+        text += ", " + std::to_string(total.taken) + " with every condition met";
+    }
+    text += '\n';
+}
+
+}
+
+CycleCount count_cycles(const uint8_t* code, size_t size){
+    CycleCount count;
+    for(size_t at = 0; at < size;){
+        const OpcodeInfo& info = i8080Opcodes.opcodes[code[at]];
+        if(info.instruction == NO_INSTRUCTION){
+            at++;
+            continue;
+        }
+        count.cycles += info.cycles;
+        count.taken += info.cyclesTaken;
+        at += i8080Instructions[info.instruction].size;
+    }
+    return count;
+}
+
+std::string render_timing(const AssembledFile& workingFile){
+    const std::vector<ParsedLine>& lines = workingFile.parsedLines;
+    std::string text;
+    text.reserve(lines.size() * (TIMING_PREFIX + 24));
+    std::string_view block;
+    CycleCount total;
+    bool blockHasCode = false;
+    char row[TIMING_PREFIX + 1];
+    for(size_t i = 0; i < lines.size(); i++){
+        const ParsedLine& line = lines[i];
+        if(starts_block(line)){
+            if(blockHasCode){
+                put_block(text, block, total);
+            }
+            block = line.label;
+            total = {};
+            blockHasCode = false;
+        }
+        std::string cycles;
+        if(is_code(line)){
+            CycleCount count = count_cycles(workingFile.output.data() + line.offset, line.instructionSize);
+            total.cycles += count.cycles;
+            total.taken += count.taken;
+            blockHasCode = true;
+            cycles = cycles_text(count);
+        }
+        std::snprintf(row, sizeof(row), "%04X  %7s  ", line.pc, cycles.c_str());
+        text += row;
+        text += workingFile.lines[i];
+        text += '\n';
+        uint32_t iterations = 0;
+        uint64_t worst = 0;
+        size_t start = NO_LOOP;
+        if(line.instruction == JNZ && is_code(line)){
+            start = counted_loop(workingFile, i, iterations, worst);
+        }
+        if(start != NO_LOOP){
+            text.append(TIMING_PREFIX, ' ');
+            text += "; loop " + std::string(lines[start].label) + ": " + std::to_string(iterations) + " iterations, at most " +
+                    std::to_string(worst) + " cycles\n";
+        }
+    }
+    if(blockHasCode){
+        put_block(text, block, total);
+    }
+    return text;
+}
@@ -0,0 +1,39 @@
+#ifndef TIMING_H_INCLUDED
+#define TIMING_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "i8080Assembler.h"
+
+//T-states of a run of code
+struct CycleCount {
+    //every conditional call and return falls through
+    uint64_t cycles = 0;
+    //every conditional call and return is taken
+    uint64_t taken = 0;
+};
+
+/**
+ * @brief Adds up the T-states of assembled code by decoding it with i8080Opcodes. Undocumented opcodes count as
+ *        one byte and no time.
+ * @param code First opcode byte.
+ * @param size Bytes to decode.
+ * @return The T-states of the run, straight through and with every condition met.
+ */
+CycleCount count_cycles(const uint8_t* code, size_t size);
+
+/**
+ * @brief Renders the --timing report from the lines pass 2 assembled: every line with its address and T-states
+ *        ("11/17" when a condition changes them), then after each block a total. Blocks are delimited by labels.
+ *        A backward JNZ whose loop counts a register down with DCR, from an MVI just above the loop label that
+ *        nothing in the body changes or calls around, also gets a bound: the count (0 meaning 256) times the body's
+ *        worst case. Cycles are static, so called subroutines and the iterations of any other loop are not counted.
+ *        A macro call, REPT or INCLUDE line counts its whole expansion, decoded as code (a DB in it is read as
+ *        instructions).
+ * @param workingFile Assembled file context after assemble().
+ * @return The report text.
+ */
+std::string render_timing(const AssembledFile& workingFile);
+
+#endif // TIMING_H_INCLUDED
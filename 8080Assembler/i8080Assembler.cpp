@@ -0,0 +1,1694 @@
+#include "i8080Assembler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include "MacroProcessor.h"
+#include "MappedFile.h"
+#include "Peephole.h"
+#include "ThreadPool.h"
+
+
+bool AssemblyResult::ok() const{
+    for(const Diagnostic& diagnostic : diagnostics){
+        if(diagnostic.severity == Diagnostic::Severity::Error){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+/**
+*
+*DIAGNOSTICS
+*
+**/
+
+
+
+[[noreturn]] void err(std::string msg,int lineNumber){
+    throw AssemblyError{std::move(msg),lineNumber};
+}
+
+std::string format_error(const AssemblyError& error){
+    return "error on line " + std::to_string(error.lineNumber+1) + ": " + error.message;
+}
+
+std::string format_diagnostic(const Diagnostic& diagnostic){
+    if(diagnostic.severity == Diagnostic::Severity::Warning){
+        return "Warning on line " + std::to_string(diagnostic.lineNumber+1) + ", " + diagnostic.message;
+    }
+    return format_error(AssemblyError{diagnostic.message,diagnostic.lineNumber});
+}
+
+
+
+/**
+*
+*PARSING
+*
+**/
+
+
+
+namespace {
+
+/**
+ * @brief If the parsed line has a label, adds it to the symbol table with the current PC address.
+ *        Errors if the label already exists (duplicate definition).
+ * @param currentLine Parsed line containing an optional label.
+ * @param pc Program counter address to bind to the label.
+ * @param workingFile Assembled file context holding the symbol table.
+ * @return None.
+ */
+void check_and_add_symbol_reference(const ParsedLine& currentLine,uint16_t pc,AssembledFile& workingFile){
+    //if their is no LABEL, then there is no symbol to record, and we can skip this line in pass 1.
+    if(currentLine.label.empty()){
+        return;
+    }
+    //if there is not currently an entry for this label, then this should be symbolTable.end().
+    auto symbolEntry = workingFile.symbolTable.find(currentLine.label);
+    //if the symbol already exists, thats an error and we should stop assembly.
+    if(symbolEntry != workingFile.symbolTable.end()){
+        err("Error, label "+std::string(currentLine.label)+" is already present in symbol table.",currentLine.lineNumber);
+    }
+    workingFile.symbolTable.insert({currentLine.label,pc});
+}
+
+/**
+ * @brief Works out how many bytes a DB/DW list produces: a string gives one byte per character, any other DB
+ *        item one byte and every DW item two.
+ * @param currentLine Lexed DB/DW line (argument1 holds the whole list).
+ * @return Size of the line in bytes.
+ */
+uint16_t data_size(const ParsedLine& currentLine){
+    if(currentLine.argument1.empty()){
+        err("Error, ["+std::string(currentLine.opcode)+"] expects at least one value.",currentLine.lineNumber);
+    }
+    std::string_view list = currentLine.argument1;
+    size_t size = 0;
+    for(size_t start = 0; ; start++){
+        size_t end = find_item_end(list,start);
+        std::string_view item = trim(list.substr(start,end - start));
+        if(item.empty()){
+            err("Error, empty item in ["+std::string(currentLine.opcode)+"] list.",currentLine.lineNumber);
+        }
+        if(item.front() == '\'' || item.front() == '"'){
+            if(!is_string_item(item)){
+                err("Error, unterminated string "+std::string(item)+".",currentLine.lineNumber);
+            }
+            if(currentLine.directive == Directive::Dw){
+                err("Error, DW takes numbers and labels, not strings.",currentLine.lineNumber);
+            }
+            size += item.size() - 2;
+        }
+        else{
+            size += currentLine.directive == Directive::Dw ? 2 : 1;
+        }
+        if(end == list.size()){
+            break;
+        }
+        start = end;
+    }
+    if(size > 0xFFFF){
+        err("Error, ["+std::string(currentLine.opcode)+"] list is longer than 65535 bytes.",currentLine.lineNumber);
+    }
+    return static_cast<uint16_t>(size);
+}
+
+}
+
+ParsedLine parse(std::string_view line,uint32_t lineNumber,const MacroProcessor* macros){
+    LineFields fields = split_line(line);
+    std::string_view a1,a2;
+    //FINDING SIZE
+    //a label-only line has no instruction and a size of 0, otherwise the size depends on the opcode or directive
+    if(!fields.opcode.empty() && fields.instruction == nullptr && fields.directive == Directive::None){
+        if(macros == nullptr || !macros->defines(fields.opcode)){
+            err("Error: opcode not found in size table during pass 1",lineNumber);
+        }
+        fields.directive = Directive::MacroCall;
+    }
+    Directive directive = fields.directive;
+
+    if(directive == Directive::Db || directive == Directive::Dw || directive == Directive::Macro ||
+       directive == Directive::Local || directive == Directive::MacroCall || directive == Directive::Public ||
+       directive == Directive::Extrn || directive == Directive::Include || directive == Directive::Incbin){
+        //a list keeps its commas, the items are split where they are used
+        a1 = trim(fields.rest);
+    } else {
+        split_operands(fields.rest,a1,a2);
+    }
+
+    ParsedLine parsedLine(fields.label,fields.opcode,a1,a2,fields.instruction,lineNumber);
+    parsedLine.directive = directive;
+    if(directive == Directive::Db || directive == Directive::Dw){
+        parsedLine.instructionSize = data_size(parsedLine);
+    }
+    return parsedLine;
+}
+
+Directive block_directive(std::string_view line){
+    line = line.substr(0, find_comment(line));
+    size_t pos = line.find(':');
+    if (pos != std::string_view::npos && !has_quote(line.substr(0, pos))) {
+        line.remove_prefix(pos + 1);
+    }
+    line = ltrim(line);
+    pos = line.find_first_of(" \t");
+    Directive directive = lookup_directive(line.substr(0, pos));
+    if(directive == Directive::Macro || directive == Directive::Rept || directive == Directive::Endm ||
+       directive == Directive::Local){
+        return directive;
+    }
+    //"NAME MACRO params"
+    if(pos != std::string_view::npos){
+        line = ltrim(line.substr(pos));
+        if(lookup_directive(line.substr(0, line.find_first_of(" \t"))) == Directive::Macro){
+            return Directive::Macro;
+        }
+    }
+    return Directive::None;
+}
+
+
+
+/**
+*
+*BUILDING OPCODES
+*
+**/
+
+
+
+void to_little_endian(uint16_t value,uint8_t* out){
+    // Extract the low byte (least significant)
+    // Use AND mask to get only the rightmost 8 bits (0x1234 & 0x00FF -> 0x0034)
+    out[0] = static_cast<uint8_t>(value & 0xFF);
+    // Extract the high byte (most significant)
+    // Shift the 16-bit value right by 8 bits (0x1234 -> 0x0012)
+    out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+namespace {
+
+/**
+ * @brief Encodes one operand into its field of the opcode byte (register, register pair or RST vector).
+ * @param field Field descriptor from the instruction table.
+ * @param argument Operand text filling the field.
+ * @param currentLine Parsed line (used for error reporting).
+ * @return The operand value already shifted into place.
+ */
+uint8_t encode_field(const OperandField& field,std::string_view argument,const ParsedLine& currentLine){
+    int code = field_code(field,argument);
+    //if the argument doesnt fit the field, error out
+    if(code < 0){
+        switch(field.kind){
+            case FieldKind::Register:
+                err("Error, reg code ["+std::string(argument)+"] is not recognized",currentLine.lineNumber);
+            case FieldKind::RegPair:
+                err("Error, rp code ["+std::string(argument)+"] is not recognized",currentLine.lineNumber);
+            default:
+                err("Error, RST expects a number 0 to 7.", currentLine.lineNumber);
+        }
+    }
+    return static_cast<uint8_t>((code & field.mask) << field.shift);
+}
+
+/**
+ * @brief Builds the 8-bit opcode from the instruction's precompiled base opcode and field descriptors,
+ *        consuming the operands that fill register/pair/vector fields.
+ * @param currentLine Parsed line (arguments are cleared as fields consume them).
+ * @return The encoded opcode byte.
+ */
+uint8_t build_opcode(ParsedLine& currentLine){
+    //the mnemonic was resolved while lexing, if it is missing the user input an unrecognized mnemonic and we should exit.
+    if(currentLine.instruction == nullptr){
+        err("Error, ["+std::string(currentLine.opcode)+"] is not a recognized mnemonic.",currentLine.lineNumber);
+    }
+    const Instruction& instruction = *currentLine.instruction;
+    uint8_t opcode = instruction.baseOpcode;
+    if(instruction.arg1.kind != FieldKind::None){
+        //if no a1, error out
+        if(currentLine.argument1.empty()){
+            err("Error, mnemonic ["+std::string(currentLine.opcode)+"] expects an argument.",currentLine.lineNumber);
+        }
+        opcode |= encode_field(instruction.arg1,currentLine.argument1,currentLine);
+        //clear the argument so future steps dont flag this as an argument that should not exist.
+        currentLine.argument1 = {};
+    }
+    if(instruction.arg2.kind != FieldKind::None){
+        //if no a2, error out
+        if(currentLine.argument2.empty()){
+            err("Error, mnemonic ["+std::string(currentLine.opcode)+"] expects a second argument.",currentLine.lineNumber);
+        }
+        opcode |= encode_field(instruction.arg2,currentLine.argument2,currentLine);
+        currentLine.argument2 = {};
+    }
+    return opcode;
+}
+
+/**
+*
+*BUILDING OPERANDS
+*
+**/
+
+
+
+/**
+ * @brief Counts an event for --stats, if the run is counted.
+ * @param workingFile Assembled file context.
+ * @param counter Counter of the event.
+ * @return None.
+ */
+void count_event(const AssembledFile& workingFile,std::atomic<uint64_t> AssemblyCounters::*counter){
+    if(workingFile.counters != nullptr){
+        (workingFile.counters->*counter).fetch_add(1,std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Looks an operand up in the symbol table, counting the lookup.
+ * @param workingFile Assembled file context.
+ * @param name Operand text.
+ * @return The entry, or symbolTable.end().
+ */
+std::unordered_map<std::string_view,uint16_t>::const_iterator find_symbol(const AssembledFile& workingFile,std::string_view name){
+    count_event(workingFile,&AssemblyCounters::symbolLookups);
+    auto symbolLookup = workingFile.symbolTable.find(name);
+    if(symbolLookup == workingFile.symbolTable.end()){
+        count_event(workingFile,&AssemblyCounters::symbolMisses);
+    }
+    return symbolLookup;
+}
+
+/**
+ * @brief Scans an operand as a numeric literal (see scan_literal), counting the scan.
+ * @param workingFile Assembled file context.
+ * @param text Operand text.
+ * @param literal Receives the literal.
+ * @return true if text is a literal; false otherwise.
+ */
+bool scan_operand(const AssembledFile& workingFile,std::string_view text,NumericLiteral& literal){
+    count_event(workingFile,&AssemblyCounters::literalScans);
+    return scan_literal(text,literal);
+}
+
+/**
+ * @brief Builds the operand byte(s) for the current line (immediates or label addresses).
+ *        Resolves labels from the symbol table; otherwise scans a numeric literal. A word operand takes any 16-bit
+ *        value, small ones included; a byte operand takes a value up to 0xFF, and a larger one is written as a word
+ *        for the caller to report as a mismatch. 16-bit operands are written little-endian (low, high).
+ * @param currentLine Parsed line (expects remaining operand in argument1 if present).
+ * @param out Destination for up to 2 operand bytes.
+ * @param workingFile Assembled file context (symbol table + error reporting).
+ * @param forwardReferences If given, an operand that is neither a known label nor a number is added here
+ *        (as a label defined further on) instead of being an error.
+ * @param labelWords If given, a label resolved into a 16-bit address operand is added here, and a defined label
+ *        resolved into a byte operand is added with width 1 (for the caller to reject unless it is a constant).
+ * @return Number of operand bytes written (0, 1, or 2 depending on operand type; 0 for a forward reference).
+ */
+uint8_t build_operand(const ParsedLine& currentLine,uint8_t* out,const AssembledFile& workingFile,std::vector<ForwardReference>* forwardReferences,
+                      std::vector<ForwardReference>* labelWords){
+    //operands are in little endian notation
+    if(currentLine.argument1.empty()){
+        return 0;
+    }
+    //if we find argument1 in our symbol table, then that is the value we want, otherwise it should be a number
+    uint16_t value = 0;
+    auto symbolLookup = find_symbol(workingFile,currentLine.argument1);
+    NumericLiteral literal;
+    if(symbolLookup != workingFile.symbolTable.end()){
+        value = symbolLookup -> second;
+    }
+    else if(scan_operand(workingFile,currentLine.argument1,literal)){
+        value = literal.value;
+    }
+    //neither is a label still to come
+    else if(forwardReferences != nullptr){
+        forwardReferences->push_back({currentLine.argument1,1,static_cast<uint8_t>(currentLine.instructionSize - 1)});
+        if(labelWords != nullptr && currentLine.instructionSize == 3){
+            labelWords->push_back({currentLine.argument1,1,2});
+        }
+        return 0;
+    }
+    else{
+        err("Unrecognized symbol ["+std::string(currentLine.argument1)+"]",currentLine.lineNumber);
+    }
+    if(currentLine.instructionSize == 2){
+        count_event(workingFile,&AssemblyCounters::byteChecks);
+        if(value <= 0xFF){
+            if(labelWords != nullptr && symbolLookup != workingFile.symbolTable.end()){
+                labelWords->push_back({currentLine.argument1,1,1});
+            }
+            out[0] = static_cast<uint8_t>(value);
+            return 1;
+        }
+    }
+    if(labelWords != nullptr && currentLine.instructionSize == 3 && symbolLookup != workingFile.symbolTable.end()){
+        labelWords->push_back({currentLine.argument1,1,2});
+    }
+    to_little_endian(value,out);
+    return 2;
+}
+
+/**
+ * @brief Encodes a DB/DW list: strings byte for byte, numbers and labels as bytes (DB) or little-endian words (DW).
+ * @param currentLine Lexed DB/DW line.
+ * @param out Destination for the line's bytes (instructionSize of them).
+ * @param workingFile Assembled file context (symbol table).
+ * @param forwardReferences If given, labels that are not defined yet are added here instead of being an error.
+ * @param labelWords If given, DW items naming a label are added here, and DB items naming a defined label are added
+ *        with width 1.
+ * @return None.
+ */
+void encode_data(const ParsedLine& currentLine,uint8_t* out,const AssembledFile& workingFile,std::vector<ForwardReference>* forwardReferences,
+                 std::vector<ForwardReference>* labelWords){
+    uint8_t width = currentLine.directive == Directive::Dw ? 2 : 1;
+    std::string_view list = currentLine.argument1;
+    uint32_t at = 0;
+    for(size_t start = 0; ; start++){
+        size_t end = find_item_end(list,start);
+        std::string_view item = trim(list.substr(start,end - start));
+        if(is_string_item(item)){
+            std::memcpy(out + at,item.data() + 1,item.size() - 2);
+            at += static_cast<uint32_t>(item.size() - 2);
+        }
+        else{
+            uint16_t value = 0;
+            bool label = true;
+            auto symbolLookup = find_symbol(workingFile,item);
+            NumericLiteral literal;
+            if(symbolLookup != workingFile.symbolTable.end()){
+                value = symbolLookup -> second;
+            }
+            else if(scan_operand(workingFile,item,literal)){
+                value = literal.value;
+                label = false;
+            }
+            else if(forwardReferences != nullptr){
+                //left zero for the fixup
+                forwardReferences->push_back({item,at,width});
+            }
+            else{
+                err("Unrecognized symbol ["+std::string(item)+"]",currentLine.lineNumber);
+            }
+            if(labelWords != nullptr && label && (width == 2 || symbolLookup != workingFile.symbolTable.end())){
+                labelWords->push_back({item,at,width});
+            }
+            if(width == 1){
+                count_event(workingFile,&AssemblyCounters::byteChecks);
+            }
+            if(width == 1 && value > 0xFF){
+                err("Error, value of ["+std::string(item)+"] does not fit in a byte.",currentLine.lineNumber);
+            }
+            if(width == 1){
+                out[at] = static_cast<uint8_t>(value);
+            }
+            else{
+                to_little_endian(value,out + at);
+            }
+            at += width;
+        }
+        if(end == list.size()){
+            break;
+        }
+        start = end;
+    }
+}
+
+}
+
+
+
+/**
+*
+*CORE LOGIC
+*
+**/
+
+
+
+void encode_line(const ParsedLine& cachedLine,uint8_t* out,const AssembledFile& workingFile,std::vector<ForwardReference>* forwardReferences,
+                 std::vector<ForwardReference>* labelWords){
+    //ORG/DS/EQU produce no bytes; their values are dealt with by the pass that lays out addresses
+    if(cachedLine.directive != Directive::None){
+        if(cachedLine.directive == Directive::Db || cachedLine.directive == Directive::Dw){
+            encode_data(cachedLine,out,workingFile,forwardReferences,labelWords);
+        }
+        return;
+    }
+    //copy so consuming arguments below does not disturb the cached line
+    ParsedLine currentLineInfo = cachedLine;
+    uint8_t opcode = build_opcode(currentLineInfo);
+    //now that we have built the opcode and consumed any arguments that process used, we can count how many operands the user gave the opcode.
+    currentLineInfo.set_operand_count();
+    //check to make sure the user sent the appropriate amount of operands for this opcode
+    //if the size is 1, we should expect no operands left after building the opcode
+    if(currentLineInfo.instructionSize == 1 && currentLineInfo.operandCount != 0){
+        err("Error, mnemonic ["+std::string(currentLineInfo.opcode)+"] expects 0 operands but was passed "+std::to_string(currentLineInfo.operandCount),currentLineInfo.lineNumber);
+    }
+    //if the size is greater than 1, we should expect 1 operand left after building the opcode
+    else if(currentLineInfo.instructionSize > 1 && currentLineInfo.operandCount != 1){
+        err("Error, mnemonic ["+std::string(currentLineInfo.opcode)+"] expects 1 operands but was passed "+std::to_string(currentLineInfo.operandCount),currentLineInfo.lineNumber);
+    }
+    //at this point, we should only have 1 operand that we need to translate. Were going to move it to argument1 if its not there already
+    if(currentLineInfo.argument1.empty()){
+        currentLineInfo.argument1 = currentLineInfo.argument2;
+    }
+    //get the bytes for the operands, straight after the opcode
+    size_t forwardCount = forwardReferences != nullptr ? forwardReferences->size() : 0;
+    uint8_t operandCount = build_operand(currentLineInfo,out+1,workingFile,forwardReferences,labelWords);
+    //a forward reference leaves its bytes zero; the fixup checks the width once the label is known
+    if(forwardReferences != nullptr && forwardReferences->size() != forwardCount){
+        out[0] = opcode;
+        return;
+    }
+    //check for mismatch in operand types (expecting 8 bit or 16 bit)
+    if(currentLineInfo.instructionSize-1 != operandCount){
+        err("Error, mismatch in operand type and opcode ["+std::string(currentLineInfo.opcode)+"] expectation",currentLineInfo.lineNumber);
+    }
+    out[0] = opcode;
+}
+
+namespace {
+
+//Times the passes of one assemble() into AssembledFile::passNanoseconds
+struct PassClock{
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+
+    /**
+     * @brief Records the time since the previous lap (or since the clock was made).
+     * @param nanoseconds Receives the time.
+     * @return None.
+     */
+    void lap(uint64_t& nanoseconds){
+        auto now = std::chrono::steady_clock::now();
+        nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+        last = now;
+    }
+};
+
+//A contiguous range of source lines that one task lexes in pass 1 and encodes in pass 2
+struct LineChunk{
+    size_t begin = 0, end = 0;
+    //bytes produced by the chunk, and where its first byte lands in output once the prefix sum is done
+    uint32_t size = 0;
+    uint32_t base = 0;
+    //lines in the chunk that define a label, in order
+    std::vector<uint32_t> labelLines;
+    //warnings, plus errors when they are being collected, in line order
+    std::vector<Diagnostic> diagnostics;
+    //the first error in the chunk when errors are not collected; lines after it were not processed
+    bool failed = false;
+    AssemblyError error;
+    //the chunk has an ORG, DS, EQU or macro line, whose addresses cannot be laid out chunk by chunk. A macro is defined
+    //before it is called, so a chunk that fails on an unknown macro call comes after one that sets this
+    bool needsSinglePass = false;
+};
+
+/**
+ * @brief Records an error raised on one line of a chunk.
+ * @param workingFile Assembled file context (decides whether errors are collected).
+ * @param chunk Chunk the line belongs to.
+ * @param error The error.
+ * @return true if the chunk should carry on with its next line; false if it must stop.
+ */
+bool chunk_error(const AssembledFile& workingFile,LineChunk& chunk,const AssemblyError& error){
+    if(workingFile.collectErrors){
+        chunk.diagnostics.push_back({Diagnostic::Severity::Error,error.lineNumber,error.message});
+        return true;
+    }
+    chunk.failed = true;
+    chunk.error = error;
+    return false;
+}
+
+/**
+ * @brief Pass 1 for one chunk: lexes its lines into parsedLines and gives each a chunk-relative offset.
+ *        Touches only the chunk's own slots of parsedLines, so chunks can run concurrently.
+ *        A line that fails to lex keeps its text as opcode with no instruction, so pass 2 skips it quietly.
+ * @param workingFile Assembled file context (parsedLines must already be sized to lines).
+ * @param chunk Chunk to lex; receives its size, labelled lines and errors.
+ * @return None.
+ */
+void lex_chunk(AssembledFile& workingFile,LineChunk& chunk){
+    uint32_t offset = 0;
+    for(size_t i = chunk.begin; i < chunk.end; i++){
+        try{
+            workingFile.parsedLines[i] = parse(workingFile.lines[i],static_cast<uint32_t>(i));
+        }
+        catch(const AssemblyError& error){
+            if(!chunk_error(workingFile,chunk,error)){
+                break;
+            }
+            workingFile.parsedLines[i] = ParsedLine({},workingFile.lines[i],{},{},nullptr,static_cast<uint32_t>(i));
+        }
+        ParsedLine& currentLineInfo = workingFile.parsedLines[i];
+        currentLineInfo.offset = offset;
+        if(!currentLineInfo.label.empty()){
+            chunk.labelLines.push_back(static_cast<uint32_t>(i));
+        }
+        if(currentLineInfo.directive != Directive::None && currentLineInfo.directive != Directive::Db &&
+           currentLineInfo.directive != Directive::Dw){
+            chunk.needsSinglePass = true;
+        }
+        offset += currentLineInfo.instructionSize;
+    }
+    chunk.size = offset;
+}
+
+/**
+ * @brief Pass 2 for one chunk: makes its line offsets absolute and encodes every line into output.
+ *        Each line writes only its own bytes, so chunks can run concurrently.
+ * @param workingFile Assembled file context (output must already be sized, symbol table complete).
+ * @param chunk Chunk to encode; receives its warnings and errors.
+ * @return None.
+ */
+void encode_chunk(AssembledFile& workingFile,LineChunk& chunk){
+    for(size_t i = chunk.begin; i < chunk.end; i++){
+        ParsedLine& currentLineInfo = workingFile.parsedLines[i];
+        currentLineInfo.offset += chunk.base;
+        currentLineInfo.pc = static_cast<uint16_t>(currentLineInfo.offset);
+        if(currentLineInfo.instruction == nullptr && currentLineInfo.directive == Directive::None){
+            if(currentLineInfo.opcode.empty()){
+                chunk.diagnostics.push_back({Diagnostic::Severity::Warning,static_cast<int>(i),"no opcode"});
+            }
+            continue;
+        }
+        try{
+            encode_line(currentLineInfo,workingFile.output.data()+currentLineInfo.offset,workingFile);
+        }
+        catch(const AssemblyError& error){
+            if(!chunk_error(workingFile,chunk,error)){
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Runs body on every chunk, on the file's thread pool if it has one.
+ * @param workingFile Assembled file context.
+ * @param chunks Chunks to process.
+ * @param body Callable taking (AssembledFile&, LineChunk&).
+ * @return None.
+ */
+template <typename Body>
+void for_each_chunk(AssembledFile& workingFile,std::vector<LineChunk>& chunks,Body body){
+    if(workingFile.pool == nullptr || chunks.size() == 1){
+        for(LineChunk& chunk : chunks){
+            body(workingFile,chunk);
+        }
+        return;
+    }
+    workingFile.pool->parallel_for(chunks.size(),[&](size_t i){ body(workingFile,chunks[i]); });
+}
+
+/**
+ * @brief Assembles a large file on the thread pool in two passes over line chunks (see assemble()).
+ * @param workingFile Assembled file context with a pool.
+ * @param clock Clock of the run, lapped once pass 1 is done.
+ * @return false if the file uses ORG, DS or EQU and has to go through the single pass instead (nothing is kept);
+ *         true once assembled (throws the first AssemblyError unless errors are collected).
+ */
+bool assemble_chunks(AssembledFile& workingFile,PassClock& clock){
+    size_t lineCount = workingFile.lines.size();
+    //a few chunks per worker so stealing can even out chunks that happen to be slower
+    size_t chunkCount = workingFile.pool->size() * 4;
+    size_t chunkLines = (lineCount + chunkCount - 1) / chunkCount;
+    std::vector<LineChunk> chunks;
+    for(size_t begin = 0; begin < lineCount || chunks.empty(); begin += chunkLines){
+        LineChunk& chunk = chunks.emplace_back();
+        chunk.begin = begin;
+        chunk.end = begin + chunkLines < lineCount ? begin + chunkLines : lineCount;
+    }
+
+    //PASS 1: Lex every line once and link labels
+    workingFile.currentPass = 1;
+    workingFile.parsedLines.clear();
+    workingFile.parsedLines.resize(lineCount);
+    for_each_chunk(workingFile,chunks,lex_chunk);
+    for(const LineChunk& chunk : chunks){
+        if(chunk.needsSinglePass){
+            return false;
+        }
+    }
+    //exclusive prefix sum over the chunk sizes, then merge labels in source order so duplicates are caught where the serial pass would
+    uint32_t base = 0;
+    for(LineChunk& chunk : chunks){
+        chunk.base = base;
+        for(uint32_t line : chunk.labelLines){
+            const ParsedLine& currentLineInfo = workingFile.parsedLines[line];
+            try{
+                check_and_add_symbol_reference(currentLineInfo,static_cast<uint16_t>(base + currentLineInfo.offset),workingFile);
+            }
+            catch(const AssemblyError& error){
+                if(!workingFile.collectErrors){
+                    throw;
+                }
+                //a collected duplicate keeps the first definition
+                workingFile.diagnostics.push_back({Diagnostic::Severity::Error,error.lineNumber,error.message});
+            }
+        }
+        if(chunk.failed){
+            throw chunk.error;
+        }
+        base += chunk.size;
+    }
+
+    clock.lap(workingFile.passNanoseconds[0]);
+    //pass 1 already told us exactly how big the output will be
+    workingFile.currentPass = 2;
+    workingFile.output.assign(base,0);
+    //PASS 2: Build the output file from the cached lines
+    for_each_chunk(workingFile,chunks,encode_chunk);
+    for(LineChunk& chunk : chunks){
+        workingFile.diagnostics.insert(workingFile.diagnostics.end(),chunk.diagnostics.begin(),chunk.diagnostics.end());
+        if(chunk.failed){
+            throw chunk.error;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Reports an error found outside the line being processed (or one that must not stop it): collected as a
+ *        diagnostic when errors are collected, thrown otherwise.
+ * @param workingFile Assembled file context.
+ * @param msg Error message.
+ * @param lineNumber Zero-based line the error belongs to.
+ * @return None.
+ */
+void report_error(AssembledFile& workingFile,std::string msg,int lineNumber){
+    if(!workingFile.collectErrors){
+        err(std::move(msg),lineNumber);
+    }
+    workingFile.diagnostics.push_back({Diagnostic::Severity::Error,lineNumber,std::move(msg)});
+}
+
+/**
+ * @brief Gives a name a view that lasts as long as the assembly.
+ * @param workingFile Assembled file context.
+ * @param name Name as it appears in the current line.
+ * @param copyNames Whether the line text goes away after the line (streaming); then the name is copied into ownedNames.
+ * @return A view safe to keep as a table key.
+ */
+std::string_view keep_name(AssembledFile& workingFile,std::string_view name,bool copyNames){
+    if(!copyNames){
+        return name;
+    }
+    return workingFile.ownedNames.emplace_back(name);
+}
+
+/**
+ * @brief Tells whether a defined name is a constant (-D, or EQU of a number) rather than an address.
+ * @param workingFile Assembled file context (relocatable).
+ * @param name Defined name.
+ * @return true for a constant; false for a label.
+ */
+bool is_constant(const AssembledFile& workingFile,std::string_view name){
+    return std::find(workingFile.constants.begin(),workingFile.constants.end(),name) != workingFile.constants.end();
+}
+
+/**
+ * @brief Binds a line's label to a value and back-patches every fixup that was waiting for it.
+ *        A duplicate keeps the first definition.
+ * @param workingFile Assembled file context.
+ * @param currentLine Line defining the label.
+ * @param value Value of the label: the line's pc, or the constant of an EQU.
+ * @param copyNames Whether the label must be copied (see keep_name).
+ * @return None.
+ */
+void define_label(AssembledFile& workingFile,const ParsedLine& currentLine,uint16_t value,bool copyNames){
+    if(currentLine.label.empty()){
+        return;
+    }
+    if(workingFile.symbolTable.count(currentLine.label) != 0){
+        report_error(workingFile,"Error, label "+std::string(currentLine.label)+" is already present in symbol table.",currentLine.lineNumber);
+        return;
+    }
+    workingFile.symbolTable.insert({keep_name(workingFile,currentLine.label,copyNames),value});
+    auto pending = workingFile.pendingFixups.find(currentLine.label);
+    if(pending == workingFile.pendingFixups.end()){
+        return;
+    }
+    uint32_t next = pending->second;
+    workingFile.pendingFixups.erase(pending);
+    while(next != NO_FIXUP){
+        const Fixup& fixup = workingFile.fixups[next];
+        next = fixup.next;
+        if(fixup.width == 2){
+            to_little_endian(value,workingFile.output.data() + fixup.offset);
+            continue;
+        }
+        if(workingFile.relocatable && !is_constant(workingFile,currentLine.label)){
+            report_error(workingFile,"Error, label ["+std::string(currentLine.label)+"] can only be used as a word in a relocatable object.",
+                         static_cast<int>(fixup.lineNumber));
+            continue;
+        }
+        count_event(workingFile,&AssemblyCounters::byteChecks);
+        if(value <= 0xFF){
+            workingFile.output[fixup.offset] = static_cast<uint8_t>(value);
+        }
+        else if(fixup.instruction != nullptr){
+            report_error(workingFile,"Error, mismatch in operand type and opcode ["+std::string(fixup.instruction->mnemonic)+"] expectation",fixup.lineNumber);
+        }
+        else{
+            report_error(workingFile,"Error, value of ["+std::string(currentLine.label)+"] does not fit in a byte.",fixup.lineNumber);
+        }
+    }
+}
+
+/**
+ * @brief Gives the value of an operand that must be known when its line is met.
+ * @param workingFile Assembled file context.
+ * @param currentLine Line the operand belongs to.
+ * @param operand Number or label defined above the line.
+ * @return The value (throws AssemblyError otherwise).
+ */
+uint16_t known_value(const AssembledFile& workingFile,const ParsedLine& currentLine,std::string_view operand){
+    auto symbolLookup = find_symbol(workingFile,operand);
+    if(symbolLookup != workingFile.symbolTable.end()){
+        return symbolLookup -> second;
+    }
+    NumericLiteral literal;
+    if(!scan_operand(workingFile,operand,literal)){
+        err("Error, ["+std::string(currentLine.opcode)+"] needs a number or a label defined above it, not ["+
+            std::string(operand)+"].",currentLine.lineNumber);
+    }
+    return literal.value;
+}
+
+}
+
+uint16_t resolve_value(const AssembledFile& workingFile,const ParsedLine& currentLine){
+    if(currentLine.argument1.empty() || !currentLine.argument2.empty()){
+        err("Error, ["+std::string(currentLine.opcode)+"] expects 1 operand.",currentLine.lineNumber);
+    }
+    return known_value(workingFile,currentLine,currentLine.argument1);
+}
+
+namespace {
+
+/**
+ * @brief Works out the path of the file an INCLUDE or INCBIN line names.
+ * @param workingFile Assembled file context (its directory anchors relative names).
+ * @param currentLine INCLUDE or INCBIN line.
+ * @param name File name operand, in quotes.
+ * @return The path (throws AssemblyError if the name is not quoted).
+ */
+std::string source_path(const AssembledFile& workingFile,const ParsedLine& currentLine,std::string_view name){
+    if(name.size() < 3 || (name.front() != '"' && name.front() != '\'') || name.back() != name.front()){
+        err("Error, ["+std::string(currentLine.opcode)+"] needs a file name in quotes.",currentLine.lineNumber);
+    }
+    std::filesystem::path path(name.substr(1,name.size() - 2));
+    if(workingFile.directory.empty()){
+        return path.string();
+    }
+    //an absolute name replaces the directory
+    return (std::filesystem::path(workingFile.directory) / path).string();
+}
+
+/**
+ * @brief Assembles an INCBIN line: maps the file and copies the slice straight into output, so a large blob costs
+ *        one copy instead of a DB item per byte.
+ * @param workingFile Assembled file context.
+ * @param currentLine INCBIN line, already placed; receives its size.
+ * @return None (throws AssemblyError if the file cannot be read or the slice is out of range).
+ */
+void include_binary(AssembledFile& workingFile,ParsedLine& currentLine){
+    std::string_view list = currentLine.argument1;
+    std::string_view items[3];
+    size_t count = 0;
+    for(size_t start = 0; ; start++){
+        size_t end = find_item_end(list,start);
+        if(count == 3){
+            err("Error, [INCBIN] expects a file name, an offset and a length.",currentLine.lineNumber);
+        }
+        items[count++] = trim(list.substr(start,end - start));
+        if(end == list.size()){
+            break;
+        }
+        start = end;
+    }
+    std::string path = source_path(workingFile,currentLine,items[0]);
+    MappedFile blob;
+    if(!blob.open(path)){
+        err("Error, ["+path+"] could not be opened.",currentLine.lineNumber);
+    }
+    if(std::find(workingFile.includedFiles.begin(),workingFile.includedFiles.end(),path) == workingFile.includedFiles.end()){
+        workingFile.includedFiles.push_back(path);
+    }
+    size_t offset = count > 1 ? known_value(workingFile,currentLine,items[1]) : 0;
+    if(offset > blob.size()){
+        err("Error, [INCBIN] offset is past the end of ["+path+"] ("+std::to_string(blob.size())+" bytes).",currentLine.lineNumber);
+    }
+    size_t length = count > 2 ? known_value(workingFile,currentLine,items[2]) : blob.size() - offset;
+    if(length > blob.size() - offset){
+        err("Error, [INCBIN] slice is past the end of ["+path+"] ("+std::to_string(blob.size())+" bytes).",currentLine.lineNumber);
+    }
+    if(length > 0xFFFF){
+        err("Error, ["+path+"] is longer than 65535 bytes; give INCBIN an offset and a length.",currentLine.lineNumber);
+    }
+    currentLine.instructionSize = static_cast<uint16_t>(length);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(blob.view().data()) + offset;
+    workingFile.output.insert(workingFile.output.end(),bytes,bytes + length);
+}
+
+/**
+ * @brief Records the names listed by a PUBLIC or EXTRN line.
+ * @param workingFile Assembled file context.
+ * @param currentLine Lexed PUBLIC/EXTRN line (argument1 holds the list).
+ * @param copyNames Whether names must be copied (see keep_name).
+ * @return None (throws AssemblyError on an empty name).
+ */
+void declare_names(AssembledFile& workingFile,const ParsedLine& currentLine,bool copyNames){
+    std::vector<DeclaredName>& names = currentLine.directive == Directive::Public ? workingFile.publicNames : workingFile.externNames;
+    std::string_view list = currentLine.argument1;
+    for(size_t start = 0; ; start++){
+        size_t end = find_item_end(list,start);
+        std::string_view name = trim(list.substr(start,end - start));
+        if(name.empty()){
+            err("Error, ["+std::string(currentLine.opcode)+"] expects a list of names.",currentLine.lineNumber);
+        }
+        names.push_back({keep_name(workingFile,name,copyNames),currentLine.lineNumber});
+        if(end == list.size()){
+            break;
+        }
+        start = end;
+    }
+}
+
+/**
+ * @brief Starts a new segment at origin for the lines that follow. If nothing was assembled since the last one
+ *        started, that one is moved instead.
+ * @param workingFile Assembled file context.
+ * @param origin Address the next byte is loaded at.
+ * @param lineNumber Line of the ORG/DS.
+ * @return None.
+ */
+void start_segment(AssembledFile& workingFile,uint32_t origin,uint32_t lineNumber){
+    uint32_t offset = static_cast<uint32_t>(workingFile.output.size());
+    Segment& last = workingFile.segments.back();
+    if(last.offset == offset){
+        last.origin = origin;
+        last.lineNumber = lineNumber;
+        return;
+    }
+    last.size = offset - last.offset;
+    workingFile.segments.push_back({origin,offset,0,lineNumber});
+}
+
+/**
+ * @brief Gives a line the current output offset and address.
+ * @param workingFile Assembled file context.
+ * @param currentLine Line; receives its offset and pc.
+ * @return The address, before it is truncated to 16 bits.
+ */
+uint32_t place_line(const AssembledFile& workingFile,ParsedLine& currentLine){
+    const Segment& segment = workingFile.segments.back();
+    currentLine.offset = static_cast<uint32_t>(workingFile.output.size());
+    uint32_t address = segment.origin + (currentLine.offset - segment.offset);
+    currentLine.pc = static_cast<uint16_t>(address);
+    return address;
+}
+
+/**
+ * @brief Single pass for one lexed line: assigns its address, defines its label and appends its encoding to output,
+ *        chaining a fixup if it uses a label that is not defined yet.
+ * @param workingFile Assembled file context.
+ * @param currentLine Lexed line; receives its offset and pc.
+ * @param copyNames Whether names must be copied (see keep_name).
+ * @return None (throws AssemblyError on an encoding error unless errors are collected; the line's bytes stay zero).
+ */
+void assemble_line(AssembledFile& workingFile,ParsedLine& currentLine,bool copyNames){
+    uint32_t address = place_line(workingFile,currentLine);
+    switch(currentLine.directive){
+        case Directive::Equ:{
+            if(currentLine.label.empty()){
+                err("Error, EQU needs a name to define.",currentLine.lineNumber);
+            }
+            uint16_t value = resolve_value(workingFile,currentLine);
+            //an EQU naming a label is another name for its address, which moves with the object like the label does
+            if(workingFile.relocatable && (find_symbol(workingFile,currentLine.argument1) == workingFile.symbolTable.end() ||
+                                           is_constant(workingFile,currentLine.argument1))){
+                workingFile.constants.push_back(keep_name(workingFile,currentLine.label,copyNames));
+            }
+            define_label(workingFile,currentLine,value,copyNames);
+            return;
+        }
+        case Directive::Public:
+        case Directive::Extrn:
+            declare_names(workingFile,currentLine,copyNames);
+            define_label(workingFile,currentLine,currentLine.pc,copyNames);
+            return;
+        case Directive::Org:
+            //a label on an ORG line names the new origin
+            currentLine.pc = resolve_value(workingFile,currentLine);
+            start_segment(workingFile,currentLine.pc,currentLine.lineNumber);
+            define_label(workingFile,currentLine,currentLine.pc,copyNames);
+            return;
+        case Directive::Ds:
+            define_label(workingFile,currentLine,currentLine.pc,copyNames);
+            start_segment(workingFile,address + resolve_value(workingFile,currentLine),currentLine.lineNumber);
+            return;
+        case Directive::Incbin:
+            define_label(workingFile,currentLine,currentLine.pc,copyNames);
+            include_binary(workingFile,currentLine);
+            return;
+        case Directive::Include:
+            err("Error, INCLUDE cannot be used in a macro or REPT body.",currentLine.lineNumber);
+        case Directive::Local:
+            err("Error, LOCAL is only allowed in a macro body.",currentLine.lineNumber);
+        case Directive::Endm:
+            err("Error, ENDM without MACRO or REPT.",currentLine.lineNumber);
+        default:
+            break;
+    }
+    define_label(workingFile,currentLine,currentLine.pc,copyNames);
+    if(currentLine.instruction == nullptr && currentLine.directive == Directive::None){
+        if(currentLine.opcode.empty()){
+            workingFile.diagnostics.push_back({Diagnostic::Severity::Warning,static_cast<int>(currentLine.lineNumber),"no opcode"});
+        }
+        return;
+    }
+    workingFile.output.resize(currentLine.offset + currentLine.instructionSize);
+    std::vector<ForwardReference>& forward = workingFile.forwardReferences;
+    forward.clear();
+    std::vector<ForwardReference>* labelWords = nullptr;
+    if(workingFile.relocatable){
+        labelWords = &workingFile.labelWords;
+        labelWords->clear();
+    }
+    encode_line(currentLine,workingFile.output.data() + currentLine.offset,workingFile,&forward,labelWords);
+    if(labelWords != nullptr){
+        for(const ForwardReference& word : *labelWords){
+            //the linker only relocates words: a byte may hold a constant, not an address
+            if(word.width == 1){
+                if(!is_constant(workingFile,word.name)){
+                    report_error(workingFile,"Error, label ["+std::string(word.name)+"] can only be used as a word in a relocatable object.",
+                                 static_cast<int>(currentLine.lineNumber));
+                }
+                continue;
+            }
+            workingFile.relocations.push_back({currentLine.offset + word.at,keep_name(workingFile,word.name,copyNames)});
+        }
+    }
+    for(const ForwardReference& reference : forward){
+        auto pending = workingFile.pendingFixups.find(reference.name);
+        if(pending == workingFile.pendingFixups.end()){
+            pending = workingFile.pendingFixups.insert({keep_name(workingFile,reference.name,copyNames),NO_FIXUP}).first;
+        }
+        Fixup fixup;
+        fixup.offset = currentLine.offset + reference.at;
+        fixup.lineNumber = currentLine.lineNumber;
+        fixup.next = pending->second;
+        fixup.width = reference.width;
+        fixup.instruction = currentLine.instruction;
+        pending->second = static_cast<uint32_t>(workingFile.fixups.size());
+        workingFile.fixups.push_back(fixup);
+    }
+}
+
+//IF blocks open in the single pass
+struct Conditionals{
+    struct Block{
+        //whether the condition held, so the IF branch is assembled and the ELSE branch skipped
+        bool taken = false;
+        bool active = false;
+        bool sawElse = false;
+        uint32_t lineNumber = 0;
+    };
+    //blocks whose IF was met in an active branch
+    std::vector<Block> open;
+    //IF blocks nested inside an inactive branch; they are skipped whole, so only their depth is kept
+    uint32_t skipped = 0;
+
+    bool active() const { return open.empty() || open.back().active; }
+};
+
+/**
+ * @brief Finds the conditional directive of a raw line without lexing it: only the first word (after a label) is
+ *        looked at, and most lines are turned away by their first letter.
+ * @param line Raw source line text.
+ * @return IF, IFDEF, IFNDEF, ELSE or ENDIF; Directive::None for any other line.
+ */
+Directive conditional_keyword(std::string_view line){
+    size_t i = 0;
+    size_t start = 0;
+    for(int word = 0; word < 2; word++){
+        while(i < line.size() && (line[i] == ' ' || line[i] == '\t')){
+            i++;
+        }
+        start = i;
+        while(i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != ';' && line[i] != ':'){
+            i++;
+        }
+        if(i == line.size() || line[i] != ':'){
+            break;
+        }
+        //a label; the keyword follows it
+        i++;
+    }
+    std::string_view keyword = line.substr(start,i - start);
+    char first = static_cast<char>(keyword.empty() ? 0 : keyword[0] | 0x20);
+    if(keyword.size() < 2 || keyword.size() > 6 || (first != 'i' && first != 'e')){
+        return Directive::None;
+    }
+    Directive directive = lookup_directive(keyword);
+    switch(directive){
+        case Directive::If:
+        case Directive::Ifdef:
+        case Directive::Ifndef:
+        case Directive::Else:
+        case Directive::Endif:
+            return directive;
+        default:
+            return Directive::None;
+    }
+}
+
+/**
+ * @brief Tracks IF nesting through a line of an inactive branch, which is never lexed.
+ * @param conditionals Open IF blocks.
+ * @param directive Conditional keyword of the line (see conditional_keyword).
+ * @param lineNumber Zero-based line number.
+ * @return None (throws AssemblyError on a second ELSE).
+ */
+void skip_line(Conditionals& conditionals,Directive directive,uint32_t lineNumber){
+    switch(directive){
+        case Directive::If:
+        case Directive::Ifdef:
+        case Directive::Ifndef:
+            conditionals.skipped++;
+            break;
+        case Directive::Else:
+            if(conditionals.skipped == 0){
+                Conditionals::Block& block = conditionals.open.back();
+                if(block.sawElse){
+                    err("Error, IF block from line "+std::to_string(block.lineNumber + 1)+" already has an ELSE.",lineNumber);
+                }
+                block.sawElse = true;
+                block.active = !block.taken;
+            }
+            break;
+        case Directive::Endif:
+            if(conditionals.skipped > 0){
+                conditionals.skipped--;
+            }
+            else{
+                conditionals.open.pop_back();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Opens, switches or closes an IF block from a lexed line of an active branch.
+ * @param workingFile Assembled file context (the symbol table decides the condition).
+ * @param conditionals Open IF blocks.
+ * @param currentLine Lexed IF, IFDEF, IFNDEF, ELSE or ENDIF line.
+ * @return None (throws AssemblyError on an unknown value or an unmatched ELSE/ENDIF).
+ */
+void conditional_line(const AssembledFile& workingFile,Conditionals& conditionals,const ParsedLine& currentLine){
+    switch(currentLine.directive){
+        case Directive::If:
+        case Directive::Ifdef:
+        case Directive::Ifndef:{
+            //the block opens even if its condition is bad, so its ELSE and ENDIF still match up
+            conditionals.open.push_back({false,false,false,currentLine.lineNumber});
+            bool taken;
+            if(currentLine.directive == Directive::If){
+                taken = resolve_value(workingFile,currentLine) != 0;
+            }
+            else{
+                if(currentLine.argument1.empty() || !currentLine.argument2.empty()){
+                    err("Error, ["+std::string(currentLine.opcode)+"] expects 1 name.",currentLine.lineNumber);
+                }
+                taken = (workingFile.symbolTable.count(currentLine.argument1) != 0) == (currentLine.directive == Directive::Ifdef);
+            }
+            conditionals.open.back().taken = taken;
+            conditionals.open.back().active = taken;
+            break;
+        }
+        case Directive::Else:
+            if(conditionals.open.empty()){
+                err("Error, ELSE without IF.",currentLine.lineNumber);
+            }
+            skip_line(conditionals,Directive::Else,currentLine.lineNumber);
+            break;
+        default:
+            if(conditionals.open.empty()){
+                err("Error, ENDIF without IF.",currentLine.lineNumber);
+            }
+            conditionals.open.pop_back();
+            break;
+    }
+}
+
+/**
+ * @brief Tells whether a lexed line is an IF, IFDEF, IFNDEF, ELSE or ENDIF.
+ * @param currentLine Lexed line.
+ * @return true for a conditional directive; false otherwise.
+ */
+bool is_conditional(const ParsedLine& currentLine){
+    return currentLine.directive >= Directive::If && currentLine.directive <= Directive::Endif;
+}
+
+/**
+ * @brief Assembles one lexed line, recording its error instead of throwing when errors are collected.
+ * @param workingFile Assembled file context.
+ * @param currentLine Lexed line.
+ * @param copyNames Whether names must be copied (see keep_name).
+ * @return None.
+ */
+void try_assemble(AssembledFile& workingFile,ParsedLine& currentLine,bool copyNames){
+    try{
+        assemble_line(workingFile,currentLine,copyNames);
+    }
+    catch(const AssemblyError& error){
+        if(!workingFile.collectErrors){
+            throw;
+        }
+        workingFile.diagnostics.push_back({Diagnostic::Severity::Error,error.lineNumber,error.message});
+    }
+}
+
+/**
+ * @brief Assembles the lines a macro call or REPT block stands for, then sizes the source line to cover their bytes.
+ *        IF blocks inside the expansion are followed as it is assembled (its lines were lexed when it was built).
+ * @param workingFile Assembled file context.
+ * @param conditionals Open IF blocks.
+ * @param owner Source line, already placed; its instructionSize becomes the bytes produced (capped at 0xFFFF).
+ * @param lines Expanded lines.
+ * @param copyNames Whether names must be copied (see keep_name).
+ * @return None.
+ */
+void assemble_expansion(AssembledFile& workingFile,Conditionals& conditionals,ParsedLine& owner,const std::vector<ParsedLine>& lines,bool copyNames){
+    for(const ParsedLine& line : lines){
+        try{
+            if(!conditionals.active()){
+                skip_line(conditionals,is_conditional(line) ? line.directive : Directive::None,line.lineNumber);
+                continue;
+            }
+            if(is_conditional(line)){
+                conditional_line(workingFile,conditionals,line);
+                continue;
+            }
+        }
+        catch(const AssemblyError& error){
+            if(!workingFile.collectErrors){
+                throw;
+            }
+            workingFile.diagnostics.push_back({Diagnostic::Severity::Error,error.lineNumber,error.message});
+            continue;
+        }
+        ParsedLine expanded = line;
+        try_assemble(workingFile,expanded,copyNames);
+    }
+    owner.instructionSize = static_cast<uint16_t>(std::min<size_t>(workingFile.output.size() - owner.offset,0xFFFF));
+}
+
+//A file read by INCLUDE, mapped and split once per run
+struct IncludedFile{
+    MappedFile file;
+    std::vector<std::string_view> lines;
+    //each line as it was first lexed, for later INCLUDEs of the file (empty until then, or if it did not lex)
+    std::vector<std::optional<ParsedLine>> lexed;
+};
+
+//State the single pass carries from one line to the next
+struct SinglePass{
+    explicit SinglePass(AssembledFile& workingFile) : macros(workingFile){}
+
+    MacroProcessor macros;
+    Conditionals conditionals;
+    //included files by path; their lines stay mapped for the whole run
+    std::unordered_map<std::string,IncludedFile> includes;
+    //INCLUDE lines being assembled
+    int includeDepth = 0;
+    //source lines the peephole pass looks ahead in; null unless optimizing
+    const std::vector<std::string_view>* lookahead = nullptr;
+    //a source line whose instruction the peephole pass already decided to remove
+    uint32_t dropLine = NO_LINE;
+    //includes nested deeper than this are taken to be a file including itself
+    static const int MAX_INCLUDE_DEPTH = 16;
+};
+
+void assemble_include(AssembledFile& workingFile,SinglePass& pass,ParsedLine& owner);
+
+/**
+ * @brief Adds the file and line a message comes from, unless a nested INCLUDE already did.
+ * @param message Message of a line of an included file.
+ * @param path Included file.
+ * @param line Zero-based line in the file.
+ * @return None.
+ */
+void locate_message(std::string& message,const std::string& path,size_t line){
+    if(message.find(" (in ") == std::string::npos){
+        message += " (in "+path+" line "+std::to_string(line + 1)+")";
+    }
+}
+
+/**
+ * @brief Lexes and assembles one line in the single pass, dealing with its errors. Lines inside a MACRO or REPT
+ *        block go to the macro processor; a macro call or a closed REPT is assembled from its expansion. Lines in an
+ *        inactive IF branch are not lexed at all: only their first word is checked for IF nesting.
+ * @param workingFile Assembled file context.
+ * @param pass State of the run.
+ * @param text Line text.
+ * @param lineNumber Zero-based line number.
+ * @param copyNames Whether names must be copied (see keep_name).
+ * @param lexed Line of an included file: holds the line as first lexed, which is then used instead of lexing the text
+ *        again (nullptr for a source line).
+ * @return The lexed line with its offset and pc.
+ */
+ParsedLine single_pass_line(AssembledFile& workingFile,SinglePass& pass,std::string_view text,uint32_t lineNumber,bool copyNames,
+                            std::optional<ParsedLine>* lexed){
+    MacroProcessor& macros = pass.macros;
+    Conditionals& conditionals = pass.conditionals;
+    if(!conditionals.active() && !macros.recording()){
+        ParsedLine skippedLine({},text,{},{},nullptr,lineNumber);
+        place_line(workingFile,skippedLine);
+        Directive directive = conditional_keyword(text);
+        if(directive != Directive::None){
+            try{
+                skip_line(conditionals,directive,lineNumber);
+            }
+            catch(const AssemblyError& error){
+                if(!workingFile.collectErrors){
+                    throw;
+                }
+                workingFile.diagnostics.push_back({Diagnostic::Severity::Error,error.lineNumber,error.message});
+            }
+        }
+        return skippedLine;
+    }
+    if(macros.recording()){
+        ParsedLine bodyLine({},text,{},{},nullptr,lineNumber);
+        place_line(workingFile,bodyLine);
+        try{
+            if(macros.record(text,lineNumber,copyNames)){
+                bodyLine.directive = Directive::Endm;
+                assemble_expansion(workingFile,conditionals,bodyLine,macros.close(),copyNames);
+            }
+        }
+        catch(const AssemblyError& error){
+            if(!workingFile.collectErrors){
+                throw;
+            }
+            workingFile.diagnostics.push_back({Diagnostic::Severity::Error,error.lineNumber,error.message});
+        }
+        return bodyLine;
+    }
+    ParsedLine currentLine;
+    try{
+        if(lexed != nullptr && lexed->has_value()){
+            currentLine = **lexed;
+            currentLine.lineNumber = lineNumber;
+        }
+        else{
+            currentLine = parse(text,lineNumber,&macros);
+            if(lexed != nullptr){
+                *lexed = currentLine;
+            }
+        }
+    }
+    catch(const AssemblyError& error){
+        if(!workingFile.collectErrors){
+            throw;
+        }
+        workingFile.diagnostics.push_back({Diagnostic::Severity::Error,error.lineNumber,error.message});
+        //keeping the text as opcode with no instruction makes the line take no bytes and no warning
+        currentLine = ParsedLine({},text,{},{},nullptr,lineNumber);
+    }
+    if(pass.lookahead != nullptr && lexed == nullptr && currentLine.instruction != nullptr){
+        if(lineNumber == pass.dropLine){
+            remove_instruction(currentLine,workingFile.optimization);
+        }
+        else{
+            uint32_t drop = optimize_line(currentLine,*pass.lookahead,macros,workingFile.optimization);
+            if(drop != NO_LINE){
+                pass.dropLine = drop;
+            }
+        }
+    }
+    try{
+        switch(currentLine.directive){
+            case Directive::Macro:
+                place_line(workingFile,currentLine);
+                macros.begin(currentLine,copyNames);
+                break;
+            case Directive::Rept:
+                define_label(workingFile,currentLine,place_line(workingFile,currentLine),copyNames);
+                macros.begin(currentLine,copyNames);
+                break;
+            case Directive::If:
+            case Directive::Ifdef:
+            case Directive::Ifndef:
+            case Directive::Else:
+            case Directive::Endif:
+                define_label(workingFile,currentLine,place_line(workingFile,currentLine),copyNames);
+                conditional_line(workingFile,conditionals,currentLine);
+                break;
+            case Directive::MacroCall:
+                define_label(workingFile,currentLine,place_line(workingFile,currentLine),copyNames);
+                assemble_expansion(workingFile,conditionals,currentLine,macros.expand(currentLine),copyNames);
+                break;
+            case Directive::Include:
+                define_label(workingFile,currentLine,place_line(workingFile,currentLine),copyNames);
+                assemble_include(workingFile,pass,currentLine);
+                break;
+            default:
+                assemble_line(workingFile,currentLine,copyNames);
+                break;
+        }
+    }
+    catch(const AssemblyError& error){
+        if(!workingFile.collectErrors){
+            throw;
+        }
+        workingFile.diagnostics.push_back({Diagnostic::Severity::Error,error.lineNumber,error.message});
+    }
+    return currentLine;
+}
+
+/**
+ * @brief Assembles an INCLUDE line: every line of the file goes through the single pass in its place, numbered as
+ *        the INCLUDE line and copying its names, and their messages name the file and line they come from. A file
+ *        is mapped and split the first time it is included in a run; later INCLUDEs of it reuse its lexed lines.
+ * @param workingFile Assembled file context.
+ * @param pass State of the run.
+ * @param owner INCLUDE line, already placed; its instructionSize becomes the bytes produced (capped at 0xFFFF).
+ * @return None (throws AssemblyError if the file cannot be opened, or on its first error unless errors are collected).
+ */
+void assemble_include(AssembledFile& workingFile,SinglePass& pass,ParsedLine& owner){
+    std::string path = source_path(workingFile,owner,owner.argument1);
+    if(pass.includeDepth >= SinglePass::MAX_INCLUDE_DEPTH){
+        err("Error, INCLUDE is nested too deep (does ["+path+"] include itself?).",owner.lineNumber);
+    }
+    auto found = pass.includes.find(path);
+    if(found == pass.includes.end()){
+        IncludedFile included;
+        if(!included.file.open(path)){
+            err("Error, ["+path+"] could not be opened.",owner.lineNumber);
+        }
+        split_lines(included.file.view(),included.lines);
+        workingFile.includedFiles.push_back(path);
+        included.lexed.resize(included.lines.size());
+        found = pass.includes.emplace(path,std::move(included)).first;
+    }
+    IncludedFile& included = found->second;
+    pass.includeDepth++;
+    for(size_t i = 0; i < included.lines.size(); i++){
+        size_t reported = workingFile.diagnostics.size();
+        try{
+            single_pass_line(workingFile,pass,included.lines[i],owner.lineNumber,true,&included.lexed[i]);
+        }
+        catch(AssemblyError& error){
+            pass.includeDepth--;
+            locate_message(error.message,path,i);
+            throw;
+        }
+        for(; reported < workingFile.diagnostics.size(); reported++){
+            locate_message(workingFile.diagnostics[reported].message,path,i);
+        }
+    }
+    pass.includeDepth--;
+    owner.instructionSize = static_cast<uint16_t>(std::min<size_t>(workingFile.output.size() - owner.offset,0xFFFF));
+}
+
+/**
+ * @brief Checks that the source did not end inside a MACRO, REPT or IF block.
+ * @param workingFile Assembled file context.
+ * @param pass State of the run.
+ * @return None (throws unless errors are collected).
+ */
+void finish_blocks(AssembledFile& workingFile,const SinglePass& pass){
+    try{
+        pass.macros.finish();
+    }
+    catch(const AssemblyError& error){
+        report_error(workingFile,error.message,error.lineNumber);
+    }
+    if(!pass.conditionals.open.empty()){
+        report_error(workingFile,"Error, IF without ENDIF.",static_cast<int>(pass.conditionals.open.back().lineNumber));
+    }
+}
+
+/**
+ * @brief Clears everything a run fills in, keeping the source lines.
+ * @param workingFile Assembled file context.
+ * @return None.
+ */
+void reset_results(AssembledFile& workingFile){
+    workingFile.currentPass = 1;
+    workingFile.parsedLines.clear();
+    workingFile.output.clear();
+    workingFile.segments.assign(1,Segment{});
+    workingFile.symbolTable.clear();
+    workingFile.pendingFixups.clear();
+    workingFile.fixups.clear();
+    workingFile.ownedNames.clear();
+    workingFile.diagnostics.clear();
+    workingFile.relocations.clear();
+    workingFile.constants.clear();
+    workingFile.publicNames.clear();
+    workingFile.externNames.clear();
+    workingFile.includedFiles.clear();
+    workingFile.optimization = OptimizationStats();
+    for(const auto& define : workingFile.defines){
+        workingFile.symbolTable.insert(define);
+        if(workingFile.relocatable){
+            workingFile.constants.push_back(define.first);
+        }
+    }
+}
+
+/**
+ * @brief Closes the last segment, drops the empty ones and sorts them by address, reporting any that run past FFFFh
+ *        or overlap.
+ * @param workingFile Assembled file context.
+ * @return None (throws on a segment past the address space or an overlap unless errors are collected).
+ */
+void finish_segments(AssembledFile& workingFile){
+    std::vector<Segment>& segments = workingFile.segments;
+    segments.back().size = static_cast<uint32_t>(workingFile.output.size()) - segments.back().offset;
+    for(const Segment& segment : segments){
+        if(segment.size != 0 && uint64_t(segment.origin) + segment.size > 0x10000){
+            char address[16];
+            std::snprintf(address,sizeof(address),"%04Xh",static_cast<unsigned>(segment.origin));
+            report_error(workingFile,"Error, code at "+std::string(address)+" runs past FFFFh.",static_cast<int>(segment.lineNumber));
+        }
+    }
+    if(segments.size() == 1){
+        //no ORG/DS after the first byte: nothing can overlap
+        if(segments[0].size == 0){
+            segments.clear();
+        }
+        return;
+    }
+    segments.erase(std::remove_if(segments.begin(),segments.end(),[](const Segment& segment){ return segment.size == 0; }),
+                   segments.end());
+    std::sort(segments.begin(),segments.end(),[](const Segment& a,const Segment& b){
+        return a.origin != b.origin ? a.origin < b.origin : a.offset < b.offset;
+    });
+    for(size_t i = 1; i < segments.size(); i++){
+        const Segment& previous = segments[i - 1];
+        if(segments[i].origin < previous.origin + previous.size){
+            char address[16];
+            std::snprintf(address,sizeof(address),"%04Xh",static_cast<unsigned>(segments[i].origin));
+            report_error(workingFile,"Error, code at "+std::string(address)+" overlaps the code from line "+
+                         std::to_string(previous.lineNumber+1)+".",static_cast<int>(segments[i].lineNumber));
+        }
+    }
+}
+
+/**
+ * @brief Checks the PUBLIC and EXTRN names of a relocatable object. Labels declared EXTRN are left to the linker, so
+ *        their fixups are dropped from the pending ones; the zero words they left get a relocation to the import.
+ * @param workingFile Assembled file context.
+ * @return None (throws on an undefined PUBLIC name or a misused EXTRN one unless errors are collected).
+ */
+void finish_links(AssembledFile& workingFile){
+    for(const DeclaredName& name : workingFile.publicNames){
+        if(workingFile.symbolTable.count(name.name) == 0){
+            report_error(workingFile,"Error, PUBLIC name ["+std::string(name.name)+"] is not defined.",static_cast<int>(name.lineNumber));
+        }
+    }
+    for(const DeclaredName& name : workingFile.externNames){
+        if(workingFile.symbolTable.count(name.name) != 0){
+            report_error(workingFile,"Error, EXTRN name ["+std::string(name.name)+"] is also defined here.",static_cast<int>(name.lineNumber));
+            continue;
+        }
+        auto pending = workingFile.pendingFixups.find(name.name);
+        if(pending == workingFile.pendingFixups.end()){
+            continue;
+        }
+        for(uint32_t next = pending->second; next != NO_FIXUP; next = workingFile.fixups[next].next){
+            if(workingFile.fixups[next].width != 2){
+                report_error(workingFile,"Error, EXTRN name ["+std::string(name.name)+"] can only be used as a word.",
+                             static_cast<int>(workingFile.fixups[next].lineNumber));
+            }
+        }
+        workingFile.pendingFixups.erase(pending);
+    }
+}
+
+/**
+ * @brief Ends a run: every label still pending was never defined, the segments are checked, then collected
+ *        diagnostics are put in line order.
+ * @param workingFile Assembled file context.
+ * @return None (throws the earliest unrecognized symbol, or an overlap, unless errors are collected).
+ */
+void finish(AssembledFile& workingFile){
+    if(workingFile.relocatable){
+        finish_links(workingFile);
+    }
+    if(!workingFile.pendingFixups.empty()){
+        std::vector<AssemblyError> unresolved;
+        for(const auto& pending : workingFile.pendingFixups){
+            for(uint32_t next = pending.second; next != NO_FIXUP; next = workingFile.fixups[next].next){
+                unresolved.push_back({"Unrecognized symbol ["+std::string(pending.first)+"]",static_cast<int>(workingFile.fixups[next].lineNumber)});
+            }
+        }
+        std::sort(unresolved.begin(),unresolved.end(),[](const AssemblyError& a,const AssemblyError& b){ return a.lineNumber < b.lineNumber; });
+        if(!workingFile.collectErrors){
+            throw unresolved.front();
+        }
+        for(const AssemblyError& error : unresolved){
+            workingFile.diagnostics.push_back({Diagnostic::Severity::Error,error.lineNumber,error.message});
+        }
+    }
+    finish_segments(workingFile);
+    if(workingFile.collectErrors){
+        //errors found by fixups and in the chunked pass 1 were recorded out of line order
+        std::stable_sort(workingFile.diagnostics.begin(),workingFile.diagnostics.end(),
+                         [](const Diagnostic& a,const Diagnostic& b){ return a.lineNumber < b.lineNumber; });
+    }
+}
+
+}
+
+void assemble(AssembledFile& workingFile){
+    reset_results(workingFile);
+    PassClock clock;
+    size_t lineCount = workingFile.lines.size();
+    if(workingFile.pool != nullptr && lineCount >= PARALLEL_MIN_LINES && !workingFile.relocatable && !workingFile.optimize){
+        if(assemble_chunks(workingFile,clock)){
+            finish(workingFile);
+            clock.lap(workingFile.passNanoseconds[1]);
+            return;
+        }
+        reset_results(workingFile);
+    }
+    workingFile.parsedLines.reserve(lineCount);
+    workingFile.output.reserve(lineCount * 2);
+    SinglePass pass(workingFile);
+    if(workingFile.optimize){
+        pass.lookahead = &workingFile.lines;
+    }
+    for(size_t i = 0; i < lineCount; i++){
+        workingFile.parsedLines.push_back(single_pass_line(workingFile,pass,workingFile.lines[i],static_cast<uint32_t>(i),false,nullptr));
+    }
+    finish_blocks(workingFile,pass);
+    clock.lap(workingFile.passNanoseconds[0]);
+    finish(workingFile);
+    clock.lap(workingFile.passNanoseconds[1]);
+}
+
+bool assemble_stream(std::FILE* input,AssembledFile& workingFile){
+    workingFile.lines.clear();
+    reset_results(workingFile);
+    SinglePass pass(workingFile);
+    std::vector<char> buffer(1 << 16);
+    std::vector<std::string_view> lines;
+    size_t carried = 0;
+    uint32_t lineNumber = 0;
+    while(true){
+        size_t got = std::fread(buffer.data() + carried,1,buffer.size() - carried,input);
+        if(got == 0){
+            break;
+        }
+        size_t filled = carried + got;
+        //only whole lines are assembled; the partial line at the end waits for the next read
+        size_t complete = filled;
+        while(complete > 0 && buffer[complete - 1] != '\n'){
+            complete--;
+        }
+        if(complete == 0){
+            //a line longer than the buffer
+            carried = filled;
+            if(filled == buffer.size()){
+                buffer.resize(buffer.size() * 2);
+            }
+            continue;
+        }
+        lines.clear();
+        split_lines(std::string_view(buffer.data(),complete),lines);
+        for(std::string_view line : lines){
+            single_pass_line(workingFile,pass,line,lineNumber++,true,nullptr);
+        }
+        carried = filled - complete;
+        std::memmove(buffer.data(),buffer.data() + complete,carried);
+    }
+    if(carried > 0){
+        single_pass_line(workingFile,pass,std::string_view(buffer.data(),carried),lineNumber,true,nullptr);
+    }
+    finish_blocks(workingFile,pass);
+    finish(workingFile);
+    return std::ferror(input) == 0;
+}
+
+
+
+/**
+*
+*LIBRARY API
+*
+**/
+
+
+
+const AssemblyResult& Assembler::assemble(std::string_view source,std::string_view directory,
+                                         const std::vector<std::pair<std::string_view,uint16_t>>& defines,bool optimize){
+    scratch.lines.clear();
+    split_lines(source,scratch.lines);
+    scratch.directory.assign(directory);
+    scratch.defines = defines;
+    scratch.optimize = optimize;
+    scratch.collectErrors = true;
+    //the buffers handed out last time come back as scratch, so both sides keep their capacity
+    scratch.output.swap(result.bytes);
+    scratch.diagnostics.swap(result.diagnostics);
+    scratch.segments.swap(result.segments);
+    ::assemble(scratch);
+    result.bytes.swap(scratch.output);
+    result.diagnostics.swap(scratch.diagnostics);
+    result.segments.swap(scratch.segments);
+    //assigned in place, so the names keep their capacity from one call to the next
+    result.symbols.resize(scratch.symbolTable.size());
+    size_t count = 0;
+    for(const auto& entry : scratch.symbolTable){
+        Symbol& symbol = result.symbols[count++];
+        symbol.name.assign(entry.first);
+        symbol.address = entry.second;
+    }
+    std::sort(result.symbols.begin(),result.symbols.end(),[](const Symbol& a,const Symbol& b){
+        return a.address != b.address ? a.address < b.address : a.name < b.name;
+    });
+    return result;
+}
+
+AssemblyResult assemble(std::string_view source){
+    thread_local Assembler assembler;
+    return assembler.assemble(source);
+}
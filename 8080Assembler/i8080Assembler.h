@@ -0,0 +1,758 @@
+#ifndef I8080ASSEMBLER_H_INCLUDED
+#define I8080ASSEMBLER_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "i8080InstructionData.h"
+
+class ThreadPool;
+class MacroProcessor;
+
+
+/**
+*
+*STRUCTS USED FOR ASSEMBLY
+*
+**/
+
+
+
+//Assembler directives; they take the place of an instruction on a line
+enum class Directive : uint8_t {
+    None,
+    Org,    //ORG address: the following lines are assembled from address
+    Db,     //DB list: bytes, quoted strings or labels/constants that fit in a byte
+    Dw,     //DW list: little-endian words, numbers or labels
+    Ds,     //DS count: reserves count bytes without writing them
+    Equ,    //NAME EQU value: binds NAME to value instead of an address
+    Macro,  //NAME MACRO params: the lines up to the matching ENDM are the body of macro NAME
+    Rept,   //REPT count: the lines up to the matching ENDM are assembled count times
+    Endm,   //ENDM: closes a MACRO or REPT block
+    Local,  //LOCAL names: labels inside a macro body that get a fresh name on every expansion
+    Public, //PUBLIC names: labels a relocatable object exports to other modules
+    Extrn,  //EXTRN names: labels a relocatable object imports from other modules
+    If,     //IF value: the lines up to the matching ELSE/ENDIF are assembled only if value (a number or a label
+            //defined above) is not zero
+    Ifdef,  //IFDEF name: like IF, taken if name is a label defined above
+    Ifndef, //IFNDEF name: like IF, taken if name is not a label defined above
+    Else,   //ELSE: switches an IF block to its other branch
+    Endif,  //ENDIF: closes an IF block
+    Include,//INCLUDE "file": assembles the lines of file in place of the line
+    Incbin, //INCBIN "file"[,offset[,length]]: copies the bytes of file (or a slice of them) into the image as they are
+    MacroCall   //not a keyword: the line invokes a macro, argument1 holds the whole argument list
+};
+
+/**
+ * @brief Compares two names, ignoring the case of ASCII letters.
+ * @param a First name.
+ * @param b Second name, in upper case.
+ * @return true if they are the same name; false otherwise.
+ */
+constexpr bool equals_upper(std::string_view a, std::string_view b){
+    if(a.size() != b.size()) return false;
+    for(size_t i = 0; i < a.size(); i++){
+        char c = a[i];
+        if(c >= 'a' && c <= 'z') c = static_cast<char>(c - 'a' + 'A');
+        if(c != b[i]) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Looks up a directive name, ignoring case.
+ * @param name Name as written in the source.
+ * @return The directive; Directive::None if name is not one.
+ */
+constexpr Directive lookup_directive(std::string_view name){
+    switch(name.size()){
+        case 2:
+            if(equals_upper(name, "IF")) return Directive::If;
+            if(equals_upper(name, "DB")) return Directive::Db;
+            if(equals_upper(name, "DW")) return Directive::Dw;
+            if(equals_upper(name, "DS")) return Directive::Ds;
+            break;
+        case 3:
+            if(equals_upper(name, "ORG")) return Directive::Org;
+            if(equals_upper(name, "EQU")) return Directive::Equ;
+            break;
+        case 4:
+            if(equals_upper(name, "REPT")) return Directive::Rept;
+            if(equals_upper(name, "ENDM")) return Directive::Endm;
+            if(equals_upper(name, "ELSE")) return Directive::Else;
+            break;
+        case 5:
+            if(equals_upper(name, "MACRO")) return Directive::Macro;
+            if(equals_upper(name, "LOCAL")) return Directive::Local;
+            if(equals_upper(name, "EXTRN")) return Directive::Extrn;
+            if(equals_upper(name, "IFDEF")) return Directive::Ifdef;
+            if(equals_upper(name, "ENDIF")) return Directive::Endif;
+            break;
+        case 6:
+            if(equals_upper(name, "PUBLIC")) return Directive::Public;
+            if(equals_upper(name, "IFNDEF")) return Directive::Ifndef;
+            if(equals_upper(name, "INCBIN")) return Directive::Incbin;
+            break;
+        case 7:
+            if(equals_upper(name, "INCLUDE")) return Directive::Include;
+            break;
+    }
+    return Directive::None;
+}
+
+//A single lexed source line. All text fields are views into the source, so lexing a line never allocates.
+struct ParsedLine{
+    //some variables for managing the current line were parsing
+    std::string_view label,opcode,argument1,argument2;
+    //instruction table entry for opcode, resolved once while lexing (nullptr for label-only/blank/directive lines)
+    const Instruction* instruction = nullptr;
+    //zero-based source line, used for error messages
+    uint32_t lineNumber = 0;
+    //offset of the line's first byte in output, and the address it is assembled at; assigned during pass 1
+    uint32_t offset = 0;
+    uint16_t pc = 0;
+    //bytes the line produces (a DB/DW list can be longer than any instruction)
+    uint16_t instructionSize = 0;
+    //directive in place of an instruction; for DB/DW, MACRO, LOCAL, PUBLIC, EXTRN and macro calls argument1 holds the whole list
+    Directive directive = Directive::None;
+    int operandCount = 0;
+
+    ParsedLine() = default;
+
+    /**
+     * @brief Constructs a ParsedLine representing one parsed assembly line.
+     * @param lab Parsed label (without ':') or empty if none.
+     * @param op Parsed opcode/mnemonic (as written in the source) or empty if none.
+     * @param a1 First operand string (may be empty).
+     * @param a2 Second operand string (may be empty).
+     * @param insn Instruction table entry for op, or nullptr for label-only/blank lines.
+     * @param line Zero-based source line number.
+     * @return None (constructor).
+     */
+    ParsedLine(std::string_view lab, std::string_view op, std::string_view a1, std::string_view a2, const Instruction* insn, uint32_t line){
+        this->label = lab;
+        this->opcode = op;
+        this->argument1 = a1;
+        this->argument2 = a2;
+        this->instruction = insn;
+        this->instructionSize = insn ? insn->size : 0;
+        this->lineNumber = line;
+    }
+
+    /**
+     * @brief Counts how many operands remain (non-empty argument1/argument2) and stores it in operandCount.
+     * @param None.
+     * @return None.
+     */
+    void set_operand_count(){
+        if(!argument1.empty()){
+            this -> operandCount += 1;
+        }
+        if(!argument2.empty()){
+            this -> operandCount += 1;
+        }
+    }
+};
+
+//Thrown by err() to abandon assembly of the current file; the caller decides how to report it.
+struct AssemblyError{
+    std::string message;
+    int lineNumber = 0;
+};
+
+//A warning or error tied to a source line
+struct Diagnostic{
+    enum class Severity{ Warning, Error };
+    Severity severity = Severity::Error;
+    //zero-based source line
+    int lineNumber = 0;
+    std::string message;
+};
+
+//An operand waiting for a label defined further down the source
+struct Fixup{
+    //offset of the operand bytes in output
+    uint32_t offset = 0;
+    //line that used the label, for errors
+    uint32_t lineNumber = 0;
+    //next older fixup waiting for the same label, or NO_FIXUP
+    uint32_t next = 0;
+    //bytes the operand has room for: 2 for an address, 1 for a byte
+    uint8_t width = 0;
+    //instruction that used the label, named in the error if a byte operand gets a value over 0xFF; nullptr for DB/DW
+    const Instruction* instruction = nullptr;
+};
+
+//A label operand found while encoding a line: one used before its definition, or a word naming a label to relocate
+struct ForwardReference{
+    std::string_view name;
+    //offset of the operand bytes from the start of the line
+    uint32_t at = 0;
+    uint8_t width = 0;
+};
+
+//A word operand holding a label's value, which the linker adjusts when the file is assembled as a relocatable object
+struct Relocation{
+    //offset of the word in output
+    uint32_t offset = 0;
+    std::string_view name;
+};
+
+//A name listed by PUBLIC or EXTRN, with its line for errors
+struct DeclaredName{
+    std::string_view name;
+    uint32_t lineNumber = 0;
+};
+
+//A contiguous run of the image: output[offset, offset + size) is loaded at origin
+struct Segment{
+    uint32_t origin = 0;
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    //line whose ORG or DS started the run, for overlap errors
+    uint32_t lineNumber = 0;
+};
+
+//end of a fixup chain
+const uint32_t NO_FIXUP = UINT32_MAX;
+
+//files with fewer lines than this are assembled on one thread even when a pool is available
+const size_t PARALLEL_MIN_LINES = 1 << 15;
+
+//What the -O peephole pass saved in a run
+struct OptimizationStats{
+    //instructions removed or replaced
+    uint32_t rewrites = 0;
+    uint32_t bytes = 0;
+    //T-states, counting every rewritten instruction once
+    uint32_t cycles = 0;
+};
+
+//What operand resolution did in a run, counted for --stats. Relaxed atomics: the chunked passes count from several
+//threads, and nothing is ordered by them.
+struct AssemblyCounters{
+    //operands looked up in the symbol table, and the lookups that found nothing (a number or a label still to come)
+    std::atomic<uint64_t> symbolLookups{0};
+    std::atomic<uint64_t> symbolMisses{0};
+    //operands scanned as numeric literals
+    std::atomic<uint64_t> literalScans{0};
+    //values checked to fit in a byte (byte operands, DB items and byte fixups)
+    std::atomic<uint64_t> byteChecks{0};
+};
+
+//A struct that holds our output file and all information related to that file
+struct AssembledFile{
+    //the input files contents, one view per line into the loaded source (which must outlive this struct)
+    std::vector<std::string_view> lines;
+    //every source line lexed once in pass 1. pass 2 encodes from these instead of parsing the text again.
+    std::vector<ParsedLine> parsedLines;
+    //the binary output: the bytes of every segment, in source order with no gaps between them
+    std::vector<uint8_t> output;
+    //where each run of output is loaded, sorted by origin and never overlapping. a source without ORG/DS has one at 0.
+    std::vector<Segment> segments;
+    //what pass were currently on; the chunked path makes 2 passes, the serial path only 1. after assemble(), 2 means
+    //the chunked path ran.
+    int currentPass = 1;
+    //addresses of our labels. keys are views into the source text (or into ownedNames when streaming).
+    std::unordered_map<std::string_view,uint16_t> symbolTable;
+    //labels used before their definition -> newest fixup waiting for them; the chain continues through Fixup::next
+    std::unordered_map<std::string_view,uint32_t> pendingFixups;
+    std::vector<Fixup> fixups;
+    //forward references of the line being encoded (scratch for the single pass)
+    std::vector<ForwardReference> forwardReferences;
+    //assemble a relocatable object: addresses start at 0 and move at link time, and labels declared EXTRN may stay
+    //undefined. set before assemble().
+    bool relocatable = false;
+    //relocatable only: every word operand naming a label, in output order, and the label operands of the line
+    //being encoded (scratch)
+    std::vector<Relocation> relocations;
+    std::vector<ForwardReference> labelWords;
+    //relocatable only: names bound by EQU to a number or another constant, which stay put when the object is linked
+    std::vector<std::string_view> constants;
+    //names listed by PUBLIC and EXTRN
+    std::vector<DeclaredName> publicNames;
+    std::vector<DeclaredName> externNames;
+    //constants defined before the first line (-D NAME=value on the command line), e.g. for IF and IFDEF. the names
+    //must outlive assembly.
+    std::vector<std::pair<std::string_view,uint16_t>> defines;
+    //directory INCLUDE and INCBIN file names are relative to (the main source's); empty for the working directory
+    std::string directory;
+    //paths of the files INCLUDE and INCBIN read, in the order they were first read
+    std::vector<std::string> includedFiles;
+    //run the peephole pass (see optimize_line) on the source lines. set before assemble(); assemble_stream ignores it.
+    bool optimize = false;
+    OptimizationStats optimization;
+    //text the symbol table and cached lines point into besides the source: label names copied when the source text
+    //does not outlive assembly (streaming), macro bodies with their parameters substituted and local label names
+    std::deque<std::string> ownedNames;
+    //optional pool for splitting a large file across cores; null assembles on the calling thread
+    ThreadPool* pool = nullptr;
+    //record every error in diagnostics and keep going, instead of throwing the first one
+    bool collectErrors = false;
+    //warnings (and collected errors) raised while assembling, in source order. the caller prints them so parallel runs dont interleave.
+    std::vector<Diagnostic> diagnostics;
+    //wall time of each pass of the last assemble(), in nanoseconds: the chunked path's lexing and encoding, or the
+    //single pass and the fixups and segments finished after it. a chunked attempt that fell back counts in pass 1.
+    uint64_t passNanoseconds[2] = {};
+    //if set, operand resolution is counted here (--stats); null costs one check per operand
+    AssemblyCounters* counters = nullptr;
+    //constructor
+
+    AssembledFile() = default;
+
+    /**
+     * @brief Constructs an AssembledFile from the input file's lines.
+     * @param Infile Vector of source lines (one view per line), moved into the struct.
+     * @return None (constructor).
+     */
+    AssembledFile(std::vector<std::string_view> Infile){
+        this->lines = std::move(Infile);
+    }
+};
+
+//A label and the address it was bound to
+struct Symbol{
+    //a copy: names from macro expansions and included files live in the assembler, not in the source
+    std::string name;
+    uint16_t address = 0;
+};
+
+//Everything one call to Assembler::assemble produces
+struct AssemblyResult{
+    //the image, segment after segment in source order; lines that failed to encode are left as zero bytes
+    std::vector<uint8_t> bytes;
+    //where each run of bytes is loaded, sorted by origin
+    std::vector<Segment> segments;
+    //every label, ordered by address then name
+    std::vector<Symbol> symbols;
+    //warnings and errors in source order
+    std::vector<Diagnostic> diagnostics;
+
+    /**
+     * @brief Tells whether the source assembled without errors (warnings are allowed).
+     * @param None.
+     * @return true if no diagnostic is an error; false otherwise.
+     */
+    bool ok() const;
+};
+
+
+
+/**
+*
+*DIAGNOSTICS
+*
+**/
+
+
+
+/**
+ * @brief Abandons assembly of the current file with an error message and source line number.
+ * @param msg Human-readable error message.
+ * @param lineNumber Zero-based line index (printed as 1-based).
+ * @return None (throws AssemblyError).
+ */
+[[noreturn]] void err(std::string msg,int lineNumber);
+
+/**
+ * @brief Formats an AssemblyError the way it is printed to the user.
+ * @param error Error thrown by err().
+ * @return "error on line N: message".
+ */
+std::string format_error(const AssemblyError& error);
+
+/**
+ * @brief Formats a diagnostic the way it is printed to the user.
+ * @param diagnostic Warning or error.
+ * @return "Warning on line N, message" or "error on line N: message".
+ */
+std::string format_diagnostic(const Diagnostic& diagnostic);
+
+
+
+/**
+*
+*PARSING AND ENCODING
+*
+**/
+
+
+
+//The lexing below is constexpr so the compile-time assembler (ConstexprAssembler.h) reads a line exactly as parse() does.
+
+/**
+ * @brief Trims leading spaces/tabs from a view.
+ * @param s View to trim.
+ * @return Sub-view of s without leading whitespace (empty if s is all whitespace).
+ */
+constexpr std::string_view ltrim(std::string_view s){
+    auto p = s.find_first_not_of(" \t\r");
+    if (p == std::string_view::npos) return {};
+    return s.substr(p);
+}
+
+/**
+ * @brief Trims leading and trailing spaces/tabs from a view.
+ * @param s View to trim.
+ * @return Sub-view of s without surrounding whitespace (empty if s is all whitespace).
+ */
+constexpr std::string_view trim(std::string_view s){
+    auto start = s.find_first_not_of(" \t\r");
+    if (start == std::string_view::npos) return {};
+    auto end = s.find_last_not_of(" \t\r");
+    return s.substr(start, end - start + 1);
+}
+
+/**
+ * @brief Checks whether text contains a quote character.
+ * @param text Text to check.
+ * @return true if text has a ' or "; false otherwise.
+ */
+constexpr bool has_quote(std::string_view text){
+    return text.find('\'') != std::string_view::npos || text.find('"') != std::string_view::npos;
+}
+
+/**
+ * @brief Finds where the comment of a line starts, skipping ';' inside quoted strings.
+ * @param line Source line.
+ * @return Index of the ';' starting the comment; std::string_view::npos if there is none.
+ */
+constexpr size_t find_comment(std::string_view line){
+    size_t pos = line.find(';');
+    //almost every line has no string before its comment
+    if(pos == std::string_view::npos || !has_quote(line.substr(0,pos))){
+        return pos;
+    }
+    pos = line.find_first_of(";'\"");
+    while(pos != std::string_view::npos && line[pos] != ';'){
+        size_t close = line.find(line[pos],pos + 1);
+        //an unterminated string runs to the end of the line
+        if(close == std::string_view::npos){
+            return std::string_view::npos;
+        }
+        pos = line.find_first_of(";'\"",close + 1);
+    }
+    return pos;
+}
+
+/**
+ * @brief Finds the end of the item starting at start in an operand list (the next comma outside quotes).
+ * @param list Operand list.
+ * @param start Index the item starts at.
+ * @return Index of the comma ending the item; list.size() for the last item.
+ */
+constexpr size_t find_item_end(std::string_view list,size_t start){
+    size_t pos = list.find_first_of(",'\"",start);
+    while(pos != std::string_view::npos && list[pos] != ','){
+        size_t close = list.find(list[pos],pos + 1);
+        if(close == std::string_view::npos){
+            return list.size();
+        }
+        pos = list.find_first_of(",'\"",close + 1);
+    }
+    return pos == std::string_view::npos ? list.size() : pos;
+}
+
+/**
+ * @brief Checks whether a DB item is a quoted string ('text' or "text").
+ * @param item Trimmed list item.
+ * @return true if the item is a closed string; false otherwise.
+ */
+constexpr bool is_string_item(std::string_view item){
+    return item.size() >= 2 && (item.front() == '\'' || item.front() == '"') && item.back() == item.front();
+}
+
+//A source line cut into its label, opcode and the text after the opcode, with the comment stripped
+struct LineFields{
+    std::string_view label,opcode,rest;
+    //instruction table entry or directive the opcode names; nullptr and Directive::None if it names neither
+    //(a blank or label-only line, a macro call or an unknown opcode)
+    const Instruction* instruction = nullptr;
+    Directive directive = Directive::None;
+};
+
+/**
+ * @brief Cuts a raw source line into label (before a ':' outside quotes), opcode and operand text, and looks the
+ *        opcode up. "NAME EQU value" and "NAME MACRO params" come back with NAME as the label.
+ * @param line Raw source line text.
+ * @return The fields, views into line.
+ */
+constexpr LineFields split_line(std::string_view line){
+    LineFields fields;
+    // Strip comment first (a ';' inside a quoted string is part of the string)
+    line = line.substr(0, find_comment(line));
+    // LABEL (a ':' inside a quoted string is not one)
+    size_t pos = line.find(':');
+    if (pos != std::string_view::npos && !has_quote(line.substr(0, pos))) {
+        fields.label = trim(line.substr(0, pos));
+        line.remove_prefix(pos + 1);
+    }
+    // OP
+    line = ltrim(line);
+    pos = line.find_first_of(" \t");
+    if (pos != std::string_view::npos) {
+        fields.opcode = trim(line.substr(0, pos));
+        fields.rest = line.substr(pos + 1);
+    } else {
+        fields.opcode = trim(line);
+    }
+    if(fields.opcode.empty()){
+        return fields;
+    }
+    fields.instruction = lookup_instruction(fields.opcode);
+    if(fields.instruction == nullptr){
+        fields.directive = lookup_directive(fields.opcode);
+    }
+    //"NAME EQU value" and "NAME MACRO params" name their constant or macro without a colon, so what looked like the
+    //opcode is the label
+    if(fields.instruction == nullptr && fields.directive == Directive::None && fields.label.empty()){
+        std::string_view rest = ltrim(fields.rest);
+        pos = rest.find_first_of(" \t");
+        Directive named = lookup_directive(rest.substr(0, pos));
+        if(named == Directive::Equ || named == Directive::Macro){
+            fields.label = fields.opcode;
+            fields.opcode = rest.substr(0, pos);
+            fields.directive = named;
+            fields.rest = pos == std::string_view::npos ? std::string_view{} : rest.substr(pos + 1);
+        }
+    }
+    return fields;
+}
+
+/**
+ * @brief Splits the operand text of an instruction line on its first ','.
+ * @param rest Text after the opcode.
+ * @param a1 Receives the first operand (may be empty).
+ * @param a2 Receives everything after the comma (may be empty).
+ * @return None.
+ */
+constexpr void split_operands(std::string_view rest,std::string_view& a1,std::string_view& a2){
+    rest = ltrim(rest);
+    size_t pos = rest.find(',');
+    if (pos != std::string_view::npos) {
+        a1 = trim(rest.substr(0, pos));
+        a2 = trim(rest.substr(pos + 1));
+    } else {
+        a1 = trim(rest);
+        a2 = {};
+    }
+}
+
+//A numeric operand as written in the source
+struct NumericLiteral{
+    uint16_t value = 0;
+    //2, 10 or 16
+    uint8_t base = 10;
+    //bytes value needs: 1 up to 0xFF, 2 above
+    uint8_t width = 1;
+};
+
+/**
+ * @brief Scans a numeric literal in one pass, without exceptions or allocation.
+ *        Accepts decimal, hex with an 'h' suffix or '0x' prefix, and binary with a '0b' prefix or 'b' suffix, with an
+ *        optional leading '+'. The 'h' suffix is checked first, so "0Bh" is hex 0x0B rather than a binary prefix.
+ * @param text Operand text (e.g., "255", "0FFh", "0xFF", "1010b").
+ * @param literal Receives the value, base and width when the text is a literal.
+ * @return true if text is a literal of at most 16 bits; false otherwise.
+ */
+constexpr bool scan_literal(std::string_view text,NumericLiteral& literal){
+    text = trim(text);
+    if (!text.empty() && text.front() == '+') {
+        text.remove_prefix(1);
+    }
+    if (text.empty()) {
+        return false;
+    }
+    uint32_t base = 10;
+    char last = text.back();
+    if (last == 'h' || last == 'H') {
+        base = 16;
+        text.remove_suffix(1);
+    }
+    else if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        base = 16;
+        text.remove_prefix(2);
+    }
+    else if (text.size() > 2 && text[0] == '0' && (text[1] == 'b' || text[1] == 'B')) {
+        base = 2;
+        text.remove_prefix(2);
+    }
+    else if (last == 'b' || last == 'B') {
+        base = 2;
+        text.remove_suffix(1);
+    }
+    //no sign or prefix is left, so anything that is not a digit of base fails the scan
+    uint32_t value = 0;
+    for (char c : text) {
+        uint32_t digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : 16;
+        value = value * base + digit;
+        if (digit >= base || value > 0xFFFF) {
+            return false;
+        }
+    }
+    if (text.empty()) {
+        return false;
+    }
+    literal.value = static_cast<uint16_t>(value);
+    literal.base = static_cast<uint8_t>(base);
+    literal.width = value > 0xFF ? 2 : 1;
+    return true;
+}
+
+/**
+ * @brief Gives the code of an operand filling a field of the opcode byte (register, register pair or RST vector).
+ * @param field Field descriptor from the instruction table.
+ * @param argument Operand text filling the field.
+ * @return The code, not yet shifted into place; -1 if argument does not fit the field.
+ */
+constexpr int field_code(const OperandField& field,std::string_view argument){
+    switch(field.kind){
+        case FieldKind::Register:
+            return lookup_reg(argument);
+        case FieldKind::RegPair:{
+            int code = lookup_rp(argument);
+            return code <= field.mask ? code : -1;
+        }
+        case FieldKind::Vector:{
+            NumericLiteral literal;
+            return scan_literal(argument,literal) && literal.value <= 7 ? literal.value : -1;
+        }
+        case FieldKind::None:
+            break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Parses a raw assembly source line into label/opcode/arg1/arg2 and resolves its instruction table entry.
+ *        Strips ';' comments, supports labels ending with ':', and splits operands on ','.
+ *        The returned fields are views into line, which must outlive the ParsedLine.
+ * @param line Raw source line text.
+ * @param lineNumber Zero-based source line number (used for error reporting).
+ * @param macros If given, an opcode naming one of its macros makes the line a macro call instead of an error.
+ * @return ParsedLine containing parsed fields and instruction size (0 for label-only).
+ */
+ParsedLine parse(std::string_view line,uint32_t lineNumber,const MacroProcessor* macros = nullptr);
+
+/**
+ * @brief Finds the block directive of a raw line (MACRO, REPT, ENDM or LOCAL) without lexing it, so lines inside a
+ *        macro body can be scanned before their parameters are substituted.
+ * @param line Raw source line text.
+ * @return The block directive; Directive::None for any other line.
+ */
+Directive block_directive(std::string_view line);
+
+/**
+ * @brief Reads the value operand of an ORG, DS, EQU or REPT line: a number, or a label defined on an earlier line.
+ *        A later label is not allowed, as the value decides how the lines that follow are laid out.
+ * @param workingFile Assembled file context (symbol table).
+ * @param currentLine Directive line.
+ * @return The value (throws AssemblyError if the operand is neither).
+ */
+uint16_t resolve_value(const AssembledFile& workingFile,const ParsedLine& currentLine);
+
+/**
+ * @brief Writes a 16-bit value as two bytes in little-endian order (low, then high).
+ * @param value Value to split.
+ * @param out Destination for the 2 bytes: {lowByte, highByte}.
+ * @return None.
+ */
+void to_little_endian(uint16_t value,uint8_t* out);
+
+/**
+ * @brief Encodes one cached line (opcode plus operand bytes) into its place in the output.
+ * @param cachedLine Line lexed in pass 1 with an instruction or a directive (only DB/DW produce bytes).
+ * @param out Destination, with room for the line's instructionSize bytes.
+ * @param workingFile Assembled file context (symbol table).
+ * @param forwardReferences If given, labels that are not defined yet are added here and their bytes are left zero
+ *        for a fixup to fill in, instead of being an error.
+ * @param labelWords If given, every word operand naming a label (defined or not) is added here, for relocation, and
+ *        every byte operand naming a defined label is added with width 1.
+ * @return None.
+ */
+void encode_line(const ParsedLine& cachedLine,uint8_t* out,const AssembledFile& workingFile,std::vector<ForwardReference>* forwardReferences = nullptr,
+                 std::vector<ForwardReference>* labelWords = nullptr);
+
+
+
+/**
+*
+*CORE LOGIC
+*
+**/
+
+
+
+/**
+ * @brief Assembles the given source lines into machine code.
+ *        Lines are lexed and encoded in a single pass. An operand naming a label that is not defined yet is encoded
+ *        as zeros and a fixup is chained onto the label; when the label is defined its chain is back-patched, and any
+ *        chain still pending at the end is an unrecognized symbol.
+ *        ORG and DS start a new segment of the image, so a sparse layout only stores the bytes it populates.
+ *        Lines in an inactive IF/IFDEF/IFNDEF branch are skipped without being lexed.
+ *        With workingFile.optimize set, each source line goes through the peephole pass (see optimize_line) between
+ *        lexing and encoding, so the lines after a shortened one are simply placed lower; this keeps to the single pass.
+ *        MACRO/ENDM and REPT/ENDM blocks are recorded as they are met; a macro call or a closed REPT is assembled from
+ *        its expansion (see MacroProcessor) in place of the line, and that line is sized to cover the bytes produced.
+ *        An INCLUDE line is sized the same way; each included file is mapped and split once per run, and a line it
+ *        lexed once is reused by every later INCLUDE of the file. INCBIN copies a mapped file into output directly.
+ *        With workingFile.relocatable set, every word operand naming a label is recorded in relocations and labels
+ *        declared EXTRN may stay undefined, so the result can be written as an object file for the linker.
+ *        Large files with a thread pool are instead split into chunks: each chunk is lexed on its own with
+ *        chunk-relative offsets, an exclusive prefix sum over the chunk sizes gives each chunk its base address, and a
+ *        second pass encodes the chunks in parallel straight into their precomputed places in output. A file using ORG,
+ *        DS, EQU or macros falls back to the single pass, since those make later addresses depend on earlier lines.
+ * @param workingFile Assembled file context containing input lines and receiving output bytes.
+ * @return None (writes into workingFile.output and workingFile.symbolTable; throws the first AssemblyError
+ *         unless workingFile.collectErrors is set).
+ */
+void assemble(AssembledFile& workingFile);
+
+/**
+ * @brief Assembles a source read from a stream (e.g. a pipe) in one pass, without keeping its lines.
+ *        Only the bytes, symbol table and diagnostics are filled in; lines and parsedLines stay empty.
+ * @param input Stream to read until end of file.
+ * @param workingFile Assembled file context receiving the output.
+ * @return true if the whole stream was read; false on a read error (throws AssemblyError on assembly errors
+ *         unless workingFile.collectErrors is set).
+ */
+bool assemble_stream(std::FILE* input,AssembledFile& workingFile);
+
+/**
+ * @brief An in-process assembler for many small sources. It keeps its line, output and diagnostic buffers
+ *        between calls, so assembling a snippet allocates next to nothing once the buffers have grown.
+ *        Errors never throw or exit: every failing line becomes a diagnostic and assembly carries on.
+ *        Not thread-safe; use one Assembler per thread.
+ */
+class Assembler{
+public:
+    /**
+     * @brief Assembles a whole source.
+     * @param source Source text.
+     * @param directory Directory INCLUDE and INCBIN names are relative to; empty for the working directory.
+     * @param defines Constants defined before the first line (as with -D); the names must outlive the call.
+     * @param optimize Run the peephole pass (as with -O).
+     * @return The result, owned by the assembler and valid until the next call (copy it to keep it longer).
+     */
+    const AssemblyResult& assemble(std::string_view source,std::string_view directory = {},
+                                   const std::vector<std::pair<std::string_view,uint16_t>>& defines = {},bool optimize = false);
+
+private:
+    AssembledFile scratch;
+    AssemblyResult result;
+};
+
+/**
+ * @brief Assembles a whole source on a per-thread Assembler and returns a copy of its result.
+ * @param source Source text.
+ * @return Bytes, symbols and diagnostics.
+ */
+AssemblyResult assemble(std::string_view source);
+
+#endif // I8080ASSEMBLER_H_INCLUDED
@@ -2,13 +2,8 @@
 #define I8080INSTRUCTIONDATA_H_INCLUDED
 
 #include <cstdint>
-#include <string>
-#include <unordered_map>
-
-struct Instruction {
-    uint8_t size;
-    std::string bitPattern;
-};
+#include <cstddef>
+#include <string_view>
 
 enum class Reg : uint8_t {
     B = 0b000,
@@ -36,9 +31,369 @@ enum class RP : uint8_t {
     HL  = 0b10,
     SP  = 0b11,
 };
-extern const std::unordered_map<std::string, Instruction> i8080Instructions;
-extern const std::unordered_map<std::string, Reg>  regCode;
-extern const std::unordered_map<std::string, Cond> condCode;
-extern const std::unordered_map<std::string, RP>   rpCode;
+
+//What kind of value fills a field of the opcode byte
+enum class FieldKind : uint8_t {
+    None,       //no field
+    Register,   //DDD/SSS register code (Reg)
+    RegPair,    //RP register pair code (RP)
+    Vector      //NNN restart vector 0-7
+};
+
+//What kind of immediate follows the opcode byte
+enum class ImmediateKind : uint8_t {
+    None,   //1 byte instruction
+    Byte,   //8 bit immediate or port
+    Word    //16 bit immediate or address, little endian
+};
+
+//A field inside the opcode byte: the operand value is masked and shifted into place.
+struct OperandField {
+    FieldKind kind = FieldKind::None;
+    uint8_t shift = 0;
+    uint8_t mask = 0;
+};
+
+/**
+ * @brief One mnemonic of the instruction set.
+ *        bitPattern is the readable form ('0'/'1' literals, D/S/N 3 bit, R 2 bit and X 1 bit fields);
+ *        the constructor compiles it into a base opcode plus field descriptors, so encoding
+ *        never has to look at the pattern text.
+ */
+struct Instruction {
+    std::string_view mnemonic;
+    uint8_t size = 0;
+    std::string_view bitPattern;
+    //bitPattern with every field set to 0
+    uint8_t baseOpcode = 0;
+    //field filled from the first operand (D, R or N)
+    OperandField arg1;
+    //field filled from the second operand (S)
+    OperandField arg2;
+    ImmediateKind immediate = ImmediateKind::None;
+    //T-states with register operands, and for a conditional call or return, with the condition not met
+    uint8_t cycles = 0;
+    //T-states of the slow form: with an M operand, or for a conditional call or return, with the condition met
+    uint8_t slowCycles = 0;
+
+    constexpr Instruction() = default;
+
+    /**
+     * @brief Compiles a bitPattern into its base opcode and field descriptors.
+     * @param m Mnemonic (uppercase).
+     * @param sz Instruction size in bytes.
+     * @param pattern Opcode bit pattern, 8 bits wide once fields are expanded.
+     * @param t T-states with register operands (condition not met).
+     * @param slow T-states with an M operand (condition met); 0 if there is no slow form.
+     * @return None (constructor).
+     */
+    constexpr Instruction(std::string_view m, uint8_t sz, std::string_view pattern, uint8_t t, uint8_t slow = 0)
+        : mnemonic(m), size(sz), bitPattern(pattern), cycles(t), slowCycles(slow != 0 ? slow : t) {
+        int bit = 8;
+        for(char c : pattern){
+            switch(c){
+                case '1': bit -= 1; baseOpcode |= static_cast<uint8_t>(1 << bit); break;
+                case '0': bit -= 1; break;
+                case 'D': bit -= 3; arg1 = {FieldKind::Register, static_cast<uint8_t>(bit), 0b111}; break;
+                case 'S': bit -= 3; arg2 = {FieldKind::Register, static_cast<uint8_t>(bit), 0b111}; break;
+                case 'N': bit -= 3; arg1 = {FieldKind::Vector, static_cast<uint8_t>(bit), 0b111}; break;
+                case 'R': bit -= 2; arg1 = {FieldKind::RegPair, static_cast<uint8_t>(bit), 0b11}; break;
+                //STAX and LDAX only take B or D
+                case 'X': bit -= 1; arg1 = {FieldKind::RegPair, static_cast<uint8_t>(bit), 0b1}; break;
+            }
+        }
+        immediate = sz == 3 ? ImmediateKind::Word : sz == 2 ? ImmediateKind::Byte : ImmediateKind::None;
+    }
+};
+
+// ---------- Data definitions ----------
+inline constexpr Instruction i8080Instructions[] = {
+    {"NOP",  1, "00000000",  4},
+    {"HLT",  1, "01110110",  7},
+    {"RET",  1, "11001001", 10},
+    {"MOV",  1, "01DS",      5,  7},
+    {"ADD",  1, "10000D",    4,  7},
+    {"ADC",  1, "10001D",    4,  7},
+    {"SUB",  1, "10010D",    4,  7},
+    {"SBB",  1, "10011D",    4,  7},
+    {"ANA",  1, "10100D",    4,  7},
+    {"XRA",  1, "10101D",    4,  7},
+    {"ORA",  1, "10110D",    4,  7},
+    {"CMP",  1, "10111D",    4,  7},
+    {"INR",  1, "00D100",    5, 10},
+    {"DCR",  1, "00D101",    5, 10},
+    {"INX",  1, "00R0011",   5},
+    {"DCX",  1, "00R1011",   5},
+    {"DAD",  1, "00R1001",  10},
+    {"PUSH", 1, "11R0101",  11},
+    {"POP",  1, "11R0001",  10},
+    {"STAX", 1, "000X0010",  7},
+    {"LDAX", 1, "000X1010",  7},
+    {"RLC",  1, "00000111",  4},
+    {"RRC",  1, "00001111",  4},
+    {"RAL",  1, "00010111",  4},
+    {"RAR",  1, "00011111",  4},
+    {"DAA",  1, "00100111",  4},
+    {"CMA",  1, "00101111",  4},
+    {"STC",  1, "00110111",  4},
+    {"CMC",  1, "00111111",  4},
+    {"XCHG", 1, "11101011",  4},
+    {"XTHL", 1, "11100011", 18},
+    {"SPHL", 1, "11111001",  5},
+    {"PCHL", 1, "11101001",  5},
+    {"EI",   1, "11111011",  4},
+    {"DI",   1, "11110011",  4},
+
+    {"MVI",  2, "00D110",    7, 10},
+    {"ADI",  2, "11000110",  7},
+    {"ACI",  2, "11001110",  7},
+    {"SUI",  2, "11010110",  7},
+    {"SBI",  2, "11011110",  7},
+    {"ANI",  2, "11100110",  7},
+    {"XRI",  2, "11101110",  7},
+    {"ORI",  2, "11110110",  7},
+    {"CPI",  2, "11111110",  7},
+    {"IN",   2, "11011011", 10},
+    {"OUT",  2, "11010011", 10},
+
+    {"LXI",  3, "00R0001",  10},
+    {"JMP",  3, "11000011", 10},
+    {"JNZ",  3, "11000010", 10},
+    {"JZ",   3, "11001010", 10},
+    {"JNC",  3, "11010010", 10},
+    {"JC",   3, "11011010", 10},
+    {"JPO",  3, "11100010", 10},
+    {"JPE",  3, "11101010", 10},
+    {"JP",   3, "11110010", 10},
+    {"JM",   3, "11111010", 10},
+
+    {"CALL", 3, "11001101", 17},
+    {"CNZ",  3, "11000100", 11, 17},
+    {"CZ",   3, "11001100", 11, 17},
+    {"CNC",  3, "11010100", 11, 17},
+    {"CC",   3, "11011100", 11, 17},
+    {"CPO",  3, "11100100", 11, 17},
+    {"CPE",  3, "11101100", 11, 17},
+    {"CP",   3, "11110100", 11, 17},
+    {"CM",   3, "11111100", 11, 17},
+
+    {"RNZ",  1, "11000000",  5, 11},
+    {"RZ",   1, "11001000",  5, 11},
+    {"RNC",  1, "11010000",  5, 11},
+    {"RC",   1, "11011000",  5, 11},
+    {"RPO",  1, "11100000",  5, 11},
+    {"RPE",  1, "11101000",  5, 11},
+    {"RP",   1, "11110000",  5, 11},
+    {"RM",   1, "11111000",  5, 11},
+
+    {"STA",  3, "00110010", 13},
+    {"LDA",  3, "00111010", 13},
+    {"SHLD", 3, "00100010", 16},
+    {"LHLD", 3, "00101010", 16},
+
+    {"RST",  1, "11N111",   11}
+};
+
+inline constexpr size_t i8080InstructionCount = sizeof(i8080Instructions) / sizeof(i8080Instructions[0]);
+
+
+// ---------- Mnemonic perfect hash ----------
+//Mnemonics are 1-4 letters, so each one packs losslessly into 5 bits per letter.
+//A multiply-xorshift hash of that key is made collision free by searching for a seed at compile time.
+
+inline constexpr int MNEMONIC_HASH_BITS = 9;
+inline constexpr uint8_t NO_INSTRUCTION = 0xFF;
+
+/**
+ * @brief Packs a mnemonic into an integer key, ignoring case.
+ * @param mnemonic Mnemonic text.
+ * @return Packed key; 0 if the text cannot be a mnemonic (empty, longer than 4, or not letters).
+ */
+constexpr uint32_t pack_mnemonic(std::string_view mnemonic){
+    if(mnemonic.empty() || mnemonic.size() > 4){
+        return 0;
+    }
+    uint32_t key = 0;
+    for(char c : mnemonic){
+        if(c >= 'a' && c <= 'z') c = static_cast<char>(c - 'a' + 'A');
+        if(c < 'A' || c > 'Z') return 0;
+        key = (key << 5) | static_cast<uint32_t>(c - 'A' + 1);
+    }
+    return key;
+}
+
+/**
+ * @brief Maps a packed mnemonic key to a slot of the perfect hash table.
+ * @param key Packed mnemonic from pack_mnemonic.
+ * @param seed Multiplier chosen by build_mnemonic_hash.
+ * @return Slot index in [0, 2^MNEMONIC_HASH_BITS).
+ */
+constexpr uint32_t mnemonic_slot(uint32_t key, uint32_t seed){
+    uint32_t h = key * seed;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    return h >> (32 - MNEMONIC_HASH_BITS);
+}
+
+struct MnemonicHashTable {
+    uint32_t seed = 0;
+    uint32_t keys[1 << MNEMONIC_HASH_BITS] = {};
+    uint8_t index[1 << MNEMONIC_HASH_BITS] = {};
+};
+
+/**
+ * @brief Finds a seed for which every mnemonic lands in its own slot and fills the table.
+ * @param None.
+ * @return The finished hash table (seed 0 if no seed was found).
+ */
+constexpr MnemonicHashTable build_mnemonic_hash(){
+    MnemonicHashTable table;
+    for(uint32_t seed = 0x9E3779B1u; seed != 0x9E3779B1u + 2 * 4096; seed += 2){
+        bool used[1 << MNEMONIC_HASH_BITS] = {};
+        bool collision = false;
+        for(size_t i = 0; i < i8080InstructionCount && !collision; i++){
+            uint32_t slot = mnemonic_slot(pack_mnemonic(i8080Instructions[i].mnemonic), seed);
+            collision = used[slot];
+            used[slot] = true;
+        }
+        if(collision){
+            continue;
+        }
+        table.seed = seed;
+        for(uint32_t slot = 0; slot < (1u << MNEMONIC_HASH_BITS); slot++){
+            table.index[slot] = NO_INSTRUCTION;
+        }
+        for(size_t i = 0; i < i8080InstructionCount; i++){
+            uint32_t key = pack_mnemonic(i8080Instructions[i].mnemonic);
+            uint32_t slot = mnemonic_slot(key, seed);
+            table.keys[slot] = key;
+            table.index[slot] = static_cast<uint8_t>(i);
+        }
+        return table;
+    }
+    return table;
+}
+
+inline constexpr MnemonicHashTable i8080MnemonicHash = build_mnemonic_hash();
+static_assert(i8080MnemonicHash.seed != 0, "no perfect hash seed found for the mnemonic table");
+
+/**
+ * @brief Looks up a mnemonic in the instruction table, ignoring case.
+ * @param mnemonic Mnemonic as written in the source.
+ * @return Pointer to the instruction table entry; nullptr if not found.
+ */
+constexpr const Instruction* lookup_instruction(std::string_view mnemonic){
+    uint32_t key = pack_mnemonic(mnemonic);
+    if(key == 0){
+        return nullptr;
+    }
+    uint32_t slot = mnemonic_slot(key, i8080MnemonicHash.seed);
+    if(i8080MnemonicHash.keys[slot] != key){
+        return nullptr;
+    }
+    return &i8080Instructions[i8080MnemonicHash.index[slot]];
+}
+
+
+// ---------- Opcode decoding ----------
+//The instruction table run backwards: every opcode byte to the entry that encodes it, with its timing.
+
+//What an opcode byte decodes to
+struct OpcodeInfo {
+    //index into i8080Instructions; NO_INSTRUCTION for the undocumented opcodes
+    uint8_t instruction = NO_INSTRUCTION;
+    //T-states, and with the condition met (the same for anything but a conditional call or return)
+    uint8_t cycles = 0;
+    uint8_t cyclesTaken = 0;
+};
+
+struct OpcodeTable {
+    OpcodeInfo opcodes[256] = {};
+};
+
+/**
+ * @brief Fills in every opcode each instruction can encode to. Where two entries share an opcode the first one
+ *        listed keeps it (HLT sits where MOV M,M would be).
+ * @param None.
+ * @return The decode table.
+ */
+constexpr OpcodeTable build_opcode_table(){
+    OpcodeTable table;
+    for(size_t i = 0; i < i8080InstructionCount; i++){
+        const Instruction& insn = i8080Instructions[i];
+        int values1 = insn.arg1.kind == FieldKind::None ? 1 : insn.arg1.mask + 1;
+        int values2 = insn.arg2.kind == FieldKind::None ? 1 : insn.arg2.mask + 1;
+        for(int a = 0; a < values1; a++){
+            for(int b = 0; b < values2; b++){
+                uint8_t opcode = static_cast<uint8_t>(insn.baseOpcode | a << insn.arg1.shift | b << insn.arg2.shift);
+                OpcodeInfo& info = table.opcodes[opcode];
+                if(info.instruction != NO_INSTRUCTION){
+                    continue;
+                }
+                bool registers = insn.arg1.kind == FieldKind::Register || insn.arg2.kind == FieldKind::Register;
+                bool memory = (insn.arg1.kind == FieldKind::Register && a == static_cast<int>(Reg::M)) ||
+                              (insn.arg2.kind == FieldKind::Register && b == static_cast<int>(Reg::M));
+                info.instruction = static_cast<uint8_t>(i);
+                info.cycles = memory ? insn.slowCycles : insn.cycles;
+                info.cyclesTaken = registers ? info.cycles : insn.slowCycles;
+            }
+        }
+    }
+    return table;
+}
+
+inline constexpr OpcodeTable i8080Opcodes = build_opcode_table();
+
+
+// ---------- Operand names ----------
+
+/**
+ * @brief Looks up a register name (B, C, D, E, H, L, M, A).
+ * @param name Operand text.
+ * @return Register code 0-7; -1 if name is not a register.
+ */
+constexpr int lookup_reg(std::string_view name){
+    if(name.size() != 1){
+        return -1;
+    }
+    switch(name[0]){
+        case 'B': return static_cast<int>(Reg::B);
+        case 'C': return static_cast<int>(Reg::C);
+        case 'D': return static_cast<int>(Reg::D);
+        case 'E': return static_cast<int>(Reg::E);
+        case 'H': return static_cast<int>(Reg::H);
+        case 'L': return static_cast<int>(Reg::L);
+        case 'M': return static_cast<int>(Reg::M);
+        case 'A': return static_cast<int>(Reg::A);
+    }
+    return -1;
+}
+
+/**
+ * @brief Looks up a register pair name (B/BC, D/DE, H/HL, SP, and PSW for PUSH/POP).
+ * @param name Operand text.
+ * @return Register pair code 0-3; -1 if name is not a register pair.
+ */
+constexpr int lookup_rp(std::string_view name){
+    if(name == "B" || name == "BC") return static_cast<int>(RP::BC);
+    if(name == "D" || name == "DE") return static_cast<int>(RP::DE);
+    if(name == "H" || name == "HL") return static_cast<int>(RP::HL);
+    // PUSH/POP special case
+    if(name == "SP" || name == "PSW") return static_cast<int>(RP::SP);
+    return -1;
+}
+
+/**
+ * @brief Looks up a condition code name (NZ, Z, NC, C, PO, PE, P, M).
+ * @param name Condition text.
+ * @return Condition code 0-7; -1 if name is not a condition.
+ */
+constexpr int lookup_cond(std::string_view name){
+    constexpr std::string_view names[] = {"NZ", "Z", "NC", "C", "PO", "PE", "P", "M"};
+    for(int i = 0; i < 8; i++){
+        if(names[i] == name) return i;
+    }
+    return -1;
+}
 
 #endif // I8080INSTRUCTIONDATA_H_INCLUDED
@@ -1,631 +1,561 @@
 #include <iostream>
-#include <fstream>
 #include <vector>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <cstdint>
-#include <cctype>
-#include <type_traits>
-#include "i8080InstructionData.h"
+#include <cstdlib>
+#include <memory>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include "i8080Assembler.h"
+#include "Daemon.h"
+#include "HeapCounter.h"
+#include "IncrementalAssembly.h"
+#include "MappedFile.h"
+#include "ObjectFile.h"
+#include "OutputCache.h"
+#include "OutputWriters.h"
+#include "SelfCheck.h"
+#include "SourceMap.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+#include "Timing.h"
 
 
 /**
 *
-*STRUCTS AND TEMPLATES USED FOR ASSEMBLY
+*OUTPUT
 *
 **/
 
 
-//A struct that holds our output file and all information related to that file
-struct AssembledFile{
-    //the input files contents
-    std::vector<std::string> lines;
-    //the binary output
-    std::vector<uint8_t> output;
-    //the current line were on in output
-    size_t lineNum=0;
-    //what pass were currently on, this assembler will preform 2 passes.
-    int currentPass = 1;
-    //addresses of our labels.
-    std::unordered_map<std::string,uint16_t> symbolTable;
-    //constructor
-
-    /**
-     * @brief Constructs an AssembledFile from the input file's lines.
-     * @param Infile Vector of source lines (one string per line).
-     * @return None (constructor).
-     */
-    AssembledFile(std::vector<std::string> Infile){
-        this->lines = Infile;
-    }
-};
-
-struct ParsedLine{
-    //some variables for managing the current line were parsing
-    std::string label,opcode,argument1,argument2;
-    uint8_t instructionSize;
-    int operandCount = 0;
-
-    /**
-     * @brief Constructs a ParsedLine representing one parsed assembly line.
-     * @param lab Parsed label (without ':') or empty if none.
-     * @param op Parsed opcode/mnemonic (typically uppercased later) or empty if none.
-     * @param a1 First operand string (may be empty).
-     * @param a2 Second operand string (may be empty).
-     * @param Is Instruction size in bytes (0 for label-only/blank lines).
-     * @return None (constructor).
-     */
-    ParsedLine(std::string lab, std::string op, std::string a1, std::string a2,uint8_t Is){
-        this->label = lab;
-        this->opcode = op;
-        this->argument1 = a1;
-        this->argument2 = a2;
-        this->instructionSize = Is;
-    }
-
-    /**
-     * @brief Debug prints the opcode and operands for this parsed line.
-     * @param None.
-     * @return None.
-     */
-    void print(){
-        std::cout << this -> opcode << this -> argument1 << this -> argument2;
-    }
-
-    /**
-     * @brief Counts how many operands remain (non-empty argument1/argument2) and stores it in operandCount.
-     * @param None.
-     * @return None.
-     */
-    void set_operand_count(){
-        if(!argument1.empty()){
-            this -> operandCount += 1;
-        }
-        if(!argument2.empty()){
-            this -> operandCount += 1;
-        }
-    }
-};
-
 
-template <typename T>
 /**
- * @brief Parses a numeric string (decimal, binary, or hex) into an unsigned integer type (uint8_t or uint16_t).
- *        Supports prefixes (0b, 0x) and suffixes (b, h). Whitespace is trimmed.
- * @param input Numeric text to parse (assumed convertible per your note).
- * @return Parsed value, cast to T (truncates if the number exceeds the target width).
+ * @brief Collects one listing entry per source line from the cached pass 1 results. The listing and the source map
+ *        are both rendered from these records.
+ * @param workingFile Assembled file context after assemble().
+ * @return Listing entries in source order.
  */
-T parse_uint(const std::string& input) {
-    static_assert(
-        std::is_same<T, uint8_t>::value || std::is_same<T, uint16_t>::value,
-        "parseUint only supports uint8_t or uint16_t"
-    );
-
-    //Trim leading and trailing whitespace
-    auto isSpace = [](unsigned char c) { return std::isspace(c) != 0; };
-
-    size_t startIndex = 0;
-    while (startIndex < input.size() && isSpace(input[startIndex])) {
-        startIndex++;
-    }
-
-    size_t endIndex = input.size();
-    while (endIndex > startIndex && isSpace(input[endIndex - 1])) {
-        endIndex--;
-    }
-
-    std::string trimmedInput = input.substr(startIndex, endIndex - startIndex);
-
-    //Determine numeric base
-    int numericBase = 10;
-
-    // Binary: 0b1010 or 1010b
-    if (trimmedInput.size() >= 2 &&
-        (trimmedInput.rfind("0b", 0) == 0 || trimmedInput.rfind("0B", 0) == 0)) {
-        numericBase = 2;
-        trimmedInput.erase(0, 2);
-    }
-    else if (!trimmedInput.empty() &&
-             (trimmedInput.back() == 'b' || trimmedInput.back() == 'B')) {
-        numericBase = 2;
-        trimmedInput.pop_back();
-    }
-    // Hexadecimal: 0x1A2F or 1A2Fh
-    else if (trimmedInput.size() >= 2 &&
-             (trimmedInput.rfind("0x", 0) == 0 || trimmedInput.rfind("0X", 0) == 0)) {
-        numericBase = 16;
-        trimmedInput.erase(0, 2);
-    }
-    else if (!trimmedInput.empty() &&
-             (trimmedInput.back() == 'h' || trimmedInput.back() == 'H')) {
-        numericBase = 16;
-        trimmedInput.pop_back();
-    }
-
-    //Convert and truncate to target width
-    unsigned long parsedValue = std::stoul(trimmedInput, nullptr, numericBase);
-    return static_cast<T>(parsedValue);
+std::vector<ListingEntry> build_listing(const AssembledFile& workingFile){
+    std::vector<ListingEntry> entries;
+    entries.reserve(workingFile.parsedLines.size());
+    for(size_t i = 0; i < workingFile.parsedLines.size(); i++){
+        const ParsedLine& line = workingFile.parsedLines[i];
+        entries.push_back({line.offset, line.pc, line.instructionSize, workingFile.lines[i]});
+    }
+    return entries;
 }
 
 /**
- * @brief Prints an error message including source line number and terminates the program.
- * @param msg Human-readable error message.
- * @param lineNumber Zero-based line index (printed as 1-based).
- * @return None (exits the process).
+ * @brief Points at the populated segments of the assembled image.
+ * @param workingFile Assembled file context after assemble().
+ * @return One view per segment, in address order.
  */
-
-
-/**
-*
-*MISCELANEOUS HELPER FUNCTIONS
-*
-**/
-
-
-
-void err(std::string msg,int lineNumber){
-    std::cout << "error on line " << lineNumber+1 << ": "+msg<<std::endl;
-    exit(1);
-}
-
-
-
-/**
-*
-*PARSING
-*
-**/
-
-
-
-/**
- * @brief Uppercases a string in-place (ASCII-safe via unsigned char cast).
- * @param str String to modify.
- * @return None.
- */
-void to_upper(std::string& str){
-    for (char& c : str) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+std::vector<ImageSegment> image_segments(const AssembledFile& workingFile){
+    std::vector<ImageSegment> segments;
+    segments.reserve(workingFile.segments.size());
+    for(const Segment& segment : workingFile.segments){
+        segments.push_back({segment.origin, workingFile.output.data() + segment.offset, segment.size});
+    }
+    return segments;
 }
 
 /**
- * @brief Trims leading spaces/tabs from a string in-place.
- * @param s String to modify.
- * @return None.
+ * @brief Builds the relocatable object of a file assembled with relocatable set: its segments become the sections,
+ *        every word naming a label gets a relocation (to the module's base, or to the import it names), and the
+ *        PUBLIC names are exported. Words naming an EQU of a number are left as they are; an EQU naming a label is
+ *        relocated and exported like the label.
+ * @param workingFile Assembled file context after assemble().
+ * @return The object module.
  */
-void ltrim(std::string& s) {
-    auto p = s.find_first_not_of(" \t");
-    if (p == std::string::npos) { s.clear(); return; }
-    s.erase(0, p);
+ObjectModule build_object(const AssembledFile& workingFile){
+    ObjectModule module;
+    module.bytes = workingFile.output;
+    for(const Segment& segment : workingFile.segments){
+        module.sections.push_back({segment.origin, segment.offset, segment.size});
+    }
+    std::unordered_set<std::string_view> constants(workingFile.constants.begin(), workingFile.constants.end());
+    std::unordered_map<std::string_view,uint32_t> imports;
+    for(const Relocation& relocation : workingFile.relocations){
+        if(workingFile.symbolTable.count(relocation.name) != 0){
+            if(constants.count(relocation.name) == 0){
+                module.relocations.push_back({relocation.offset, LOCAL_RELOCATION});
+            }
+            continue;
+        }
+        auto import = imports.try_emplace(relocation.name, static_cast<uint32_t>(module.imports.size())).first;
+        if(import->second == module.imports.size()){
+            module.imports.emplace_back(relocation.name);
+        }
+        module.relocations.push_back({relocation.offset, import->second});
+    }
+    for(const DeclaredName& name : workingFile.publicNames){
+        module.exports.push_back({std::string(name.name), workingFile.symbolTable.at(name.name), constants.count(name.name) == 0});
+    }
+    return module;
 }
 
 /**
- * @brief Trims leading and trailing spaces/tabs from a string in-place.
- * @param s String to modify.
- * @return None.
+ * @brief Renders the assembled output in the requested format into one buffer.
+ * @param workingFile Assembled file context after assemble().
+ * @param format Output format.
+ * @return The output file's contents.
  */
-void trim(std::string& s) {
-    auto start = s.find_first_not_of(" \t");
-    if (start == std::string::npos) { s.clear(); return; }
-    auto end = s.find_last_not_of(" \t");
-    s = s.substr(start, end - start + 1);
+std::string render_assembled_file(const AssembledFile& workingFile,OutputFormat format){
+    switch(format){
+        case OutputFormat::Binary:
+            return render_image(image_segments(workingFile));
+        case OutputFormat::IntelHex:
+            return render_intel_hex(image_segments(workingFile));
+        case OutputFormat::Listing:
+            return render_listing(workingFile.output,build_listing(workingFile));
+        case OutputFormat::Object:
+            return render_object(build_object(workingFile));
+        case OutputFormat::Bits:
+            break;
+    }
+    return render_bits(image_segments(workingFile));
 }
 
-
 /**
- * @brief Finds the first occurrence of a delimiter character in a string.
- * @param s Input string.
- * @param delim Delimiter character to search for.
- * @return Index of delimiter if found; std::string::npos if not found.
+ * @brief Renders the assembled output in the requested format and writes it with a single write.
+ * @param workingFile Assembled file context after assemble().
+ * @param format Output format.
+ * @param path Destination file, or "-" for stdout.
+ * @return true if the output was written; false otherwise.
  */
-size_t find_delim_pos(const std::string& s, char delim) {
-    return s.find(delim);  // returns std::string::npos if not found
+bool write_assembled_file(const AssembledFile& workingFile,OutputFormat format,const std::string& path){
+    if(format == OutputFormat::Binary){
+        return write_image(path,image_segments(workingFile));
+    }
+    return write_output(path,render_assembled_file(workingFile,format));
 }
 
-
 /**
- * @brief If the parsed line has a label, adds it to the symbol table with the current PC address.
- *        Errors if the label already exists (duplicate definition).
- * @param currentLine Parsed line containing an optional label.
- * @param pc Program counter address to bind to the label.
- * @param workingFile Assembled file context holding the symbol table and current line number.
- * @return None.
+ * @brief Describes what the peephole pass saved.
+ * @param workingFile Assembled file context after an optimized assemble().
+ * @return One line, without a newline.
  */
-void check_and_add_symbol_reference(const ParsedLine& currentLine,uint16_t pc,AssembledFile& workingFile){
-    //if their is no LABEL, then there is no symbol to record, and we can skip this line in pass 1.
-    if(currentLine.label.empty()){
-        return;
-    }
-    //if there is not currently an entry for this label, then this should be symbolTable.end().
-    auto symbolEntry = workingFile.symbolTable.find(currentLine.label);
-    //if the symbol already exists, thats an error and we should stop assembly.
-    if(symbolEntry != workingFile.symbolTable.end()){
-        err("Error, label "+currentLine.label+" is already present in symbol table.",workingFile.lineNum);
-    }
-    workingFile.symbolTable.insert({currentLine.label,pc});
+std::string optimization_report(const AssembledFile& workingFile){
+    const OptimizationStats& stats = workingFile.optimization;
+    return "-O: "+std::to_string(stats.rewrites)+" instructions rewritten, "+std::to_string(stats.bytes)+" bytes and "+
+           std::to_string(stats.cycles)+" cycles saved";
 }
 
-
-
 /**
- * @brief Looks up the byte size of an instruction mnemonic from the i8080 instruction table.
- * @param instruction Mnemonic string (must match table key format).
- * @return Size in bytes if found; 0 if not found.
+ * @brief Writes the assembled output and stores it, with the warnings (and the -O report), in the cache. A source that read other files
+ *        is not stored, since the key only covers the source itself.
+ * @param workingFile Assembled file context after assemble() succeeded.
+ * @param format Output format.
+ * @param path Destination file, or "-" for stdout.
+ * @param cache Output cache.
+ * @param key Cache key of the source.
+ * @return true if the output was written; false otherwise (a failed store only skips the cache).
  */
-uint8_t get_instruction_size(const std::string& instruction){
-    auto instructionEntry = i8080Instructions.find(instruction);
-    if(instructionEntry == i8080Instructions.end()){
-        return 0;
+bool write_and_cache(const AssembledFile& workingFile,OutputFormat format,const std::string& path,const OutputCache& cache,const std::string& key){
+    std::string output = render_assembled_file(workingFile,format);
+    std::string messages;
+    for(const Diagnostic& warning : workingFile.diagnostics){
+        messages += format_diagnostic(warning) + "\n";
     }
-    return instructionEntry -> second.size;
-}
-
-/**
- * @brief Parses a raw assembly source line into label/opcode/arg1/arg2 and determines instruction size.
- *        Strips ';' comments, supports labels ending with ':', and splits operands on ','.
- * @param line Raw source line text.
- * @param workingFile Assembled file context (used for line number and error reporting).
- * @return ParsedLine containing parsed fields and computed instruction size (0 for label-only).
- */
-ParsedLine parse(std::string line,AssembledFile& workingFile){
-    // Strip comment first
-    auto commentPos = line.find(';');
-    if (commentPos != std::string::npos) {
-        line.erase(commentPos);
-    }
-
-    std::string label,op,a1,a2;
-    uint8_t Size;
-    // LABEL
-    size_t pos = line.find(':');
-    if (pos != std::string::npos) {
-        label = line.substr(0, pos);
-        trim(label);
-        line.erase(0, pos + 1);
-    }
-    // OP
-    ltrim(line);
-    pos = line.find_first_of(" \t");;
-    if (pos != std::string::npos) {
-        op = line.substr(0, pos);
-        trim(op);
-        line.erase(0, pos + 1);
-    } else {
-        op = line;
-        line.clear();
-        trim(op);
-    }
-    to_upper(op);
-    // ARG1
-    ltrim(line);
-    pos = line.find(',');
-    if (pos != std::string::npos) {
-        a1 = line.substr(0, pos);
-        trim(a1);
-        line.erase(0, pos + 1);
-    } else {
-        a1 = line;
-        line.clear();
-        trim(a1);
-    }
-
-    // ARG2 / COMMENT
-    //at this point, line will just be a2 as we stripped everything else.
-    a2 = line;
-    trim(a2);
-
-    //FINDING SIZE
-    //check to see if the line is just a label
-    if(op.empty()){
-        Size = 0;
-    }
-    //otherwise, the size depends on the opcode
-    else{
-        Size = get_instruction_size(op);
-        //get_instruction_size returns 0 if the opcode is not found in the size table
-        if(Size == 0){
-            err("Error: opcode not found in size table during pass 1",workingFile.lineNum);
-        }
+    if(workingFile.optimize){
+        messages += optimization_report(workingFile) + "\n";
+    }
+    if(workingFile.includedFiles.empty()){
+        cache.store(key,messages,output);
     }
-    return ParsedLine(label,op,a1,a2,Size);
+    return write_output(path,output);
 }
 
-
-
 /**
 *
-*BUILDING OPCODES
+*SOURCE OPTIONS
 *
 **/
 
 
 
+//Command line settings that change what a source assembles to, the same for every file of a run
+struct SourceOptions{
+    //-D names; the names view argv
+    std::vector<std::pair<std::string_view,uint16_t>> defines;
+    //-O: run the peephole pass
+    bool optimize = false;
+};
+
 /**
- * @brief Validates that a numeric string is parseable as an unsigned value that fits in a given byte width.
- *        Supports hex with suffix 'h' or prefix '0x'. Decimal otherwise.
- * @param number Numeric text (e.g., "255", "0FFh", "0xFF").
- * @param byteSize Size in bytes to validate against (1 for 8-bit, 2 for 16-bit).
- * @return true if parseable and within range; false otherwise.
+ * @brief Parses the argument of -D: NAME or NAME=value, value decimal or 0x hex (1 when left out).
+ * @param text Argument; the name views it, so it must outlive assembly (argv does).
+ * @param defines Receives the name and value.
+ * @return true if the argument is well formed; false otherwise.
  */
-bool check_valid_byte(const std::string& number, int byteSize) {
-    std::string s = number;
-    int base = 10;
-
-    // Detect hex suffix (Intel style)
-    if (!s.empty() && (s.back() == 'h' || s.back() == 'H')) {
-        base = 16;
-        s.pop_back();
-        if (s.empty()) return false;
-    }
-    // Detect hex prefix (C style)
-    else if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
-        base = 16;
-        s = s.substr(2);
-        if (s.empty()) return false;
-    }
-
-    int n;
-    size_t pos = 0;
-
-    try {
-        n = std::stoi(s, &pos, base);
-    } catch (const std::exception&) {
-        return false;
-    }
-
-    // Reject partial parses (e.g. "12G", "5abc")
-    if (pos != s.size()) {
+bool parse_define(std::string_view text,std::vector<std::pair<std::string_view,uint16_t>>& defines){
+    size_t equals = text.find('=');
+    std::string_view name = text.substr(0,equals);
+    if(name.empty()){
         return false;
     }
-
-    // Range check
-    int maxValue = (1 << (byteSize * 8)) - 1;
-    if (n < 0 || n > maxValue) {
-        return false;
+    unsigned long value = 1;
+    if(equals != std::string_view::npos){
+        std::string valueText(text.substr(equals + 1));
+        char* end = nullptr;
+        value = std::strtoul(valueText.c_str(),&end,0);
+        if(valueText.empty() || *end != '\0' || value > 0xFFFF){
+            return false;
+        }
     }
-
+    defines.emplace_back(name,static_cast<uint16_t>(value));
     return true;
 }
 
 /**
- * @brief Converts a 16-bit numeric string into two bytes in little-endian order (low, then high).
- * @param value Numeric text representing a 16-bit value (decimal or hex formats supported by helpers).
- * @param workingFile Current assembled file context (used for line number and error reporting).
- * @return Vector of 2 bytes: {lowByte, highByte}.
+ * @brief Spells out the options for the cache key, since they change the output as much as the source does.
+ * @param options Source options.
+ * @return One NAME=value per define, then -O if given, one per line.
  */
-std::vector<uint8_t> to_little_endian(std::string value,AssembledFile& workingFile){
-    uint8_t high_byte;
-    uint8_t low_byte;
-    if(!check_valid_byte(value,2)){
-        err("value ["+value+"] is not a valid 16bit byte and could not be converted to little endian.",workingFile.lineNum);
-    }
-    uint16_t byte = parse_uint<uint16_t>(value);
-    // Extract the high byte (most significant)
-    // Shift the 16-bit value right by 8 bits (0x1234 -> 0x0012)
-    high_byte = static_cast<uint8_t>(byte >> 8);
-
-    // Extract the low byte (least significant)
-    // Use AND mask to get only the rightmost 8 bits (0x1234 & 0x00FF -> 0x0034)
-    low_byte = static_cast<uint8_t>(byte & 0xFF);
-
-    std::vector<uint8_t> littleEndian = {low_byte,high_byte};
-    return littleEndian;
+std::string options_key(const SourceOptions& options){
+    std::string key;
+    for(const auto& define : options.defines){
+        key += std::string(define.first) + "=" + std::to_string(define.second) + "\n";
+    }
+    if(options.optimize){
+        key += "-O\n";
+    }
+    return key;
 }
 
 /**
- * @brief Builds the 8-bit opcode from the instruction's bitPattern, consuming register/immediate fields.
- *        The bitPattern may contain literals ('0','1') and placeholders (D,S,R,N) that are filled from operands.
- * @param currentLine Parsed line (arguments may be cleared as placeholders are consumed).
- * @param workingFile Assembled file context (used for symbol tables and error reporting).
- * @return The encoded opcode byte.
+ * @brief Sets the options on a file before it is assembled.
+ * @param options Source options.
+ * @param workingFile Assembled file context.
+ * @return None.
  */
-uint8_t build_opcode(ParsedLine& currentLine,AssembledFile& workingFile){
-    auto it = i8080Instructions.find(currentLine.opcode);
-    //if the current lines opcode is not recognized, then the user input an unrecognized mnemonic and we should exit.
-    if(it == i8080Instructions.end()){
-        err("Error, ["+currentLine.opcode+"] is not a recognized mnemonic.",workingFile.lineNum);
-    }
-    const std::string& bitPattern = it -> second.bitPattern;
-    uint8_t opcode = 0;
-    for(char c : bitPattern){
-        switch(c){
-            case '1': opcode <<= 1;opcode |= 1;break;
-            case '0': opcode <<= 1;break;
-            case 'D':{
-                //if no a1, error out
-                if(currentLine.argument1.empty()){
-                    err("Error, mnemonic ["+currentLine.opcode+"] expects an argument.",workingFile.lineNum);
-                }
-                auto reg = regCode.find(currentLine.argument1);
-                //if a1 didnt exist in regCodes, error out
-                if(reg == regCode.end()){
-                    err("Error, reg code ["+currentLine.argument1+"] is not recognized",workingFile.lineNum);
-                }
-                //shift out of the DDD section of the bit pattern.
-                opcode <<= 3;
-                //mask regCode into our opcode
-                opcode |= static_cast<uint8_t>(reg->second)&0b111;
-                //clear the argument so future steps dont flag this as an argument that should not exist.
-                currentLine.argument1.clear();
-                break;}
-            case 'S':{
-                //if no a2, error out
-                if(currentLine.argument2.empty()){
-                    err("Error, mnemonic ["+currentLine.opcode+"] expects a second argument.",workingFile.lineNum);
-                }
-                auto reg = regCode.find(currentLine.argument2);
-                //if a2 didnt exist in regCodes, error out
-                if(reg == regCode.end()){
-                    err("Error, reg code ["+currentLine.argument2+"] is not recognized",workingFile.lineNum);
-                }
-                //shift out of the SSS section of the bit pattern.
-                opcode <<= 3;
-                //mask regCode into our opcode
-                opcode |= static_cast<uint8_t>(reg->second)&0b111;
-                currentLine.argument2.clear();
-                break;}
-            case 'R':{
-                //if no a1, error out
-                if(currentLine.argument1.empty()){
-                    err("Error, mnemonic ["+currentLine.opcode+"] expects an argument.",workingFile.lineNum);
-                }
-                auto regp = rpCode.find(currentLine.argument1);
-                //if a1 didnt exist in regCodes, error out
-                if(regp == rpCode.end()){
-                    err("Error, rp code ["+currentLine.argument1+"] is not recognized",workingFile.lineNum);
-                }
-                //shift out of the RP section of the bit pattern.
-                opcode <<= 2;
-                //mask regCode into our opcode
-                opcode |= static_cast<uint8_t>(regp->second)& 0b11;
-                currentLine.argument1.clear();
-                break;}
-            case 'N':{
-                //if no a1, error out
-                if(currentLine.argument1.empty()){
-                    err("Error, mnemonic ["+currentLine.opcode+"] expects an argument.",workingFile.lineNum);
-                }
-                bool valid_8_bit = check_valid_byte(currentLine.argument1,1);
-                if(!valid_8_bit){
-                    err("Error, RST expects a number 07.", workingFile.lineNum);
-                }
-                //its safe to cast this to integer because check_valid_byte already checks to make sure the argument is a valid number
-                if(std::stoi(currentLine.argument1) > 7 || std::stoi(currentLine.argument1) < 0){
-                    err("Error, RST expects a number 0 to 7.", workingFile.lineNum);
-                }
-                opcode <<= 3;
-                opcode |= static_cast<uint8_t>(std::stoi(currentLine.argument1))&0b111;
-                currentLine.argument1.clear();
-                break;
-            }
-        }
-    }
-    return opcode;
+void apply_options(const SourceOptions& options,AssembledFile& workingFile){
+    workingFile.defines = options.defines;
+    workingFile.optimize = options.optimize;
 }
 
 
 
 /**
 *
-*BUILDING OPERANDS
+*WATCH MODE
 *
 **/
 
 
 
 /**
- * @brief Builds the operand byte(s) for the current line (immediates or label addresses).
- *        Resolves labels from the symbol table; otherwise parses 8-bit or 16-bit numeric literals.
- *        16-bit operands are returned little-endian (low, high).
- * @param currentLine Parsed line (expects remaining operand in argument1 if present).
- * @param workingFile Assembled file context (symbol table + error reporting).
- * @return Vector of operand bytes (0, 1, or 2 bytes depending on operand type).
+ * @brief Reads the write times of the files the last assembly included.
+ * @param workingFile Last assembled file.
+ * @return (path, write time) for each of its included files.
  */
-std::vector<uint8_t> build_operand(ParsedLine& currentLine,AssembledFile& workingFile){
-    //operands are in little endian notation
-    std::vector<uint8_t> operandVector;
-    if(!currentLine.argument1.empty()){
-        //if we find argument1 in our symbol table, then that is the value we want to return
-        auto symbolLookup = workingFile.symbolTable.find(currentLine.argument1);
-        if(symbolLookup != workingFile.symbolTable.end()){
-            operandVector = to_little_endian(std::to_string(symbolLookup -> second),workingFile);
-        }
-        //if it is not in the symbol table
-        else{
-            //if its a valid 8bit number, then we add it to our operand vector
-            if(check_valid_byte(currentLine.argument1,1)){
-                uint8_t parsedByte = parse_uint<uint8_t>(currentLine.argument1);
-                operandVector.push_back(parsedByte);
-            }
-            //if its a valid 16-bit number then we do exactly what we did with a symbol address.
-            else if(check_valid_byte(currentLine.argument1,2)){
-                operandVector = to_little_endian(currentLine.argument1,workingFile);
+std::vector<std::pair<std::string,std::filesystem::file_time_type>> included_write_times(const AssembledFile& workingFile){
+    std::vector<std::pair<std::string,std::filesystem::file_time_type>> times;
+    std::error_code ignored;
+    for(const std::string& path : workingFile.includedFiles){
+        times.emplace_back(path,std::filesystem::last_write_time(path,ignored));
+    }
+    return times;
+}
+
+/**
+ * @brief Watches a source file and the files it includes, and re-assembles it whenever one of them changes,
+ *        rewriting the output each time. A change to the source is applied incrementally; a change to an included
+ *        file reloads the whole source.
+ * @param inputPath Source file path.
+ * @param outputPath Output file path.
+ * @param format Output format.
+ * @return Exit code (only returns if the file cannot be read).
+ */
+int run_watch(const std::string& inputPath,const std::string& outputPath,OutputFormat format){
+    IncrementalAssembly assembly;
+    std::string directory = std::filesystem::path(inputPath).parent_path().string();
+    std::error_code ignored;
+    auto lastWrite = std::filesystem::last_write_time(inputPath,ignored);
+    std::vector<std::pair<std::string,std::filesystem::file_time_type>> includedWrites;
+    bool reload = true;
+    while(true){
+        MappedFile source;
+        if(!source.open(inputPath)){
+            std::cout << inputPath << " could not be opened." << std::endl;
+            return 1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        try{
+            size_t encoded;
+            if(reload){
+                assembly.load(source.view(),directory);
+                encoded = assembly.file().parsedLines.size();
             }
             else{
-                err("Unrecognized symbol ["+currentLine.argument1+"]",workingFile.lineNum);
+                encoded = assembly.update(source.view());
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+            if(!write_assembled_file(assembly.file(),format,outputPath)){
+                std::cout << outputPath << " could not be written." << std::endl;
+            }
+            std::cout << inputPath << ": " << encoded << " lines encoded in " << elapsed.count() << " us" << std::endl;
+        }
+        catch(const AssemblyError& error){
+            std::cout << inputPath << ": " << format_error(error) << std::endl;
+        }
+        includedWrites = included_write_times(assembly.file());
+        reload = false;
+        source.close();
+        //poll for the next save of the source or of a file it includes
+        while(true){
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            auto writeTime = std::filesystem::last_write_time(inputPath,ignored);
+            if(writeTime != lastWrite){
+                lastWrite = writeTime;
+                break;
+            }
+            for(const auto& included : includedWrites){
+                if(std::filesystem::last_write_time(included.first,ignored) != included.second){
+                    reload = true;
+                    break;
+                }
+            }
+            if(reload){
+                break;
             }
         }
     }
-    return operandVector;
 }
 
 
 
-
 /**
 *
-*CORE LOGIC AND ENTRY POINT
+*BATCH MODE
 *
 **/
 
 
 
+//Outcome of assembling one file in batch mode, kept so results are reported in input order
+struct FileReport{
+    bool ok = false;
+    //warnings and errors, one per line
+    std::string log;
+};
+
 /**
- * @brief Assembles the given source lines into machine code using a two-pass strategy.
- *        Pass 1 builds the symbol table (labels -> PC). Pass 2 encodes opcodes and operands into output.
- * @param workingFile Assembled file context containing input lines and receiving output bytes.
- * @return None (writes into workingFile.output and workingFile.symbolTable).
+ * @brief Works out where batch mode writes the output for an input file: the input path
+ *        (or just its file name inside outputDir) with the extension replaced by the format's.
+ * @param inputPath Source file path.
+ * @param outputDir Directory for outputs; empty to write next to each input.
+ * @param format Output format.
+ * @return Output file path.
  */
-void assemble(AssembledFile& workingFile){
-    //PASS 1: Linking labels
-    uint16_t PC = 0;
-    std::vector<ParsedLine> allLines;
-    for(; workingFile.lineNum < workingFile.lines.size();workingFile.lineNum++){
-        ParsedLine currentLineInfo = parse(workingFile.lines[workingFile.lineNum],workingFile);
-        check_and_add_symbol_reference(currentLineInfo,PC,workingFile);
-        PC += currentLineInfo.instructionSize;
-    }
-    //Reset lineNum and PC
-    workingFile.lineNum = 0;
-    PC = 0;
-    //PASS 2: Build the output file
-    for(; workingFile.lineNum < workingFile.lines.size(); workingFile.lineNum++){
-        ParsedLine currentLineInfo = parse(workingFile.lines[workingFile.lineNum],workingFile);
-        if(currentLineInfo.opcode.empty()){
-            std::cout << "Warning on line " + std::to_string(workingFile.lineNum+1) + ", no opcode" << std::endl;
-            continue;
+std::string batch_output_path(const std::string& inputPath,const std::string& outputDir,OutputFormat format){
+    size_t nameStart = inputPath.find_last_of("/\\");
+    nameStart = nameStart == std::string::npos ? 0 : nameStart + 1;
+    size_t dot = inputPath.find_last_of('.');
+    size_t stemEnd = dot == std::string::npos || dot < nameStart ? inputPath.size() : dot;
+    std::string path;
+    if(outputDir.empty()){
+        path = inputPath.substr(0,stemEnd);
+    }
+    else{
+        path = outputDir;
+        if(path.back() != '/' && path.back() != '\\'){
+            path += '/';
         }
-        uint8_t opcode = build_opcode(currentLineInfo,workingFile);
-        //now that we have built the opcode and consumed any arguments that process used, we can count how many operands the user gave the opcode.
-        currentLineInfo.set_operand_count();
-        //check to make sure the user sent the appropriate amount of operands for this opcode
-        //if the size is 1, we should expect no operands left after building the opcode
-        if(currentLineInfo.instructionSize == 1 && currentLineInfo.operandCount != 0){
-            err("Error, mnemonic ["+currentLineInfo.opcode+"] expects 0 operands but was passed "+std::to_string(currentLineInfo.operandCount),workingFile.lineNum);
+        path += inputPath.substr(nameStart,stemEnd - nameStart);
+    }
+    return path + format_extension(format);
+}
+
+/**
+ * @brief Assembles one file and writes its output, collecting every message instead of printing it.
+ *        Safe to run on several files at once: each call owns all of its state.
+ * @param inputPath Source file path.
+ * @param outputPath Output file path.
+ * @param format Output format.
+ * @param cache Output cache to look the source up in first, or nullptr.
+ * @param options Source options.
+ * @return Whether the file was assembled and written, plus its messages.
+ */
+FileReport assemble_file(const std::string& inputPath,const std::string& outputPath,OutputFormat format,const OutputCache* cache,
+                         const SourceOptions& options){
+    FileReport report;
+    MappedFile source;
+    if(!source.open(inputPath)){
+        report.log = inputPath + " could not be opened.\n";
+        return report;
+    }
+    std::string key;
+    if(cache != nullptr){
+        key = OutputCache::key(source.view(),format,options_key(options));
+        CachedOutput entry;
+        if(cache->lookup(key,entry)){
+            for(std::string_view message : split_lines(entry.messages)){
+                report.log += inputPath + ": " + std::string(message) + "\n";
+            }
+            report.ok = write_output(outputPath,entry.output);
+            if(!report.ok){
+                report.log += outputPath + " could not be written.\n";
+            }
+            return report;
         }
-        //if the size is greater than 1, we should expect 1 operand left after building the opcode
-        else if(currentLineInfo.instructionSize > 1 && currentLineInfo.operandCount != 1){
-            err("Error, mnemonic ["+currentLineInfo.opcode+"] expects 1 operands but was passed "+std::to_string(currentLineInfo.operandCount),workingFile.lineNum);
+    }
+    AssembledFile currentFile(split_lines(source.view()));
+    currentFile.relocatable = format == OutputFormat::Object;
+    apply_options(options,currentFile);
+    currentFile.directory = std::filesystem::path(inputPath).parent_path().string();
+    try{
+        assemble(currentFile);
+    }
+    catch(const AssemblyError& error){
+        for(const Diagnostic& warning : currentFile.diagnostics){
+            report.log += inputPath + ": " + format_diagnostic(warning) + "\n";
         }
-        //at this point, we should only have 1 operand that we need to translate. Were going to move it to argument1 if its not there already
-        if(currentLineInfo.argument1.empty()){
-            currentLineInfo.argument1 = currentLineInfo.argument2;
+        report.log += inputPath + ": " + format_error(error) + "\n";
+        return report;
+    }
+    for(const Diagnostic& warning : currentFile.diagnostics){
+        report.log += inputPath + ": " + format_diagnostic(warning) + "\n";
+    }
+    if(options.optimize){
+        report.log += inputPath + ": " + optimization_report(currentFile) + "\n";
+    }
+    bool written = cache != nullptr ? write_and_cache(currentFile,format,outputPath,*cache,key) :
+                                      write_assembled_file(currentFile,format,outputPath);
+    if(!written){
+        report.log += outputPath + " could not be written.\n";
+        return report;
+    }
+    report.ok = true;
+    return report;
+}
+
+/**
+ * @brief Adds the paths listed in a manifest file (one per line, blank lines and ';' comments ignored).
+ * @param manifestPath Manifest file path.
+ * @param inputs Receives the listed paths.
+ * @return true if the manifest could be read; false otherwise.
+ */
+bool read_manifest(const std::string& manifestPath,std::vector<std::string>& inputs){
+    MappedFile manifest;
+    if(!manifest.open(manifestPath)){
+        return false;
+    }
+    for(std::string_view line : split_lines(manifest.view())){
+        line = trim(line.substr(0,line.find(';')));
+        if(!line.empty()){
+            inputs.emplace_back(line);
         }
-        //get the bytes for the operands
-        std::vector<uint8_t> operandBytes = build_operand(currentLineInfo,workingFile);
-        //check for mismatch in operand types (expecting 8 bit or 16 bit)
-        if(currentLineInfo.instructionSize-1 != operandBytes.size()){
-            err("Error, mismatch in operand type and opcode ["+currentLineInfo.opcode+"] expectation",workingFile.lineNum);
+    }
+    return true;
+}
+
+/**
+ * @brief Assembles every input on a thread pool, one task per file, then reports the results in input order.
+ *        The ISA tables are constexpr, so all workers share them without any setup.
+ * @param inputs Source file paths.
+ * @param outputDir Directory for outputs; empty to write next to each input.
+ * @param format Output format.
+ * @param threadCount Number of worker threads (0 for one per hardware thread).
+ * @param cache Output cache, or nullptr.
+ * @param options Source options.
+ * @return Exit code (0 if every file assembled, 1 otherwise).
+ */
+int run_batch(const std::vector<std::string>& inputs,const std::string& outputDir,OutputFormat format,unsigned threadCount,const OutputCache* cache,
+              const SourceOptions& options){
+    std::vector<FileReport> reports(inputs.size());
+    {
+        ThreadPool pool(threadCount);
+        pool.parallel_for(inputs.size(),[&](size_t i){
+            reports[i] = assemble_file(inputs[i],batch_output_path(inputs[i],outputDir,format),format,cache,options);
+        });
+    }
+    size_t failed = 0;
+    for(const FileReport& report : reports){
+        std::cout << report.log;
+        if(!report.ok){
+            failed++;
         }
-        //add the bytes into the output file
-        workingFile.output.push_back(opcode);
-        workingFile.output.insert(workingFile.output.end(),operandBytes.begin(),operandBytes.end());
     }
+    std::cout << "assembled " << inputs.size() - failed << " of " << inputs.size() << " files" << std::endl;
+    return failed == 0 ? 0 : 1;
 }
 
+
+
 /**
- * @brief Prints an 8-bit value as binary (MSB first) to stdout.
- * @param value Byte to print.
- * @return None.
+ * @brief Assembles a source piped into stdin and writes the output.
+ * @param format Output format (anything but a listing, which needs the source lines).
+ * @param outputPath Destination file, or "-" for stdout.
+ * @param options Source options (-O does not apply to a stream).
+ * @return Exit code (0 on success, non-zero on failure).
  */
-void printBits(uint8_t value) {
-    for (int i = 7; i >= 0; --i) {
-        std::cout << ((value >> i) & 1);
+int assemble_stdin(OutputFormat format,const std::string& outputPath,const SourceOptions& options){
+    if(format == OutputFormat::Listing){
+        std::cout << "a listing needs a source file, not stdin" << std::endl;
+        return 1;
     }
-    std::cout << '\n';
+    //output written to stdout keeps it to itself; messages then go to stderr
+    std::ostream& messages = outputPath == "-" ? std::cerr : std::cout;
+    AssembledFile currentFile;
+    currentFile.relocatable = format == OutputFormat::Object;
+    apply_options(options,currentFile);
+    try{
+        if(!assemble_stream(stdin,currentFile)){
+            messages << "stdin could not be read." << std::endl;
+            return 1;
+        }
+    }
+    catch(const AssemblyError& error){
+        for(const Diagnostic& warning : currentFile.diagnostics){
+            messages << format_diagnostic(warning) << std::endl;
+        }
+        messages << format_error(error) << std::endl;
+        return 1;
+    }
+    for(const Diagnostic& warning : currentFile.diagnostics){
+        messages << format_diagnostic(warning) << std::endl;
+    }
+    if(!write_assembled_file(currentFile,format,outputPath)){
+        messages << outputPath << " could not be written." << std::endl;
+        return 1;
+    }
+    return 0;
 }
 
+
+
 /**
- * @brief Program entry point. Loads a source file from argv[1], assembles it, and prints output bytes as bits.
+ * @brief Program entry point. Maps a source file, assembles it, and writes the output.
+ *        Usage: 8080Assembler <file|-> [-o <output>] [-f bits|bin|hex|lst|obj] [-D NAME[=value]]... [-O] [--map <file>] [--timing <file>] [--stats] [--cache <dir>]
+ *               8080Assembler --batch [-j <threads>] [-o <dir>] [-f bin|hex|lst|bits|obj] [-D NAME[=value]]... [-O] [--cache <dir>] <file|@manifest>...
+ *               8080Assembler --watch <file> -o <output> [-f bin|hex|lst|bits]
+ *               8080Assembler --daemon <socket>
+ *               8080Assembler --self-check
+ *        Without -o (or with -o -) the output is printed to stdout, as bits unless -f is given, and warnings, errors
+ *        and the -O report go to stderr. With -o the format follows the output file's extension (.hex/.ihx Intel HEX, .lst listing, .obj relocatable object, otherwise raw binary)
+ *        unless -f is given. Object files are linked into an image by 8080Link.
+ *        Batch mode writes each output next to its input (or into -o <dir>), binary unless -f is given.
+ *        A file name of - reads the source from stdin.
+ *        -D defines NAME as a constant (1 unless a value is given) before the first line, to pick a variant with
+ *        IF/IFDEF without editing the source.
+ *        -O runs the peephole pass (see optimize_line) and reports the bytes and cycles it saved.
+ *        --map also writes a binary source map (see SourceMap.h) built from the same per-line records as the listing.
+ *        --timing also writes a report of the T-states of every line, label-delimited block and counted loop
+ *        (see render_timing).
+ *        --stats prints, to stderr, the time spent loading, in each pass and writing, the heap allocations, how the
+ *        symbol table's buckets fill and how often operands were looked up (see render_stats).
+ *        With --cache, a source whose output is in the cache directory is not assembled: the cached output is
+ *        written instead, and new outputs are added to the cache (see OutputCache) unless the source reads other files
+ *        with INCLUDE or INCBIN.
+ *        Watch mode re-assembles incrementally and rewrites the output every time the file, or a file it includes, is
+ *        saved.
+ *        Daemon mode serves requests on a Unix domain socket instead (see run_daemon).
+ *        --self-check runs the built-in checks (see run_self_checks) and exits non-zero if any fails.
  * @param argc Argument count (expects at least 2).
  * @param argv Argument values (argv[1] should be input file path).
  * @return Exit code (0 on success, non-zero on failure).
@@ -637,26 +567,210 @@ int main(int argc, char* argv[]){
         return 1;
     }
 
-    //open the file
-    std::string FilePath = argv[1];
-    std::ifstream infile(FilePath);
+    std::string FilePath;
+    std::string OutputPath = "-";
+    OutputFormat format = OutputFormat::Bits;
+    bool formatGiven = false;
+    bool batch = false;
+    bool watch = false;
+    bool stats = false;
+    unsigned threadCount = 0;
+    std::string MapPath;
+    std::string TimingPath;
+    std::unique_ptr<OutputCache> cache;
+    SourceOptions options;
+    std::vector<std::string> batchInputs;
+    for(int i = 1; i < argc; i++){
+        std::string_view arg = argv[i];
+        if(arg == "--batch"){
+            batch = true;
+        }
+        else if(arg == "--watch"){
+            watch = true;
+        }
+        else if(arg == "-j" && i + 1 < argc){
+            threadCount = static_cast<unsigned>(std::strtoul(argv[++i],nullptr,10));
+        }
+        else if(arg == "-o" && i + 1 < argc){
+            OutputPath = argv[++i];
+        }
+        else if(arg == "--daemon" && i + 1 < argc){
+            return run_daemon(argv[++i]);
+        }
+        else if(arg == "--self-check"){
+            return run_self_checks() == 0 ? 0 : 1;
+        }
+        else if(arg == "--map" && i + 1 < argc){
+            MapPath = argv[++i];
+        }
+        else if(arg == "--timing" && i + 1 < argc){
+            TimingPath = argv[++i];
+        }
+        else if(arg == "-D" && i + 1 < argc){
+            if(!parse_define(argv[++i],options.defines)){
+                std::cout << "Bad define " << argv[i] << ", expected NAME or NAME=value (up to 0xFFFF)" << std::endl;
+                return 1;
+            }
+        }
+        else if(arg == "--stats"){
+            stats = true;
+        }
+        else if(arg == "-O"){
+            options.optimize = true;
+        }
+        else if(arg == "--cache" && i + 1 < argc){
+            cache = std::make_unique<OutputCache>(argv[++i]);
+        }
+        else if(arg == "-f" && i + 1 < argc){
+            if(!parse_output_format(argv[++i],format)){
+                std::cout << "Unknown output format " << argv[i] << ", expected bits, bin, hex, lst or obj" << std::endl;
+                return 1;
+            }
+            formatGiven = true;
+        }
+        else if(arg.size() > 1 && arg[0] == '@'){
+            if(!read_manifest(std::string(arg.substr(1)),batchInputs)){
+                std::cout << arg.substr(1) << " could not be opened." << std::endl;
+                return 1;
+            }
+        }
+        else if(arg.size() > 1 && arg[0] == '-'){
+            //a misspelled flag, or one missing its value, must not be taken for a source file
+            std::cout << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+        else{
+            FilePath = argv[i];
+            batchInputs.push_back(FilePath);
+        }
+    }
+    if(!batch && batchInputs.size() > 1){
+        std::cout << "only one source file can be given without --batch" << std::endl;
+        return 1;
+    }
+    if(stats && (batch || watch || FilePath == "-")){
+        std::cout << "--stats needs a single source file" << std::endl;
+        return 1;
+    }
+    if(batch){
+        return run_batch(batchInputs,OutputPath == "-" ? "" : OutputPath,formatGiven ? format : OutputFormat::Binary,threadCount,cache.get(),options);
+    }
+    if(!formatGiven && OutputPath != "-"){
+        format = format_from_extension(OutputPath);
+    }
+    if(watch){
+        if(OutputPath == "-"){
+            std::cout << "--watch needs an output file (-o)" << std::endl;
+            return 1;
+        }
+        if(format == OutputFormat::Object){
+            std::cout << "--watch cannot write an object file" << std::endl;
+            return 1;
+        }
+        if(!options.defines.empty() || options.optimize){
+            std::cout << "--watch does not take -D or -O" << std::endl;
+            return 1;
+        }
+        return run_watch(FilePath,OutputPath,format);
+    }
+
+    //"-" streams the source from stdin in one pass without holding its lines
+    if(FilePath == "-"){
+        if(!MapPath.empty() || !TimingPath.empty()){
+            std::cout << "a source map or timing report needs a source file, not stdin" << std::endl;
+            return 1;
+        }
+        if(options.optimize){
+            std::cout << "-O needs a source file, not stdin" << std::endl;
+            return 1;
+        }
+        return assemble_stdin(format,OutputPath,options);
+    }
+
+    //output written to stdout keeps it to itself; messages then go to stderr
+    std::ostream& messages = OutputPath == "-" ? std::cerr : std::cout;
+    RunStats run;
+    AssemblyCounters counters;
+    count_allocations(stats);
+    auto loadStart = std::chrono::steady_clock::now();
+    //map the file, the passes read the source straight out of the mapping
+    MappedFile source;
     //if the file could not be opened, print an error
-    if(infile.good() == false){
-        std::cout << FilePath << " could not be opened." << std::endl;
+    if(!source.open(FilePath)){
+        messages << FilePath << " could not be opened." << std::endl;
         //exit the program
         return 1;
     }
+    //an unchanged source is answered from the cache without assembling it (a source map, timing report or stats need the
+    //assembled lines)
+    std::string key;
+    bool cached = cache != nullptr && MapPath.empty() && TimingPath.empty() && !stats;
+    if(cached){
+        key = OutputCache::key(source.view(),format,options_key(options));
+        CachedOutput entry;
+        if(cache->lookup(key,entry)){
+            messages << entry.messages;
+            if(!write_output(OutputPath,entry.output)){
+                messages << OutputPath << " could not be written." << std::endl;
+                return 1;
+            }
+            return 0;
+        }
+    }
 
     //we want to split the contents of the file into an array of lines
-    //rather than writing my own dynamically resizing array, I will just use a vector.
-    std::vector<std::string> lines;
-    std::string currentLine;
-    while(std::getline(infile,currentLine)){
-        lines.push_back(currentLine);
+    AssembledFile currentFile(split_lines(source.view()));
+    run.loadNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - loadStart).count();
+    currentFile.relocatable = format == OutputFormat::Object;
+    apply_options(options,currentFile);
+    if(stats){
+        currentFile.counters = &counters;
+    }
+    //INCLUDE and INCBIN names are relative to the source file
+    currentFile.directory = std::filesystem::path(FilePath).parent_path().string();
+    //a single large file is split across all cores
+    std::unique_ptr<ThreadPool> pool;
+    if(currentFile.lines.size() >= PARALLEL_MIN_LINES){
+        pool = std::make_unique<ThreadPool>(threadCount);
+        currentFile.pool = pool.get();
+    }
+    try{
+        assemble(currentFile);
+    }
+    catch(const AssemblyError& error){
+        for(const Diagnostic& warning : currentFile.diagnostics){
+            messages << format_diagnostic(warning) << std::endl;
+        }
+        messages << format_error(error) << std::endl;
+        return 1;
+    }
+    for(const Diagnostic& warning : currentFile.diagnostics){
+        messages << format_diagnostic(warning) << std::endl;
+    }
+    if(options.optimize){
+        messages << optimization_report(currentFile) << std::endl;
     }
-    AssembledFile currentFile(lines);
-    assemble(currentFile);
-    for(int i = 0; i < currentFile.output.size(); i++){
-        printBits(currentFile.output[i]);
+    auto emitStart = std::chrono::steady_clock::now();
+    bool written = cached ? write_and_cache(currentFile,format,OutputPath,*cache,key) :
+                   write_assembled_file(currentFile,format,OutputPath);
+    run.emitNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - emitStart).count();
+    if(!written){
+        messages << OutputPath << " could not be written." << std::endl;
+        return 1;
+    }
+    if(stats){
+        count_allocations(false);
+        allocations_counted(run.allocations,run.allocatedBytes);
+        //stderr, so the bits written to stdout without -o stay clean
+        std::cerr << render_stats(currentFile,counters,run);
+    }
+    if(!MapPath.empty() && !write_output(MapPath,render_source_map(build_source_map(build_listing(currentFile))))){
+        messages << MapPath << " could not be written." << std::endl;
+        return 1;
+    }
+    if(!TimingPath.empty() && !write_output(TimingPath,render_timing(currentFile))){
+        messages << TimingPath << " could not be written." << std::endl;
+        return 1;
     }
+    return 0;
 }
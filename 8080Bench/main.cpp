@@ -0,0 +1,447 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include "i8080Assembler.h"
+#include "MappedFile.h"
+#include "OutputWriters.h"
+#include "ThreadPool.h"
+
+//Source sizes run when no --lines is given
+const size_t DEFAULT_LINE_COUNTS[] = {10000,100000,1000000,10000000};
+
+//A label is defined every LABEL_STRIDE lines, so a branch can name one further on before it exists
+const size_t LABEL_STRIDE = 8;
+
+//Bytes of code a source may hold: the 8080 addresses 64 KiB, and the assembler rejects code past FFFFh
+const size_t CODE_BUDGET = 0xF000;
+
+//Bytes an instruction line encodes to on average, for spreading the budget over a source
+const size_t AVERAGE_CODE_BYTES = 2;
+
+//What one generated source took in each phase, best of the repeats
+struct BenchmarkRun{
+    size_t lines = 0;
+    size_t sourceBytes = 0;
+    size_t outputBytes = 0;
+    //mapping the file and splitting it into lines
+    uint64_t loadNanoseconds = UINT64_MAX;
+    //AssembledFile::passNanoseconds
+    uint64_t pass1Nanoseconds = UINT64_MAX;
+    uint64_t pass2Nanoseconds = UINT64_MAX;
+    //writing the raw binary
+    uint64_t writeNanoseconds = UINT64_MAX;
+    //the chunked path ran (a file it cannot split falls back to the single pass)
+    bool chunked = false;
+};
+
+
+
+/**
+*
+*GENERATING SOURCES
+*
+**/
+
+
+
+//register names, in Reg order
+const char* const REGISTERS[] = {"B","C","D","E","H","L","M","A"};
+const char* const PAIRS[] = {"B","D","H","SP"};
+const char* const ALU_OPS[] = {"ADD","ADC","SUB","SBB","ANA","XRA","ORA","CMP"};
+const char* const IMMEDIATE_OPS[] = {"ADI","ACI","SUI","SBI","ANI","XRI","ORI","CPI"};
+const char* const BRANCHES[] = {"JMP","JZ","JNZ","JC","JNC","CALL","CZ","CNZ"};
+const char* const ADDRESS_OPS[] = {"LDA","STA","LHLD","SHLD"};
+const char* const SIMPLE_OPS[] = {"NOP","RET","XCHG","RLC","RAR","CMA","STC","EI"};
+const char* const COMMENTS[] = {"loop counter","save the result","next entry","check the flags","restore HL",
+                                "advance the pointer","table lookup","fall through"};
+
+/**
+ * @brief Picks one of a fixed array's entries.
+ * @param rng Generator.
+ * @param names Array to pick from.
+ * @return The entry.
+ */
+template<size_t N>
+const char* pick(std::mt19937& rng,const char* const (&names)[N]){
+    return names[rng() % N];
+}
+
+/**
+ * @brief Writes a byte value the way sources write them: decimal, hex with an h suffix or 0x prefix, or binary.
+ * @param rng Generator.
+ * @param value Value to write.
+ * @param out Receives the text.
+ * @return None.
+ */
+void put_number(std::mt19937& rng,unsigned value,std::string& out){
+    char text[24];
+    switch(rng() % 4){
+        case 0: std::snprintf(text,sizeof(text),"%u",value); break;
+        case 1: std::snprintf(text,sizeof(text),"0%02Xh",value); break;
+        case 2: std::snprintf(text,sizeof(text),"0x%02X",value); break;
+        default:{
+            int at = 0;
+            for(int bit = 7; bit >= 0; bit--){
+                text[at++] = static_cast<char>('0' + (value >> bit & 1));
+            }
+            text[at++] = 'b';
+            text[at] = '\0';
+        }
+    }
+    out += text;
+}
+
+/**
+ * @brief Generates a source that looks like hand-written 8080 code: register moves and arithmetic, immediates in
+ *        every base, 16-bit loads and stores, branches to labels on both sides (mostly ahead, which assemble as
+ *        forward references), full-line and trailing comments. std::mt19937's output is fixed by the standard, so a
+ *        seed gives the same source everywhere. A source too long to fit in the address space keeps CODE_BUDGET bytes
+ *        of code spread over its length, and the other lines are comments.
+ * @param lineCount Lines to generate.
+ * @param seed Generator seed.
+ * @return The source text.
+ */
+std::string generate_source(size_t lineCount,uint32_t seed){
+    std::mt19937 rng(seed);
+    size_t labelCount = (lineCount + LABEL_STRIDE - 1) / LABEL_STRIDE;
+    //share of the lines that may hold code, in millionths
+    uint64_t codeShare = std::min<uint64_t>(1000000,uint64_t(CODE_BUDGET) * 1000000 / (AVERAGE_CODE_BYTES * std::max<size_t>(lineCount,1)));
+    size_t codeBytes = 0;
+    std::string source;
+    source.reserve(lineCount * 24);
+    for(size_t i = 0; i < lineCount; i++){
+        size_t label = i / LABEL_STRIDE;
+        bool labelled = i % LABEL_STRIDE == 0;
+        if(labelled){
+            source += "L" + std::to_string(label) + ":";
+        }
+        source += '\t';
+        //filler is comments (and labels on otherwise empty lines), which the chunked path takes like code
+        if(codeBytes + 3 > CODE_BUDGET || rng() % 1000000 >= codeShare){
+            source += "; ";
+            source += pick(rng,COMMENTS);
+            source += '\n';
+            continue;
+        }
+        unsigned kind = rng() % 100;
+        if(kind < 8){
+            source += "; ";
+            source += pick(rng,COMMENTS);
+            source += '\n';
+            continue;
+        }
+        if(kind < 28){
+            //never MOV M,M, which is HLT
+            unsigned to = rng() % 8, from = rng() % 8;
+            if(to == 6 && from == 6){
+                from = 7;
+            }
+            source += "MOV ";
+            source += REGISTERS[to];
+            source += ',';
+            source += REGISTERS[from];
+            codeBytes += 1;
+        }
+        else if(kind < 40){
+            source += rng() % 3 == 0 ? (rng() % 2 ? "INR " : "DCR ") : std::string(pick(rng,ALU_OPS)) + " ";
+            source += pick(rng,REGISTERS);
+            codeBytes += 1;
+        }
+        else if(kind < 52){
+            source += "MVI ";
+            source += pick(rng,REGISTERS);
+            source += ',';
+            put_number(rng,rng() % 256,source);
+            codeBytes += 2;
+        }
+        else if(kind < 60){
+            source += pick(rng,IMMEDIATE_OPS);
+            source += ' ';
+            put_number(rng,rng() % 256,source);
+            codeBytes += 2;
+        }
+        else if(kind < 70){
+            //a hex number gets a leading 0 so it never starts with a letter
+            char text[24];
+            if(rng() % 2){
+                std::snprintf(text,sizeof(text),"LXI %s,0%04Xh",pick(rng,PAIRS),static_cast<unsigned>(rng() % 0x10000));
+            }
+            else{
+                std::snprintf(text,sizeof(text),"%s 0%04Xh",pick(rng,ADDRESS_OPS),static_cast<unsigned>(rng() % 0x10000));
+            }
+            source += text;
+            codeBytes += 3;
+        }
+        else if(kind < 88){
+            //three branches in four go forward
+            size_t target = rng() % 4 != 0 ? label + 1 + rng() % 4 : label - (label > 0 ? rng() % (label < 16 ? label : 16) : 0);
+            if(target >= labelCount){
+                target = labelCount - 1;
+            }
+            source += pick(rng,BRANCHES);
+            source += " L" + std::to_string(target);
+            codeBytes += 3;
+        }
+        else if(kind < 94){
+            source += rng() % 2 ? "PUSH " : "POP ";
+            source += rng() % 4 == 3 ? "PSW" : PAIRS[rng() % 3];
+            codeBytes += 1;
+        }
+        else{
+            source += pick(rng,SIMPLE_OPS);
+            codeBytes += 1;
+        }
+        if(rng() % 4 == 0){
+            source += "\t; ";
+            source += pick(rng,COMMENTS);
+        }
+        source += '\n';
+    }
+    return source;
+}
+
+
+
+/**
+*
+*MEASURING
+*
+**/
+
+
+
+/**
+ * @brief Gives the nanoseconds since a point in time.
+ * @param start Start of the measured span.
+ * @return Elapsed nanoseconds.
+ */
+uint64_t nanoseconds_since(std::chrono::steady_clock::time_point start){
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * @brief Keeps the faster of two timings.
+ * @param best Best timing so far.
+ * @param time New timing.
+ * @return None.
+ */
+void keep_best(uint64_t& best,uint64_t time){
+    if(time < best){
+        best = time;
+    }
+}
+
+/**
+ * @brief Loads, assembles and writes a source file repeatedly, keeping each phase's best time. The file is read
+ *        from the page cache after the first load.
+ * @param sourcePath Generated source.
+ * @param outputPath Where the binary goes.
+ * @param repeat Runs to take the best of.
+ * @param pool Pool for the chunked path, or nullptr for the single pass.
+ * @param run Receives the timings and sizes.
+ * @return true if every run assembled and wrote; false otherwise (after printing why).
+ */
+bool measure(const std::string& sourcePath,const std::string& outputPath,int repeat,ThreadPool* pool,BenchmarkRun& run){
+    for(int i = 0; i < repeat; i++){
+        auto start = std::chrono::steady_clock::now();
+        MappedFile source;
+        if(!source.open(sourcePath)){
+            std::cout << sourcePath << " could not be opened." << std::endl;
+            return false;
+        }
+        AssembledFile workingFile(split_lines(source.view()));
+        keep_best(run.loadNanoseconds,nanoseconds_since(start));
+        workingFile.pool = pool;
+        try{
+            assemble(workingFile);
+        }
+        catch(const AssemblyError& error){
+            std::cout << sourcePath << ": " << format_error(error) << std::endl;
+            return false;
+        }
+        keep_best(run.pass1Nanoseconds,workingFile.passNanoseconds[0]);
+        keep_best(run.pass2Nanoseconds,workingFile.passNanoseconds[1]);
+        start = std::chrono::steady_clock::now();
+        std::vector<ImageSegment> segments;
+        for(const Segment& segment : workingFile.segments){
+            segments.push_back({segment.origin,workingFile.output.data() + segment.offset,segment.size});
+        }
+        if(!write_image(outputPath,segments)){
+            std::cout << outputPath << " could not be written." << std::endl;
+            return false;
+        }
+        keep_best(run.writeNanoseconds,nanoseconds_since(start));
+        run.chunked = workingFile.currentPass == 2;
+        run.lines = workingFile.lines.size();
+        run.sourceBytes = source.view().size();
+        run.outputBytes = workingFile.output.size();
+    }
+    return true;
+}
+
+
+
+/**
+*
+*REPORTING
+*
+**/
+
+
+
+/**
+ * @brief Writes one phase as a JSON object: its time and its throughput over the source.
+ * @param name Phase name.
+ * @param nanoseconds Best time of the phase.
+ * @param run Run the phase belongs to.
+ * @param last No comma after the object.
+ * @param measured false for a phase the run did not have, written as null.
+ * @return The JSON text.
+ */
+std::string phase_json(const char* name,uint64_t nanoseconds,const BenchmarkRun& run,bool last,bool measured = true){
+    if(!measured){
+        return std::string("        \"") + name + "\": null" + (last ? "" : ",") + "\n";
+    }
+    double seconds = nanoseconds / 1e9;
+    //a phase too quick for the clock gets no throughput rather than an infinite one
+    double linesPerSecond = nanoseconds != 0 ? run.lines / seconds : 0;
+    double megabytesPerSecond = nanoseconds != 0 ? run.sourceBytes / 1e6 / seconds : 0;
+    char text[256];
+    std::snprintf(text,sizeof(text),"        \"%s\": {\"seconds\": %.6f, \"lines_per_second\": %.0f, \"mb_per_second\": %.2f}%s\n",
+                  name,seconds,linesPerSecond,megabytesPerSecond,last ? "" : ",");
+    return text;
+}
+
+/**
+ * @brief Renders the results as JSON. Throughput is always over the source (lines and MB of assembly text), so the
+ *        phases can be compared with each other; the output size is given alongside. Each run names the path that
+ *        actually assembled it, since the chunked path falls back to the single pass on a file it cannot split.
+ * @param runs Results, one per source size.
+ * @param seed Generator seed.
+ * @param repeat Runs each timing is the best of.
+ * @param threads Pool size, or 0 for the single pass.
+ * @return The JSON text.
+ */
+std::string results_json(const std::vector<BenchmarkRun>& runs,uint32_t seed,int repeat,unsigned threads){
+    std::string json = "{\n";
+    json += "  \"seed\": " + std::to_string(seed) + ",\n";
+    json += "  \"repeat\": " + std::to_string(repeat) + ",\n";
+    json += "  \"threads\": " + std::to_string(threads) + ",\n";
+    json += "  \"runs\": [\n";
+    for(size_t i = 0; i < runs.size(); i++){
+        const BenchmarkRun& run = runs[i];
+        json += "    {\n";
+        json += "      \"lines\": " + std::to_string(run.lines) + ",\n";
+        json += std::string("      \"mode\": \"") + (run.chunked ? "chunked" : "single pass") + "\",\n";
+        json += "      \"source_bytes\": " + std::to_string(run.sourceBytes) + ",\n";
+        json += "      \"output_bytes\": " + std::to_string(run.outputBytes) + ",\n";
+        json += "      \"phases\": {\n";
+        json += phase_json("load",run.loadNanoseconds,run,false);
+        json += phase_json("pass1",run.pass1Nanoseconds,run,false);
+        //the single pass has no pass 2 of its own, only the fixups and segments finished after it (counted in total)
+        json += phase_json("pass2",run.pass2Nanoseconds,run,false,run.chunked);
+        json += phase_json("write",run.writeNanoseconds,run,false);
+        json += phase_json("total",run.loadNanoseconds + run.pass1Nanoseconds + run.pass2Nanoseconds + run.writeNanoseconds,run,true);
+        json += "      }\n";
+        json += i + 1 < runs.size() ? "    },\n" : "    }\n";
+    }
+    json += "  ]\n}\n";
+    return json;
+}
+
+
+
+/**
+ * @brief Program entry point. Generates sources of each size, assembles them and reports the time of every phase.
+ *        Usage: 8080Bench [--lines <count>]... [--seed <n>] [--repeat <n>] [-j <threads>] [--dir <dir>] [-o <results.json>]
+ *        Without --lines the sizes are 10k, 100k, 1M and 10M lines. The seed defaults to 1 and the repeat count to 3.
+ *        Without -j the single pass is measured; with it, the chunked two-pass path on a pool of that many threads
+ *        (0 for one per core). Sources and binaries are generated in --dir (a temporary directory by default) and
+ *        removed afterwards. The JSON goes to -o, or to stdout.
+ * @param argc Argument count.
+ * @param argv Argument values.
+ * @return Exit code (0 on success, non-zero on failure).
+ */
+int main(int argc, char* argv[]){
+    std::vector<size_t> lineCounts;
+    uint32_t seed = 1;
+    int repeat = 3;
+    bool chunked = false;
+    unsigned threadCount = 0;
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "8080Bench";
+    std::string OutputPath = "-";
+    for(int i = 1; i < argc; i++){
+        std::string_view arg = argv[i];
+        if(arg == "--lines" && i + 1 < argc){
+            lineCounts.push_back(static_cast<size_t>(std::strtoull(argv[++i],nullptr,10)));
+        }
+        else if(arg == "--seed" && i + 1 < argc){
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i],nullptr,10));
+        }
+        else if(arg == "--repeat" && i + 1 < argc){
+            repeat = std::atoi(argv[++i]);
+        }
+        else if(arg == "-j" && i + 1 < argc){
+            chunked = true;
+            threadCount = static_cast<unsigned>(std::strtoul(argv[++i],nullptr,10));
+        }
+        else if(arg == "--dir" && i + 1 < argc){
+            directory = argv[++i];
+        }
+        else if(arg == "-o" && i + 1 < argc){
+            OutputPath = argv[++i];
+        }
+        else{
+            std::cout << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+    if(lineCounts.empty()){
+        lineCounts.assign(std::begin(DEFAULT_LINE_COUNTS),std::end(DEFAULT_LINE_COUNTS));
+    }
+    if(repeat < 1){
+        repeat = 1;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(directory,error);
+    std::unique_ptr<ThreadPool> pool;
+    if(chunked){
+        pool = std::make_unique<ThreadPool>(threadCount);
+    }
+
+    std::vector<BenchmarkRun> runs;
+    for(size_t lineCount : lineCounts){
+        if(lineCount == 0){
+            continue;
+        }
+        std::string sourcePath = (directory / ("bench" + std::to_string(lineCount) + ".asm")).string();
+        std::string outputPath = (directory / ("bench" + std::to_string(lineCount) + ".bin")).string();
+        if(!write_output(sourcePath,generate_source(lineCount,seed))){
+            std::cout << sourcePath << " could not be written." << std::endl;
+            return 1;
+        }
+        BenchmarkRun& run = runs.emplace_back();
+        bool measured = measure(sourcePath,outputPath,repeat,pool.get(),run);
+        std::filesystem::remove(sourcePath,error);
+        std::filesystem::remove(outputPath,error);
+        if(!measured){
+            return 1;
+        }
+        //progress goes to stderr so stdout stays valid JSON
+        std::cerr << lineCount << " lines: " << (run.pass1Nanoseconds + run.pass2Nanoseconds) / 1000000 << " ms to assemble" << std::endl;
+    }
+    if(!write_output(OutputPath,results_json(runs,seed,repeat,pool != nullptr ? static_cast<unsigned>(pool->size()) : 0))){
+        std::cout << OutputPath << " could not be written." << std::endl;
+        return 1;
+    }
+    return 0;
+}
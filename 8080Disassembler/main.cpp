@@ -1,284 +1,138 @@
+#include <bitset>
+#include <charconv>
 #include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
 #include <string>
+#include <string_view>
 #include <vector>
+#include "i8080InstructionData.h"
+#include "SourceMap.h"
 
 /**
- * Strings and instruction sizes for Intel 8080.
+ * Text and size of an opcode for Intel 8080, generated from the assembler's instruction table.
  */
 struct i80 {
-    std::string mnemonic;   //instruction name
-    uint8_t size;           //Size of instruction in bytes
+    char mnemonic[10] = {};   //instruction name and register operands, ending in a tab or ", " when an immediate follows
+    uint8_t size = 0;         //Size of instruction in bytes
+};
+
+struct DecodeTable {
+    i80 opcodes[256];
 };
 
 /**
- * Table of Intel 8080 instructions.
+ * @brief Gives the documented opcode an undocumented one behaves as (the 8080 decodes only some of the bits of these).
+ * @param opcode Opcode byte.
+ * @return The documented opcode with the same effect; opcode itself if it is documented.
+ */
+constexpr uint8_t documented_opcode(uint8_t opcode){
+    if((opcode & 0xC7) == 0x00){
+        return 0x00;    //NOP
+    }
+    if(opcode == 0xCB){
+        return 0xC3;    //JMP
+    }
+    if(opcode == 0xD9){
+        return 0xC9;    //RET
+    }
+    if((opcode & 0xCF) == 0xCD){
+        return 0xCD;    //CALL
+    }
+    return opcode;
+}
+
+/**
+ * @brief Names the operand a field of an opcode holds.
+ * @param insn Instruction the opcode encodes.
+ * @param field Field of the opcode.
+ * @param code Value of the field.
+ * @return Operand text, lowercase.
+ */
+constexpr std::string_view operand_name(const Instruction& insn, const OperandField& field, int code){
+    constexpr std::string_view registers[] = {"b", "c", "d", "e", "h", "l", "m", "a"};
+    constexpr std::string_view pairs[] = {"b", "d", "h", "sp"};
+    constexpr std::string_view vectors[] = {"0", "1", "2", "3", "4", "5", "6", "7"};
+    switch(field.kind){
+        case FieldKind::Register:
+            return registers[code];
+        case FieldKind::RegPair:
+            //pair 3 is the stack pointer, except to PUSH and POP
+            if(code == static_cast<int>(RP::SP) && (insn.mnemonic == "PUSH" || insn.mnemonic == "POP")){
+                return "psw";
+            }
+            return pairs[code];
+        case FieldKind::Vector:
+            return vectors[code];
+        default:
+            return "";
+    }
+}
+
+/**
+ * @brief Appends text to the mnemonic of a table entry.
+ * @param entry Entry being built.
+ * @param length Characters written so far, advanced past text.
+ * @param text Text to append.
+ * @return None.
  */
+constexpr void append(i80& entry, size_t& length, std::string_view text){
+    for(char c : text){
+        entry.mnemonic[length++] = c;
+    }
+}
 
-const i80 insn[256] ={
-    { "nop",1 },
-    { "lxi b, ",3 },
-    { "stax\tb",   1 },
-    { "inx\tb",    1 },
-    { "inr\tb",    1 },
-    { "dcr\tb",    1 },
-    { "mvi\tb, ",  2 },
-    { "rlc",       1 },
-    { "nop",       1 },
-    { "dad",       1 },
-    { "ldax\tb",   1 },
-    { "dcx\tb",    1 },
-    { "inr\tc",    1 },
-    { "dcr\tc",    1 },
-    { "mvi\tc, ",  2 },
-    { "rrc",       1 },
-    { "nop",       1 },
-    { "lxi\td, ",  3 },
-    { "stax\td",   1 },
-    { "inx\td",    1 },
-    { "inr\td",    1 },
-    { "dcr\td",    1 },
-    { "mvi\td, ",  2 },
-    { "ral",       1 },
-    { "nop",       1 },
-    { "dad\td",    1 },
-    { "ldax\td",   1 },
-    { "dcx\td" ,   1 },
-    { "inr\te",    1 },
-    { "dcr\te",    1 },
-    { "mvi\te, ",  2 },
-    { "rar",       1 },
-    { "nop",       1 },
-    { "lxi\th, ",  3 },
-    { "shld\t",    3 },
-    { "inx\th",    1 },
-    { "inr\th",    1 },
-    { "dcr\th",    1 },
-    { "mvi\th, ",  2 },
-    { "daa",       1 },
-    { "nop",       1 },
-    { "dad\th",    1 },
-    { "lhld\t",    3 },
-    { "dcx\th",    1 },
-    { "inr\tl",    1 },
-    { "dcr\tl",    1 },
-    { "mvi\tl, ",  2 },
-    { "cma",       1 },
-    { "nop",       1 },
-    { "lxi\tsp, ", 3 },
-    { "sta\t",     3 },
-    { "inx\tsp",   1 },
-    { "inr\tm",    1 },
-    { "dcr\tm",    1 },
-    { "mvi\tm, ",  2 },
-    { "stc",       1 },
-    { "nop",       1 },
-    { "dad\tsp",   1 },
-    { "lda\t",     3 },
-    { "dcx\tsp",   1 },
-    { "inr\ta",    1 },
-    { "dcr\ta",    1 },
-    { "mvi\ta, ",  2 },
-    { "cmc",       1 },
-    { "mov\tb, b", 1 },
-    { "mov\tb, c", 1 },
-    { "mov\tb, d", 1 },
-    { "mov\tb, e", 1 },
-    { "mov\tb, h", 1 },
-    { "mov\tb, l", 1 },
-    { "mov\tb, m", 1 },
-    { "mov\tb, a", 1 },
-    { "mov\tc, b", 1 },
-    { "mov\tc, c", 1 },
-    { "mov\tc, d", 1 },
-    { "mov\tc, e", 1 },
-    { "mov\tc, h", 1 },
-    { "mov\tc, l", 1 },
-    { "mov\tc, m", 1 },
-    { "mov\tc, a", 1 },
-    { "mov\td, b", 1 },
-    { "mov\td, c", 1 },
-    { "mov\td, d", 1 },
-    { "mov\td, e", 1 },
-    { "mov\td, h", 1 },
-    { "mov\td, l", 1 },
-    { "mov\td, m", 1 },
-    { "mov\td, a", 1 },
-    { "mov\te, b", 1 },
-    { "mov\te, c", 1 },
-    { "mov\te, d", 1 },
-    { "mov\te, e", 1 },
-    { "mov\te, h", 1 },
-    { "mov\te, l", 1 },
-    { "mov\te, m", 1 },
-    { "mov\te, a", 1 },
-    { "mov\th, b", 1 },
-    { "mov\th, c", 1 },
-    { "mov\th, d", 1 },
-    { "mov\th, e", 1 },
-    { "mov\th, h", 1 },
-    { "mov\th, l", 1 },
-    { "mov\th, m", 1 },
-    { "mov\th, a", 1 },
-    { "mov\tl, b", 1 },
-    { "mov\tl, c", 1 },
-    { "mov\tl, d", 1 },
-    { "mov\tl, e", 1 },
-    { "mov\tl, h", 1 },
-    { "mov\tl, l", 1 },
-    { "mov\tl, m", 1 },
-    { "mov\tl, a", 1 },
-    { "mov\tm, b", 1 },
-    { "mov\tm, c", 1 },
-    { "mov\tm, d", 1 },
-    { "mov\tm, e", 1 },
-    { "mov\tm, h", 1 },
-    { "mov\tm, l", 1 },
-    { "hlt",       1 },
-    { "mov\tm, a", 1 },
-    { "mov\ta, b", 1 },
-    { "mov\ta, c", 1 },
-    { "mov\ta, d", 1 },
-    { "mov\ta, e", 1 },
-    { "mov\ta, h", 1 },
-    { "mov\ta, l", 1 },
-    { "mov\ta, m", 1 },
-    { "mov\ta, a", 1 },
-    { "add\tb",    1 },
-    { "add\tc",    1 },
-    { "add\td",    1 },
-    { "add\te",    1 },
-    { "add\th",    1 },
-    { "add\tl",    1 },
-    { "add\tm",    1 },
-    { "add\ta",    1 },
-    { "adc\tb",    1 },
-    { "adc\tc",    1 },
-    { "adc\td",    1 },
-    { "adc\te",    1 },
-    { "adc\th",    1 },
-    { "adc\tl",    1 },
-    { "adc\tm",    1 },
-    { "adc\ta",    1 },
-    { "sub\tb",    1 },
-    { "sub\tc",    1 },
-    { "sub\td",    1 },
-    { "sub\te",    1 },
-    { "sub\th",    1 },
-    { "sub\tl",    1 },
-    { "sub\tm",    1 },
-    { "sub\ta",    1 },
-    { "sbb\tb",    1 },
-    { "sbb\tc",    1 },
-    { "sbb\td",    1 },
-    { "sbb\te",    1 },
-    { "sbb\th",    1 },
-    { "sbb\tl",    1 },
-    { "sbb\tm",    1 },
-    { "sbb\ta",    1 },
-    { "ana\tb",    1 },
-    { "ana\tc",    1 },
-    { "ana\td",    1 },
-    { "ana\te",    1 },
-    { "ana\th",    1 },
-    { "ana\tl",    1 },
-    { "ana\tm",    1 },
-    { "ana\ta",    1 },
-    { "xra\tb",    1 },
-    { "xra\tc",    1 },
-    { "xra\td",    1 },
-    { "xra\te",    1 },
-    { "xra\th",    1 },
-    { "xra\tl",    1 },
-    { "xra\tm",    1 },
-    { "xra\ta",    1 },
-    { "ora\tb",    1 },
-    { "ora\tc",    1 },
-    { "ora\td",    1 },
-    { "ora\te",    1 },
-    { "ora\th",    1 },
-    { "ora\tl",    1 },
-    { "ora\tm",    1 },
-    { "ora\ta",    1 },
-    { "cmp\tb",    1 },
-    { "cmp\tc",    1 },
-    { "cmp\td",    1 },
-    { "cmp\te",    1 },
-    { "cmp\th",    1 },
-    { "cmp\tl",    1 },
-    { "cmp\tm",    1 },
-    { "cmp\ta",    1 },
-    { "rnz",       1 },
-    { "pop\tb",    1 },
-    { "jnz\t",     3 },
-    { "jmp\t",     3 },
-    { "cnz\t",     3 },
-    { "push\tb",   1 },
-    { "adi\t",     2 },
-    { "rst\t0",    1 },
-    { "rz",        1 },
-    { "ret",       1 },
-    { "jz\t",      3 },
-    { "jmp\t",     3 },
-    { "cz\t",      3 },
-    { "call\t",    3 },
-    { "aci\t",     2 },
-    { "rst\t1",    1 },
-    { "rnc",       1 },
-    { "pop\td",    1 },
-    { "jnc\t",     3 },
-    { "out\t",     2 },
-    { "cnc\t",     3 },
-    { "push\td",   1 },
-    { "sui\t",     2 },
-    { "rst\t2",    1 },
-    { "rc",        1 },
-    { "ret",       1 },
-    { "jc\t",      3 },
-    { "in\t",      2 },
-    { "cc\t",      3 },
-    { "call\t",    3 },
-    { "sbi\t",     2 },
-    { "rst\t3",    1 },
-    { "rpo",       1 },
-    { "pop\th",    1 },
-    { "jpo\t",     3 },
-    { "xthl",      1 },
-    { "cpo\t",     3 },
-    { "push\th",   1 },
-    { "ani\t",     2 },
-    { "rst\t4",    1 },
-    { "rpe",       1 },
-    { "pchl",      1 },
-    { "jpe\t",     3 },
-    { "xchg",      1 },
-    { "cpe\t",     3 },
-    { "call\t",    3 },
-    { "xri\t",     2 },
-    { "rst\t5",    1 },
-    { "rp",        1 },
-    { "pop\tpsw",  1 },
-    { "jp\t",      3 },
-    { "di",        1 },
-    { "cp\t",      3 },
-    { "push\tpsw", 1 },
-    { "ori\t",     2 },
-    { "rst\t6",    1 },
-    { "rm",        1 },
-    { "sphl",      1 },
-    { "jm\t",      3 },
-    { "ei",        1 },
-    { "cm\t",      3 },
-    { "call\t",    3 },
-    { "cpi\t",     2 },
-    { "rst\t7",    1 }
+/**
+ * @brief Renders every opcode byte from the instruction table the assembler encodes with, so the two cannot disagree.
+ * @param None.
+ * @return The decode table.
+ */
+constexpr DecodeTable build_decode_table(){
+    DecodeTable table;
+    for(int byte = 0; byte < 256; byte++){
+        uint8_t opcode = documented_opcode(static_cast<uint8_t>(byte));
+        const Instruction& insn = i8080Instructions[i8080Opcodes.opcodes[opcode].instruction];
+        i80& entry = table.opcodes[byte];
+        size_t length = 0;
+        for(char c : insn.mnemonic){
+            entry.mnemonic[length++] = static_cast<char>(c - 'A' + 'a');
+        }
+        bool hasField = insn.arg1.kind != FieldKind::None;
+        if(hasField || insn.size > 1){
+            append(entry, length, "\t");
+        }
+        if(hasField){
+            append(entry, length, operand_name(insn, insn.arg1, opcode >> insn.arg1.shift & insn.arg1.mask));
+        }
+        if(insn.arg2.kind != FieldKind::None){
+            append(entry, length, ", ");
+            append(entry, length, operand_name(insn, insn.arg2, opcode >> insn.arg2.shift & insn.arg2.mask));
+        }
+        if(hasField && insn.size > 1){
+            append(entry, length, ", ");
+        }
+        entry.size = insn.size;
+    }
+    return table;
 }
-;
+
+/**
+ * Table of Intel 8080 instructions.
+ */
+inline constexpr DecodeTable insn = build_decode_table();
 
 
+//The source lines an assembler --map file gives the image; empty without --map
+struct SourceLines {
+    std::vector<SourceMapEntry> map;
+    //address the image's first byte was assembled at: the image starts at its lowest segment, whose first byte is
+    //the first entry of the map
+    uint16_t base = 0;
+};
+
 static void print_hex_byte(uint8_t b) {
     std::cout << std::hex << std::uppercase
               << std::setw(2) << std::setfill('0')
@@ -286,7 +140,189 @@ static void print_hex_byte(uint8_t b) {
               << std::dec; // restore decimal for later if needed
 }
 
+/**
+ * @brief Ends a printed line, naming the source line that produced the byte at addr when a source map is loaded.
+ * @param lines Source lines of the image.
+ * @param addr Image offset the printed line starts at.
+ * @return None.
+ */
+void end_line(const SourceLines& lines, size_t addr){
+    const SourceMapEntry* entry = lines.map.empty() ? nullptr : find_source_line(lines.map, static_cast<uint16_t>(lines.base + addr));
+    if(entry != nullptr){
+        std::cout << "\t; line " << entry->line + 1;
+    }
+    std::cout << '\n';
+}
+
+
+/**
+ * @brief Gives the instruction table entry an opcode byte executes as.
+ * @param opcode Opcode byte, documented or not.
+ * @return The entry.
+ */
+const Instruction& decode(uint8_t opcode){
+    return i8080Instructions[i8080Opcodes.opcodes[documented_opcode(opcode)].instruction];
+}
+
+/**
+ * @brief Prints the instruction at addr: its address, mnemonic and immediate (8080 uses little endian).
+ * @param program Image being disassembled.
+ * @param addr Address of the opcode byte.
+ * @param lines Source lines of the image.
+ * @return false if the image ends inside the instruction (it is marked truncated); true otherwise.
+ */
+bool print_instruction(const std::vector<uint8_t>& program, size_t addr, const SourceLines& lines){
+    const i80& instruction = insn.opcodes[program[addr]];
+    std::cout << std::hex << std::setw(4) << std::setfill('0') << addr
+              << "\t" << instruction.mnemonic << std::dec;
+    // Bounds check for truncated instructions
+    if (addr + instruction.size > program.size()) {
+        std::cout << "  ; truncated\n";
+        return false;
+    }
+    if(instruction.size > 1){
+        if(instruction.size == 3){
+            print_hex_byte(program[addr+2]);
+        }
+        print_hex_byte(program[addr+1]);
+        std::cout << "h";
+    }
+    end_line(lines, addr);
+    return true;
+}
+
+/**
+ * @brief Prints bytes no instruction reached as db lines, eight to a line.
+ * @param program Image being disassembled.
+ * @param start First byte.
+ * @param end One past the last byte.
+ * @param lines Source lines of the image.
+ * @return None.
+ */
+void print_data(const std::vector<uint8_t>& program, size_t start, size_t end, const SourceLines& lines){
+    for(size_t line = start; line < end; line += 8){
+        std::cout << std::hex << std::setw(4) << std::setfill('0') << line << "\tdb\t" << std::dec;
+        for(size_t addr = line; addr < end && addr < line + 8; addr++){
+            if(addr != line){
+                std::cout << ", ";
+            }
+            print_hex_byte(program[addr]);
+            std::cout << "h";
+        }
+        end_line(lines, line);
+    }
+}
+
+//What a recursive traversal has reached, a bit per address of the 64 KiB address space
+struct CodeMap {
+    //first bytes of reached instructions
+    std::bitset<0x10000> starts;
+    //every byte of reached instructions
+    std::bitset<0x10000> covered;
+};
+
+/**
+ * @brief Follows control flow from an entry point and marks every instruction it reaches. JMP, Jcc, CALL, Ccc and
+ *        RST targets are queued; a path ends at RET, JMP, PCHL or HLT, at code already traced, or where the image
+ *        ends. Every address starts at most one decode, so all the calls together are linear in the image size.
+ * @param program Image being disassembled (at most 64 KiB).
+ * @param code Code found so far, extended in place.
+ * @param entry Address execution may start at.
+ * @return None.
+ */
+void trace_code(const std::vector<uint8_t>& program, CodeMap& code, uint16_t entry){
+    std::vector<uint16_t> worklist{entry};
+    while(!worklist.empty()){
+        size_t addr = worklist.back();
+        worklist.pop_back();
+        //run down the straight-line code, queueing every branch target on the way
+        while(addr < program.size() && !code.starts[addr]){
+            const Instruction& instruction = decode(program[addr]);
+            if(addr + instruction.size > program.size()){
+                break;
+            }
+            code.starts[addr] = true;
+            for(size_t i = 0; i < instruction.size; i++){
+                code.covered[addr + i] = true;
+            }
+            std::string_view mnemonic = instruction.mnemonic;
+            if(instruction.size == 3 && (mnemonic[0] == 'J' || mnemonic[0] == 'C')){
+                worklist.push_back(static_cast<uint16_t>(program[addr+1] | program[addr+2] << 8));
+            }
+            else if(mnemonic == "RST"){
+                worklist.push_back(program[addr] & 0x38);
+            }
+            if(mnemonic == "JMP" || mnemonic == "RET" || mnemonic == "PCHL" || mnemonic == "HLT"){
+                break;
+            }
+            addr += instruction.size;
+        }
+    }
+}
+
+/**
+ * @brief Prints the traced instructions, and the bytes between them as data.
+ * @param program Image being disassembled.
+ * @param code Code found by trace_code.
+ * @param lines Source lines of the image.
+ * @return None.
+ */
+void print_traced(const std::vector<uint8_t>& program, const CodeMap& code, const SourceLines& lines){
+    size_t addr = 0;
+    while(addr < program.size()){
+        if(!code.starts[addr]){
+            size_t end = addr;
+            while(end < program.size() && !code.starts[end]){
+                end++;
+            }
+            print_data(program, addr, end, lines);
+            addr = end;
+            continue;
+        }
+        print_instruction(program, addr, lines);
+        //code that jumps into the middle of an instruction is shown from there as well
+        size_t next = addr + insn.opcodes[program[addr]].size;
+        while(++addr < next && !code.starts[addr]){}
+    }
+}
+
+/**
+ * @brief Parses a hexadecimal address: bare, with a trailing h, or with a 0x prefix like 8080Link's -b takes.
+ * @param text Address text.
+ * @param address Receives the address.
+ * @return true if text is an address 0-FFFFh; false otherwise.
+ */
+bool parse_address(std::string_view text, uint16_t& address){
+    if(text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')){
+        text.remove_prefix(2);
+    }
+    else if(!text.empty() && (text.back() == 'h' || text.back() == 'H')){
+        text.remove_suffix(1);
+    }
+    unsigned value = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, 16);
+    if(text.empty() || error != std::errc() || end != text.data() + text.size() || value > 0xFFFF){
+        return false;
+    }
+    address = static_cast<uint16_t>(value);
+    return true;
+}
+
 
+/**
+ * @brief Program entry point. Disassembles a binary image loaded at address 0.
+ *        Usage: 8080Disassembler <file> [-r [--no-vectors]] [-e <address>]... [--map <file>]
+ *        By default every byte is decoded as an instruction, from 0000h to the end of the image.
+ *        -r follows control flow instead (see trace_code), from 0000h, every -e address (hexadecimal: 12, 12h or
+ *        0x12) and then the RST vectors an interrupt may enter at, and prints the bytes no path reaches as db lines,
+ *        so tables in the image do not throw the decoding off. A vector inside code already traced is not an entry
+ *        point, and --no-vectors leaves them all out.
+ *        --map reads the source map the assembler wrote with --map for this image and ends every line with the
+ *        source line that produced its first byte.
+ * @param argc Argument count (expects at least 2).
+ * @param argv Argument values.
+ * @return Exit code (0 on success, non-zero on failure).
+ */
 int main(int argc, char* argv[])
 {
     //validate that we were given a file name as a command line argument
@@ -295,8 +331,36 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
+    std::string FilePath;
+    bool recursive = false;
+    bool vectors = true;
+    std::vector<uint16_t> entries;
+    std::string MapPath;
+    for(int i = 1; i < argc; i++){
+        std::string_view arg = argv[i];
+        if(arg == "-r"){
+            recursive = true;
+        }
+        else if(arg == "--no-vectors"){
+            vectors = false;
+        }
+        else if(arg == "-e" && i + 1 < argc){
+            uint16_t address = 0;
+            if(!parse_address(argv[++i], address)){
+                std::cout << "Bad entry point " << argv[i] << ", expected a hexadecimal address up to FFFFh" << std::endl;
+                exit(1);
+            }
+            entries.push_back(address);
+        }
+        else if(arg == "--map" && i + 1 < argc){
+            MapPath = argv[++i];
+        }
+        else{
+            FilePath = argv[i];
+        }
+    }
+
     //open the file
-    std::string FilePath = argv[1];
     std::ifstream infile(FilePath,std::ios::binary);
     //if the file could not be opened, print an error
     if(infile.good() == false){
@@ -310,31 +374,52 @@ int main(int argc, char* argv[])
         std::istreambuf_iterator<char>()
     );
 
-    //now we can disassemble the programs bytes into 8080 assembly instructions
-    int addr = 0;
-    while(addr < program.size()){
-        //find the current instruction represented by the byte were reading
-        i80 instruction = insn[program[addr]];
-        //print its memory address and its mnemonic
-        std::cout << std::hex << std::setw(4) << std::setfill('0') << addr
-                  << "\t" << instruction.mnemonic << std::dec;
-
-        // Bounds check for truncated instructions
-        if (addr + instruction.size > program.size()) {
-            std::cout << "  ; truncated\n";
-            break;
+    SourceLines lines;
+    if(!MapPath.empty()){
+        std::ifstream mapFile(MapPath, std::ios::binary);
+        if(mapFile.good() == false){
+            std::cout << MapPath << " could not be opened." << std::endl;
+            exit(1);
+        }
+        std::string data((std::istreambuf_iterator<char>(mapFile)), std::istreambuf_iterator<char>());
+        if(!read_source_map(data, lines.map)){
+            std::cout << MapPath << " is not a source map." << std::endl;
+            exit(1);
+        }
+        if(!lines.map.empty()){
+            lines.base = lines.map.front().address;
         }
+    }
 
-        //if the instructions size is greater than 1, output the associated info (8080 uses little endian)
-        if(instruction.size > 1){
-            if(instruction.size == 3){
-                print_hex_byte(program[addr+2]);
+    if(recursive){
+        if(program.size() > 0x10000){
+            std::cout << FilePath << " is larger than the 8080 address space." << std::endl;
+            exit(1);
+        }
+        CodeMap code;
+        //reset lands at 0000h
+        trace_code(program, code, 0);
+        for(uint16_t entry : entries){
+            trace_code(program, code, entry);
+        }
+        //an interrupt executes RST n, which lands at n * 8
+        for(uint16_t vector = 8; vectors && vector <= 0x38; vector += 8){
+            if(!code.covered[vector]){
+                trace_code(program, code, vector);
             }
-            print_hex_byte(program[addr+1]);
-            std::cout << "h";
         }
-        std::cout << std::endl;
+        print_traced(program, code, lines);
+        return 0;
+    }
+
+    //now we can disassemble the programs bytes into 8080 assembly instructions
+    size_t addr = 0;
+    while(addr < program.size()){
+        //print the instruction represented by the byte were reading, stopping if the file ends inside it
+        if(!print_instruction(program, addr, lines)){
+            break;
+        }
         //increase the addr incrementer by the size of the instruction
-        addr += instruction.size;
+        addr += insn.opcodes[program[addr]].size;
     }
 }
@@ -0,0 +1,230 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstdlib>
+#include <unordered_map>
+#include "MappedFile.h"
+#include "ObjectFile.h"
+#include "OutputWriters.h"
+
+//An error that stops the link
+struct LinkError{
+    std::string message;
+};
+
+//One object file and the address the linker places it at
+struct LinkedModule{
+    std::string path;
+    ObjectModule module;
+    uint32_t base = 0;
+};
+
+//An exported name and the module it came from, for duplicate errors
+struct LinkedSymbol{
+    uint16_t address = 0;
+    size_t module = 0;
+};
+
+
+
+/**
+*
+*LINKING
+*
+**/
+
+
+
+/**
+ * @brief Places the modules one after another from base, in command line order.
+ * @param modules Modules to place; each receives its base address.
+ * @param base Address of the first module.
+ * @return None (throws LinkError if the modules do not fit in 64K).
+ */
+void place_modules(std::vector<LinkedModule>& modules,uint32_t base){
+    for(LinkedModule& linked : modules){
+        linked.base = base;
+        base += module_extent(linked.module);
+        if(base > 0x10000){
+            throw LinkError{linked.path + " does not fit below 10000h."};
+        }
+    }
+}
+
+/**
+ * @brief Collects every module's exports at their final addresses.
+ * @param modules Placed modules.
+ * @return Exported name -> address and owning module.
+ */
+std::unordered_map<std::string_view,LinkedSymbol> collect_exports(const std::vector<LinkedModule>& modules){
+    std::unordered_map<std::string_view,LinkedSymbol> symbols;
+    for(size_t i = 0; i < modules.size(); i++){
+        for(const ObjectSymbol& symbol : modules[i].module.exports){
+            uint16_t address = static_cast<uint16_t>(symbol.relocatable ? modules[i].base + symbol.value : symbol.value);
+            auto inserted = symbols.insert({symbol.name,{address,i}});
+            if(!inserted.second){
+                throw LinkError{"[" + symbol.name + "] is exported by both " + modules[inserted.first->second.module].path +
+                                " and " + modules[i].path + "."};
+            }
+        }
+    }
+    return symbols;
+}
+
+/**
+ * @brief Applies a module's relocations in one pass: each word gets the module's base address or its import's
+ *        address added to it.
+ * @param linked Placed module; its bytes are patched.
+ * @param symbols Exports of every module.
+ * @return None (throws LinkError naming an import no module exports).
+ */
+void relocate(LinkedModule& linked,const std::unordered_map<std::string_view,LinkedSymbol>& symbols){
+    std::vector<uint16_t> imports;
+    imports.reserve(linked.module.imports.size());
+    for(const std::string& name : linked.module.imports){
+        auto symbol = symbols.find(name);
+        if(symbol == symbols.end()){
+            throw LinkError{linked.path + " uses [" + name + "], which no module exports."};
+        }
+        imports.push_back(symbol->second.address);
+    }
+    uint8_t* bytes = linked.module.bytes.data();
+    for(const ObjectRelocation& relocation : linked.module.relocations){
+        uint16_t add = relocation.import == LOCAL_RELOCATION ? static_cast<uint16_t>(linked.base) : imports[relocation.import];
+        uint8_t* word = bytes + relocation.offset;
+        uint16_t value = static_cast<uint16_t>((word[0] | word[1] << 8) + add);
+        word[0] = static_cast<uint8_t>(value & 0xFF);
+        word[1] = static_cast<uint8_t>(value >> 8);
+    }
+}
+
+/**
+ * @brief Links the modules into one image.
+ * @param modules Loaded modules, in the order they are placed.
+ * @param base Address of the first module.
+ * @return The image's segments, in address order, pointing into the modules' bytes.
+ */
+std::vector<ImageSegment> link(std::vector<LinkedModule>& modules,uint32_t base){
+    place_modules(modules,base);
+    std::unordered_map<std::string_view,LinkedSymbol> symbols = collect_exports(modules);
+    std::vector<ImageSegment> segments;
+    for(LinkedModule& linked : modules){
+        relocate(linked,symbols);
+        for(const ObjectSection& section : linked.module.sections){
+            segments.push_back({linked.base + section.origin,linked.module.bytes.data() + section.offset,section.size});
+        }
+    }
+    return segments;
+}
+
+
+
+/**
+ * @brief Program entry point. Reads object files written by 8080Assembler -f obj, links them and writes the image.
+ *        Usage: 8080Link <file|@manifest>... [-o <output>] [-f bits|bin|hex] [-b <base>]
+ *        Modules are placed one after another from base (0 unless -b is given, e.g. -b 0x100) in the order given.
+ *        Without -o the image is printed to stdout as bits; with -o the format follows the output file's extension
+ *        unless -f is given.
+ * @param argc Argument count (expects at least 2).
+ * @param argv Argument values.
+ * @return Exit code (0 on success, non-zero on failure).
+ */
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        std::cout << "Provide object file names";
+        return 1;
+    }
+
+    std::vector<std::string> inputs;
+    std::string OutputPath = "-";
+    OutputFormat format = OutputFormat::Bits;
+    bool formatGiven = false;
+    uint32_t base = 0;
+    for(int i = 1; i < argc; i++){
+        std::string_view arg = argv[i];
+        if(arg == "-o" && i + 1 < argc){
+            OutputPath = argv[++i];
+        }
+        else if(arg == "-f" && i + 1 < argc){
+            if(!parse_output_format(argv[++i],format)){
+                std::cout << "Unknown output format " << argv[i] << ", expected bits, bin or hex" << std::endl;
+                return 1;
+            }
+            formatGiven = true;
+        }
+        else if(arg == "-b" && i + 1 < argc){
+            base = static_cast<uint32_t>(std::strtoul(argv[++i],nullptr,0));
+        }
+        else if(arg.size() > 1 && arg[0] == '@'){
+            MappedFile manifest;
+            if(!manifest.open(std::string(arg.substr(1)))){
+                std::cout << arg.substr(1) << " could not be opened." << std::endl;
+                return 1;
+            }
+            for(std::string_view line : split_lines(manifest.view())){
+                line = line.substr(0,line.find(';'));
+                while(!line.empty() && (line.back() == ' ' || line.back() == '\t' || line.back() == '\r')){
+                    line.remove_suffix(1);
+                }
+                while(!line.empty() && (line.front() == ' ' || line.front() == '\t')){
+                    line.remove_prefix(1);
+                }
+                if(!line.empty()){
+                    inputs.emplace_back(line);
+                }
+            }
+        }
+        else{
+            inputs.emplace_back(arg);
+        }
+    }
+    if(!formatGiven && OutputPath != "-"){
+        format = format_from_extension(OutputPath);
+    }
+    if(format == OutputFormat::Listing || format == OutputFormat::Object){
+        std::cout << "8080Link writes bits, bin or hex" << std::endl;
+        return 1;
+    }
+
+    std::vector<LinkedModule> modules(inputs.size());
+    for(size_t i = 0; i < inputs.size(); i++){
+        MappedFile object;
+        modules[i].path = inputs[i];
+        if(!object.open(inputs[i])){
+            std::cout << inputs[i] << " could not be opened." << std::endl;
+            return 1;
+        }
+        if(!read_object(object.view(),modules[i].module)){
+            std::cout << inputs[i] << " is not an 8080 object file." << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<ImageSegment> segments;
+    try{
+        segments = link(modules,base);
+    }
+    catch(const LinkError& error){
+        std::cout << error.message << std::endl;
+        return 1;
+    }
+    bool written = false;
+    switch(format){
+        case OutputFormat::Binary:
+            written = write_image(OutputPath,segments);
+            break;
+        case OutputFormat::IntelHex:
+            written = write_output(OutputPath,render_intel_hex(segments));
+            break;
+        default:
+            written = write_output(OutputPath,render_bits(segments));
+            break;
+    }
+    if(!written){
+        std::cout << OutputPath << " could not be written." << std::endl;
+        return 1;
+    }
+    return 0;
+}